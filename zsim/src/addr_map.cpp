@@ -0,0 +1,147 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "addr_map.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "bithacks.h"
+#include "config.h"  // for Tokenize
+#include "log.h"
+
+AddrMapper::AddrMapper(const char* _name, const char* _layout, HashType _hash)
+    : name(_name), layout(_layout), hash(_hash), ready(false) {}
+
+uint32_t AddrMapper::addField(const char* fieldName, uint32_t count, bool hashed) {
+    assert(!ready);
+    if (count == 0) panic("%s: address field %s has no values", name.c_str(), fieldName);
+    Field f;
+    f.name = fieldName;
+    f.count = count;
+    f.pow2 = isPow2(count);
+    f.bits = (count == 1)? 0 : ilog2(count - 1) + 1;
+    f.hashed = hashed && count > 1;
+    f.pos = -1u;
+    f.hashShift = 0;
+    fields.push_back(f);
+    return fields.size() - 1;
+}
+
+void AddrMapper::init() {
+    std::vector<std::string> tokens;
+    Tokenize(layout.c_str(), tokens, ":");
+    std::reverse(tokens.begin(), tokens.end());  // want lowest bits first
+
+    for (std::string t : tokens) {
+        uint32_t idx = 0;
+        while (idx < fields.size() && t != fields[idx].name.c_str()) idx++;
+        if (idx == fields.size()) panic("%s: invalid token %s in address mapping %s", name.c_str(), t.c_str(), layout.c_str());
+        if (fields[idx].pos != -1u) panic("%s: repeated field %s in address mapping %s", name.c_str(), t.c_str(), layout.c_str());
+        fields[idx].pos = order.size();
+        order.push_back(idx);
+    }
+    for (Field& f : fields) {
+        if (f.pos == -1u) panic("%s: address mapping %s lacks field %s", name.c_str(), layout.c_str(), f.name.c_str());
+    }
+
+    // Hashed fields take consecutive row slices, LSB field first
+    uint32_t hashShift = 0;
+    for (uint32_t idx : order) {
+        Field& f = fields[idx];
+        if (hash == HASH_NONE || !f.hashed) continue;
+        f.hashShift = hashShift;
+        hashShift += f.bits;
+    }
+    ready = true;
+
+    std::string desc;
+    for (auto it = order.rbegin(); it != order.rend(); it++) {
+        const Field& f = fields[*it];
+        char buf[64];
+        snprintf(buf, sizeof(buf), " %s:%d%s", f.name.c_str(), f.count, (hash != HASH_NONE && f.hashed)? "(h)" : "");
+        desc += buf;
+    }
+    const char* hashStr[] = {"None", "Permutation", "XORFold"};
+    info("%s: Address mapping row%s, hash %s", name.c_str(), desc.c_str(), hashStr[hash]);
+}
+
+inline uint32_t AddrMapper::hashField(const Field& f, Address row) const {
+    Address src = row >> f.hashShift;
+    if (hash == HASH_XORFOLD) {
+        Address h = 0;
+        while (src) {
+            h ^= src & ((1ul << f.bits) - 1);
+            src >>= f.bits;
+        }
+        return h;
+    } else {
+        return src & ((1ul << f.bits) - 1);
+    }
+}
+
+Address AddrMapper::map(Address lineAddr, uint32_t* vals) const {
+    assert(ready);
+    Address a = lineAddr;
+    for (uint32_t idx : order) {
+        const Field& f = fields[idx];
+        if (f.pow2) {
+            vals[idx] = a & (f.count - 1);
+            a >>= f.bits;
+        } else {
+            vals[idx] = a % f.count;
+            a /= f.count;
+        }
+    }
+    Address row = a;
+
+    if (hash != HASH_NONE) {
+        for (uint32_t idx : order) {
+            const Field& f = fields[idx];
+            if (!f.hashed) continue;
+            uint32_t h = hashField(f, row);
+            vals[idx] = f.pow2? (vals[idx] ^ h) : (vals[idx] + h) % f.count;
+        }
+    }
+    return row;
+}
+
+Address AddrMapper::compact(const uint32_t* vals, Address row, uint32_t skipField) const {
+    assert(ready);
+    Address a = row;
+    for (auto it = order.rbegin(); it != order.rend(); it++) {
+        if (*it == skipField) continue;
+        a = a*fields[*it].count + vals[*it];
+    }
+    return a;
+}
+
+AddrMapper::HashType AddrMapper::parseHash(const char* str) {
+    std::string s(str);
+    if (s == "None") return HASH_NONE;
+    else if (s == "Permutation") return HASH_PERMUTATION;
+    else if (s == "XORFold") return HASH_XORFOLD;
+    panic("Invalid address hash %s (None, Permutation, or XORFold)", str);
+}
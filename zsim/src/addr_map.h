@@ -0,0 +1,96 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ADDR_MAP_H_
+#define ADDR_MAP_H_
+
+/* Address-mapping engine shared by the memory controllers. A mapper splits a
+ * line address into named fields (channel, rank, bank, column...), laid out
+ * from a colon-separated string with the most significant field first (e.g.,
+ * "rank:col:bank"). Whatever is left above the fields is the row, which has
+ * no fixed width because we don't know how large addresses are.
+ *
+ * Fields may be hashed with row bits, so that strided accesses that map to the
+ * same bank or channel with plain bit-fields get spread out:
+ *  - Permutation: field ^= a slice of the low row bits (permutation-based page
+ *    interleaving, Zhang et al., MICRO 2000). Each hashed field uses a
+ *    different slice.
+ *  - XORFold: field ^= XOR of all field-wide chunks of the row (shifted by the
+ *    field's slice), so that every row bit affects the field.
+ * Fields that are not a power of 2 (e.g., 3 channels) are split with modulo
+ * arithmetic and hashed by modular addition. Either way, the mapping is a
+ * bijection: given the row, each hash just permutes the field's values.
+ */
+
+#include "g_std/g_string.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "memory_hierarchy.h"
+
+class AddrMapper : public GlobAlloc {
+    public:
+        enum HashType {HASH_NONE, HASH_PERMUTATION, HASH_XORFOLD};
+
+    private:
+        struct Field {
+            g_string name;
+            uint32_t count;
+            uint32_t bits;    // ceil(log2(count))
+            bool pow2;
+            bool hashed;
+            uint32_t pos;     // position in layout, LSB = 0
+            uint32_t hashShift;  // start of the row slice used to hash this field
+        };
+
+        const g_string name;
+        const g_string layout;
+        const HashType hash;
+        g_vector<Field> fields;  // in definition order (the order callers index them by)
+        g_vector<uint32_t> order;  // field indices, LSB first
+        bool ready;
+
+    public:
+        AddrMapper(const char* _name, const char* _layout, HashType _hash);
+
+        // Fields must be defined before init(), and callers refer to them by definition order (0, 1, ...)
+        uint32_t addField(const char* fieldName, uint32_t count, bool hashed = true);
+
+        // Parses the layout; every defined field must appear exactly once
+        void init();
+
+        // Fills vals (indexed by definition order) and returns the row
+        Address map(Address lineAddr, uint32_t* vals) const;
+
+        // Inverse of map() without the given field: packs the other fields and
+        // the row into a dense address (e.g., the address within a channel)
+        Address compact(const uint32_t* vals, Address row, uint32_t skipField) const;
+
+        static HashType parseHash(const char* str);
+
+    private:
+        uint32_t hashField(const Field& f, Address row) const;
+};
+
+#endif  // ADDR_MAP_H_
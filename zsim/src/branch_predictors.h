@@ -0,0 +1,388 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BRANCH_PREDICTORS_H_
+#define BRANCH_PREDICTORS_H_
+
+#include <stdint.h>
+#include "bithacks.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+/* Branch predictors for OOOCore. They share no base class: OOOCore is
+ * templated on the predictor, so predict() is inlined in the core's BBL
+ * loop. Every predictor implements:
+ *
+ *   bool predict(Address branchPc, bool taken);  // predicts and updates; returns false if mispredicted
+ *   uint64_t getStorageBits() const;             // size of the modeled predictor state
+ *   void initStats(AggregateStat* bpStat);       // predictor-specific stats, if any
+ */
+
+enum BranchPredictorType {BP_PAG_A2, BP_PAG_A3, BP_GSHARE, BP_TAGE, BP_PERCEPTRON};
+
+/* 2-level branch predictor:
+ *  - L1: Branch history shift registers (bshr): 2^NB entries, HB bits of history/entry, indexed by XOR'd PC
+ *  - L2: Pattern history table (pht): 2^LB entries, 2-bit sat counters, indexed by XOR'd bshr contents
+ *  NOTE: Assumes LB is in [NB, HB] range for XORing (e.g., HB = 18 and NB = 10, LB = 13 is OK)
+ *  A3 selects Yeh and Patt's automaton A3 instead of the A2 saturating counter for PHT updates.
+ */
+template<uint32_t NB, uint32_t HB, uint32_t LB, bool A3>
+class BranchPredictorPAg {
+    private:
+        uint32_t bhsr[1 << NB];
+        uint8_t pht[1 << LB];
+
+    public:
+        BranchPredictorPAg() {
+            uint32_t numBhsrs = 1 << NB;
+            uint32_t phtSize = 1 << LB;
+
+            for (uint32_t i = 0; i < numBhsrs; i++) {
+                bhsr[i] = 0;
+            }
+            for (uint32_t i = 0; i < phtSize; i++) {
+                pht[i] = 1;  // weak non-taken
+            }
+
+            static_assert(LB <= HB, "Too many PHT entries");
+            static_assert(LB >= NB, "Too few PHT entries (you'll need more XOR'ing)");
+        }
+
+        // Predicts and updates; returns false if mispredicted
+        inline bool predict(Address branchPc, bool taken) {
+            uint32_t bhsrMask = (1 << NB) - 1;
+            uint32_t histMask = (1 << HB) - 1;
+            uint32_t phtMask  = (1 << LB) - 1;
+
+            // Predict
+            // uint32_t bhsrIdx = ((uint32_t)( branchPc ^ (branchPc >> NB) ^ (branchPc >> 2*NB) )) & bhsrMask;
+            uint32_t bhsrIdx = ((uint32_t)( branchPc >> 1)) & bhsrMask;
+            uint32_t phtIdx = bhsr[bhsrIdx];
+
+            // Shift-XOR-mask to fit in PHT
+            phtIdx ^= (phtIdx & ~phtMask) >> (HB - LB); // take the [HB-1, LB] bits of bshr, XOR with [LB-1, ...] bits
+            phtIdx &= phtMask;
+
+            // If uncommented, behaves like a global history predictor
+            // bhsrIdx = 0;
+            // phtIdx = (bhsr[bhsrIdx] ^ ((uint32_t)branchPc)) & phtMask;
+
+            bool pred = pht[phtIdx] > 1;
+
+            // info("BP Pred: 0x%lx bshr[%d]=%x taken=%d pht=%d pred=%d", branchPc, bhsrIdx, phtIdx, taken, pht[phtIdx], pred);
+
+            // Update
+            if (!A3) {
+                pht[phtIdx] = taken? (pred? 3 : (pht[phtIdx]+1)) : (pred? (pht[phtIdx]-1) : 0); //2-bit saturating counter
+            } else {
+                // Automaton 3: like A2, but a misprediction in a weak state jumps to the strong opposite state (1 -T-> 3, 2 -NT-> 0)
+                pht[phtIdx] = taken? ((pred || pht[phtIdx] == 1)? 3 : 1) : ((!pred || pht[phtIdx] == 2)? 0 : 2);
+            }
+            bhsr[bhsrIdx] = ((bhsr[bhsrIdx] << 1) & histMask ) | (taken? 1: 0); //we apply phtMask here, dependence is further away
+
+            // info("BP Update: newPht=%d newBshr=%x", pht[phtIdx], bhsr[bhsrIdx]);
+            return (taken == pred);
+        }
+
+        uint64_t getStorageBits() const {return (1 << NB)*HB + (1 << LB)*2;}
+
+        void initStats(AggregateStat* bpStat) {}
+};
+
+/* Global-history predictor (McFarling's gshare): 2^LB 2-bit counters, indexed by the PC XOR'd with LB bits of global history */
+template<uint32_t LB>
+class BranchPredictorGShare {
+    private:
+        uint8_t pht[1 << LB];
+        uint32_t ghist;
+
+    public:
+        BranchPredictorGShare() : ghist(0) {
+            for (uint32_t i = 0; i < (1 << LB); i++) pht[i] = 1;  // weak non-taken
+        }
+
+        inline bool predict(Address branchPc, bool taken) {
+            uint32_t phtMask = (1 << LB) - 1;
+            uint32_t phtIdx = (((uint32_t)(branchPc >> 1)) ^ ghist) & phtMask;
+            bool pred = pht[phtIdx] > 1;
+            pht[phtIdx] = taken? (pred? 3 : (pht[phtIdx]+1)) : (pred? (pht[phtIdx]-1) : 0);
+            ghist = ((ghist << 1) | (taken? 1 : 0)) & phtMask;
+            return (taken == pred);
+        }
+
+        uint64_t getStorageBits() const {return (1 << LB)*2 + LB;}
+
+        void initStats(AggregateStat* bpStat) {}
+};
+
+/* Simplified TAGE (Seznec and Michaud, JILP 2006): a bimodal base predictor
+ * plus 4 partially-tagged tables indexed with geometric global history
+ * lengths (5, 15, 44, 130). This is the TAGE core of TAGE-SC-L, without
+ * the statistical corrector and loop predictor, and with deterministic
+ * allocation. 2^LOG_BASE base entries and 2^LOG_TAGGED entries per tagged
+ * table; with the defaults (13, 10), ~9.3KB.
+ */
+template<uint32_t LOG_BASE, uint32_t LOG_TAGGED>
+class BranchPredictorTAGE {
+    private:
+        static const uint32_t NT = 4;  // tagged tables
+        static const uint32_t HIST_BUF = 256;  // circular global history buffer, power of 2 >= longest history
+        static const uint32_t U_RESET_PERIOD = 1 << 18;  // branches between graceful useful-bit resets
+
+        struct FoldedHistory {
+            uint32_t comp;
+            uint32_t origLen;
+            uint32_t compLen;
+            uint32_t outPoint;
+
+            void init(uint32_t _origLen, uint32_t _compLen) {
+                comp = 0;
+                origLen = _origLen;
+                compLen = _compLen;
+                outPoint = origLen % compLen;
+            }
+
+            // h[pt] is the newest bit, h[pt + origLen] the one leaving the history
+            inline void update(const uint8_t* h, uint32_t pt) {
+                comp = (comp << 1) | h[pt];
+                comp ^= h[(pt + origLen) & (HIST_BUF - 1)] << outPoint;
+                comp ^= comp >> compLen;
+                comp &= (1 << compLen) - 1;
+            }
+        };
+
+        struct TaggedEntry {
+            int8_t ctr;  // 3-bit signed counter, [-4, 3]; >= 0 predicts taken
+            uint8_t u;  // 2-bit useful counter
+            uint16_t tag;
+        };
+
+        uint8_t base[1 << LOG_BASE];  // 2-bit counters
+        TaggedEntry tables[NT][1 << LOG_TAGGED];
+
+        uint32_t histLen[NT];
+        uint32_t tagBits[NT];
+        FoldedHistory idxHist[NT];
+        FoldedHistory tagHist0[NT];
+        FoldedHistory tagHist1[NT];
+
+        uint8_t ghist[HIST_BUF];
+        uint32_t ptGhist;
+
+        int32_t useAltOnNa;  // 4-bit signed, >= 0 means use the alternate prediction when the provider entry is newly allocated
+        uint64_t branches;
+
+        Counter profProviderHits[NT + 1];  // [0] is the base predictor
+
+    public:
+        BranchPredictorTAGE() {
+            const uint32_t lens[NT] = {5, 15, 44, 130};
+            const uint32_t tags[NT] = {8, 9, 10, 11};
+            for (uint32_t t = 0; t < NT; t++) {
+                histLen[t] = lens[t];
+                tagBits[t] = tags[t];
+                idxHist[t].init(histLen[t], LOG_TAGGED);
+                tagHist0[t].init(histLen[t], tagBits[t]);
+                tagHist1[t].init(histLen[t], tagBits[t] - 1);
+                for (uint32_t i = 0; i < (1 << LOG_TAGGED); i++) {
+                    tables[t][i].ctr = 0;
+                    tables[t][i].u = 0;
+                    tables[t][i].tag = 0;
+                }
+            }
+            for (uint32_t i = 0; i < (1 << LOG_BASE); i++) base[i] = 1;  // weak non-taken
+            for (uint32_t i = 0; i < HIST_BUF; i++) ghist[i] = 0;
+            ptGhist = 0;
+            useAltOnNa = 0;
+            branches = 0;
+            static_assert(LOG_TAGGED <= 16, "Tagged table index too large for the folded histories");
+        }
+
+        inline bool predict(Address branchPc, bool taken) {
+            uint32_t pc = (uint32_t)(branchPc >> 1);
+
+            // Lookup
+            uint32_t idx[NT];
+            uint16_t tag[NT];
+            for (uint32_t t = 0; t < NT; t++) {
+                idx[t] = (pc ^ (pc >> (LOG_TAGGED - t)) ^ idxHist[t].comp) & ((1 << LOG_TAGGED) - 1);
+                tag[t] = (pc ^ tagHist0[t].comp ^ (tagHist1[t].comp << 1)) & ((1 << tagBits[t]) - 1);
+            }
+
+            int32_t provider = -1;
+            int32_t alt = -1;
+            for (int32_t t = NT - 1; t >= 0; t--) {
+                if (tables[t][idx[t]].tag == tag[t]) {
+                    if (provider == -1) {
+                        provider = t;
+                    } else {
+                        alt = t;
+                        break;
+                    }
+                }
+            }
+
+            uint32_t baseIdx = pc & ((1 << LOG_BASE) - 1);
+            bool basePred = base[baseIdx] > 1;
+            bool altPred = (alt >= 0)? (tables[alt][idx[alt]].ctr >= 0) : basePred;
+            bool pred;
+            bool providerPred = basePred;
+            bool weakProvider = false;
+            if (provider >= 0) {
+                TaggedEntry& e = tables[provider][idx[provider]];
+                providerPred = e.ctr >= 0;
+                weakProvider = (e.ctr == 0 || e.ctr == -1) && e.u == 0;
+                pred = (weakProvider && useAltOnNa >= 0)? altPred : providerPred;
+            } else {
+                pred = basePred;
+            }
+            profProviderHits[provider + 1].inc();
+
+            // Update
+            if (provider >= 0) {
+                TaggedEntry& e = tables[provider][idx[provider]];
+                if (weakProvider && providerPred != altPred) {
+                    useAltOnNa += (altPred == taken)? 1 : -1;
+                    useAltOnNa = MAX(-8, MIN(7, useAltOnNa));
+                }
+                if (providerPred != altPred) {
+                    if (providerPred == taken) e.u = MIN(3, e.u + 1);
+                    else if (e.u) e.u--;
+                }
+                e.ctr = taken? MIN(3, e.ctr + 1) : MAX(-4, e.ctr - 1);
+                // Keep training the alternate while the provider is new
+                if (weakProvider && alt < 0) base[baseIdx] = taken? MIN(3, base[baseIdx] + 1) : MAX(0, base[baseIdx] - 1);
+            } else {
+                base[baseIdx] = taken? MIN(3, base[baseIdx] + 1) : MAX(0, base[baseIdx] - 1);
+            }
+
+            // On a misprediction, allocate an entry in a table with longer history
+            if (pred != taken && provider < (int32_t)NT - 1) {
+                bool allocated = false;
+                for (uint32_t t = provider + 1; t < NT; t++) {
+                    TaggedEntry& e = tables[t][idx[t]];
+                    if (e.u == 0) {
+                        e.tag = tag[t];
+                        e.ctr = taken? 0 : -1;
+                        allocated = true;
+                        break;
+                    }
+                }
+                if (!allocated) {
+                    for (uint32_t t = provider + 1; t < NT; t++) {
+                        TaggedEntry& e = tables[t][idx[t]];
+                        if (e.u) e.u--;
+                    }
+                }
+            }
+
+            // Graceful reset of useful counters
+            if ((++branches % U_RESET_PERIOD) == 0) {
+                for (uint32_t t = 0; t < NT; t++) {
+                    for (uint32_t i = 0; i < (1 << LOG_TAGGED); i++) tables[t][i].u >>= 1;
+                }
+            }
+
+            // Update global history
+            ptGhist = (ptGhist - 1) & (HIST_BUF - 1);
+            ghist[ptGhist] = taken? 1 : 0;
+            for (uint32_t t = 0; t < NT; t++) {
+                idxHist[t].update(ghist, ptGhist);
+                tagHist0[t].update(ghist, ptGhist);
+                tagHist1[t].update(ghist, ptGhist);
+            }
+
+            return (taken == pred);
+        }
+
+        uint64_t getStorageBits() const {
+            uint64_t bits = (1 << LOG_BASE)*2 + histLen[NT - 1] + 4 /*useAltOnNa*/;
+            for (uint32_t t = 0; t < NT; t++) bits += (1 << LOG_TAGGED)*(3 + 2 + tagBits[t]);
+            return bits;
+        }
+
+        void initStats(AggregateStat* bpStat) {
+            const char* names[NT + 1] = {"baseHits", "t1Hits", "t2Hits", "t3Hits", "t4Hits"};
+            for (uint32_t t = 0; t <= NT; t++) {
+                profProviderHits[t].init(names[t], "Predictions provided by this table");
+                bpStat->append(&profProviderHits[t]);
+            }
+        }
+};
+
+/* Perceptron predictor (Jimenez and Lin, HPCA 2001): 2^LOG_ENTRIES
+ * perceptrons of H 8-bit weights plus a bias, indexed by PC, over H bits of
+ * global history. Trained on mispredictions or when the output magnitude is
+ * below the threshold 1.93*H + 14.
+ */
+template<uint32_t LOG_ENTRIES, uint32_t H>
+class BranchPredictorPerceptron {
+    private:
+        int8_t weights[1 << LOG_ENTRIES][H + 1];  // [0] is the bias
+        uint64_t ghist;  // bit i is the outcome of the i-th most recent branch
+
+    public:
+        BranchPredictorPerceptron() : ghist(0) {
+            static_assert(H < 64, "History must fit in 64 bits");
+            for (uint32_t i = 0; i < (1 << LOG_ENTRIES); i++) {
+                for (uint32_t j = 0; j <= H; j++) weights[i][j] = 0;
+            }
+        }
+
+        inline bool predict(Address branchPc, bool taken) {
+            const int32_t theta = (int32_t)(1.93*H + 14);
+            int8_t* w = weights[((uint32_t)(branchPc >> 1)) & ((1 << LOG_ENTRIES) - 1)];
+
+            int32_t y = w[0];
+            for (uint32_t i = 0; i < H; i++) {
+                y += ((ghist >> i) & 1)? w[i + 1] : -w[i + 1];
+            }
+            bool pred = y >= 0;
+
+            if (pred != taken || (y <= theta && y >= -theta)) {
+                w[0] = taken? MIN(127, w[0] + 1) : MAX(-128, w[0] - 1);
+                for (uint32_t i = 0; i < H; i++) {
+                    bool agree = (((ghist >> i) & 1) != 0) == taken;
+                    w[i + 1] = agree? MIN(127, w[i + 1] + 1) : MAX(-128, w[i + 1] - 1);
+                }
+            }
+
+            ghist = (ghist << 1) | (taken? 1 : 0);
+            return (taken == pred);
+        }
+
+        uint64_t getStorageBits() const {return (1 << LOG_ENTRIES)*(H + 1)*8 + H;}
+
+        void initStats(AggregateStat* bpStat) {}
+};
+
+// Configurations used by OOOCore; all are in the 7-10KB range
+typedef BranchPredictorPAg<11, 18, 14, false> BranchPredictorPAgA2;
+typedef BranchPredictorPAg<11, 18, 14, true> BranchPredictorPAgA3;
+typedef BranchPredictorGShare<15> BranchPredictorDefaultGShare;
+typedef BranchPredictorTAGE<13, 10> BranchPredictorDefaultTAGE;
+typedef BranchPredictorPerceptron<8, 28> BranchPredictorDefaultPerceptron;
+
+#endif  // BRANCH_PREDICTORS_H_
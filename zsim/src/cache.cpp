@@ -75,6 +75,7 @@ uint64_t Cache::access(MemReq& req) {
             //Evictions are not in the critical path in any sane implementation -- we do not include their delays
             //NOTE: We might be "evicting" an invalid line for all we know. Coherence controllers will know what to do
             cc->processEviction(req, wbLineAddr, lineId, respCycle); //1. if needed, send invalidates/downgrades to lower level
+            if (unlikely(array->getNumExtraVictims())) processExtraEvictions(req, respCycle);
 
             array->postinsert(req.lineAddr, &req, lineId); //do the actual insertion. NOTE: Now we must split insert into a 2-phase thing because cc unlocks us.
         }
@@ -131,7 +132,8 @@ void Cache::startInvalidate() {
 
 uint64_t Cache::finishInvalidate(const InvReq& req) {
     int32_t lineId = array->lookup(req.lineAddr, nullptr, false);
-    assert_msg(lineId != -1, "[%s] Invalidate on non-existing address 0x%lx type %s lineId %d, reqWriteback %d", name.c_str(), req.lineAddr, InvTypeName(req.type), lineId, *req.writeback);
+    if (req.imprecise && lineId != -1 && !cc->isValid(lineId)) lineId = -1; //tag match on an invalid line, we don't have it
+    assert_msg(lineId != -1 || req.imprecise, "[%s] Invalidate on non-existing address 0x%lx type %s lineId %d, reqWriteback %d", name.c_str(), req.lineAddr, InvTypeName(req.type), lineId, *req.writeback);
     uint64_t respCycle = req.cycle + invLat;
     trace(Cache, "[%s] Invalidate start 0x%lx type %s lineId %d, reqWriteback %d", name.c_str(), req.lineAddr, InvTypeName(req.type), lineId, *req.writeback);
     respCycle = cc->processInv(req, lineId, respCycle); //send invalidates or downgrades to children, and adjust our own state
@@ -139,3 +141,26 @@ uint64_t Cache::finishInvalidate(const InvReq& req) {
 
     return respCycle;
 }
+
+uint64_t Cache::processExtraEvictions(const MemReq& req, uint64_t startCycle) {
+    EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+    TimingRecord wbRec;
+    wbRec.clear();
+    if (evRec && evRec->hasRecord()) wbRec = evRec->popRecord();
+
+    uint64_t doneCycle = 0;
+    uint32_t numVictims = array->getNumExtraVictims();
+    for (uint32_t i = 0; i < numVictims; i++) {
+        Address wbLineAddr;
+        uint32_t lineId = array->getExtraVictim(i, &wbLineAddr);
+        trace(Cache, "[%s] Evicting 0x%lx (sector)", name.c_str(), wbLineAddr);
+        doneCycle = MAX(doneCycle, cc->processEviction(req, wbLineAddr, lineId, startCycle));
+        if (evRec && evRec->hasRecord()) {
+            TimingRecord r = evRec->popRecord();
+            wbRec = wbRec.isValid()? MergeTimingRecords(evRec, wbRec, r) : r;
+        }
+    }
+
+    if (wbRec.isValid()) evRec->pushRecord(wbRec);
+    return doneCycle;
+}
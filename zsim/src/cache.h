@@ -76,6 +76,10 @@ class Cache : public BaseCache {
 
         void startInvalidate(); // grabs cc's downLock
         uint64_t finishInvalidate(const InvReq& req); // performs inv and releases downLock
+
+        // Evicts the array's extra victims after preinsert() (sectored arrays), folding their
+        // writeback timing records into the one left by the first eviction. Returns the last done cycle.
+        uint64_t processExtraEvictions(const MemReq& req, uint64_t startCycle);
 };
 
 #endif  // CACHE_H_
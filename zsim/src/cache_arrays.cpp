@@ -34,18 +34,27 @@ SetAssocArray::SetAssocArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _r
     numSets = numLines/assoc;
     setMask = numSets - 1;
     assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
+    tagMatch = GetArrayTagMatchFn(assoc);
 }
 
 int32_t SetAssocArray::lookup(const Address lineAddr, const MemReq* req, bool updateReplacement) {
     uint32_t set = hf->hash(0, lineAddr) & setMask;
     uint32_t first = set*assoc;
-    for (uint32_t id = first; id < first + assoc; id++) {
-        if (array[id] ==  lineAddr) {
-            if (updateReplacement) rp->update(id, req);
-            return id;
+    if (assoc < TAG_MATCH_SIMD_MIN_WAYS) {  // SIMD doesn't pay off (see tag_match.h)
+        for (uint32_t id = first; id < first + assoc; id++) {
+            if (array[id] ==  lineAddr) {
+                if (updateReplacement) rp->update(id, req);
+                return id;
+            }
         }
+        return -1;
     }
-    return -1;
+
+    int32_t way = tagMatch(&array[first], assoc, lineAddr);
+    if (way < 0) return -1;
+    uint32_t id = first + way;
+    if (updateReplacement) rp->update(id, req);
+    return id;
 }
 
 uint32_t SetAssocArray::preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr) { //TODO: Give out valid bit of wb cand?
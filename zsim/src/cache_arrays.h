@@ -28,6 +28,7 @@
 
 #include "memory_hierarchy.h"
 #include "stats.h"
+#include "tag_match.h"
 
 /* General interface of a cache array. The array is a fixed-size associative container that
  * translates addresses to line IDs. A line ID represents the position of the tag. The other
@@ -48,6 +49,12 @@ class CacheArray : public GlobAlloc {
          */
         virtual void postinsert(const Address lineAddr, const MemReq* req, uint32_t lineId) = 0;
 
+        /* Arrays that replace several lines at once (sectored arrays) return the other lines that
+         * the last preinsert() displaced. The cache must evict them too, before postinsert().
+         */
+        virtual uint32_t getNumExtraVictims() const {return 0;}
+        virtual uint32_t getExtraVictim(uint32_t idx, Address* wbLineAddr) const {panic("Array has no extra victims");}
+
         virtual void initStats(AggregateStat* parent) {}
 };
 
@@ -64,6 +71,7 @@ class SetAssocArray : public CacheArray {
         uint32_t numSets;
         uint32_t assoc;
         uint32_t setMask;
+        TagMatchFn tagMatch;  // vectorized tag compare, used for assoc >= TAG_MATCH_SIMD_MIN_WAYS
 
     public:
         SetAssocArray(uint32_t _numLines, uint32_t _assoc, ReplPolicy* _rp, HashFamily* _hf);
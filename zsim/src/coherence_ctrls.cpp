@@ -25,14 +25,17 @@
 
 #include "coherence_ctrls.h"
 #include "cache.h"
+#include "event_recorder.h"
 #include "network.h"
+#include "timing_event.h"
 #include "zsim.h"
 
 /* Do a simple XOR block hash on address to determine its bank. Hacky for now,
  * should probably have a class that deals with this with a real hash function
  * (TODO)
  */
-uint32_t MESIBottomCC::getParentId(Address lineAddr) {
+template <CoherenceProtocol P>
+uint32_t MESIBottomCC<P>::getParentId(Address lineAddr) {
     //Hash things a bit
     uint32_t res = 0;
     uint64_t tmp = lineAddr;
@@ -44,22 +47,28 @@ uint32_t MESIBottomCC::getParentId(Address lineAddr) {
 }
 
 
-void MESIBottomCC::init(const g_vector<MemObject*>& _parents, Network* network, const char* name) {
+template <CoherenceProtocol P>
+void MESIBottomCC<P>::init(const g_vector<MemObject*>& _parents, Network* network, const char* name) {
     parents.resize(_parents.size());
     parentRTTs.resize(_parents.size());
+    parentNodes.resize(_parents.size());
+    selfNode = (network)? network->getNodeId(name) : -1;
     for (uint32_t p = 0; p < parents.size(); p++) {
         parents[p] = _parents[p];
-        parentRTTs[p] = (network)? network->getRTT(name, parents[p]->getName()) : 0;
+        parentNodes[p] = (selfNode >= 0)? network->getNodeId(parents[p]->getName()) : -1;
+        parentRTTs[p] = (parentNodes[p] >= 0)? network->getRTT(selfNode, parentNodes[p]) : 0;
     }
+    if (selfNode >= 0 && network->modelsContention()) this->network = network;
 }
 
 
-uint64_t MESIBottomCC::processEviction(Address wbLineAddr, uint32_t lineId, bool lowerLevelWriteback, uint64_t cycle, uint32_t srcId, Address pc = 0, ApproxType approxType = no_approx) {
+template <CoherenceProtocol P>
+uint64_t MESIBottomCC<P>::processEviction(Address wbLineAddr, uint32_t lineId, bool lowerLevelWriteback, uint64_t cycle, uint32_t srcId, Address pc, ApproxType approxType) {
     MESIState* state = &array[lineId];
     if (lowerLevelWriteback) {
         //If this happens, when tcc issued the invalidations, it got a writeback. This means we have to do a PUTX, i.e. we have to transition to M if we are in E
-        assert(*state == M || *state == E); //Must have exclusive permission!
-        *state = M; //Silent E->M transition (at eviction); now we'll do a PUTX
+        assert(*state == M || *state == E || *state == O); //Must have exclusive permission (or own the line, MOESI)!
+        if (*state == E) *state = M; //Silent E->M transition (at eviction); now we'll do a PUTX
     }
     uint64_t respCycle = cycle;
     switch (*state) {
@@ -67,15 +76,21 @@ uint64_t MESIBottomCC::processEviction(Address wbLineAddr, uint32_t lineId, bool
             break; //Nothing to do
         case S:
         case E:
+        case F:
             {
+                uint32_t parentId = getParentId(wbLineAddr);
                 MemReq req = {wbLineAddr, PUTS, selfId, state, cycle, &ccLock, *state, srcId, 0 /*no flags*/, pc, approxType};
-                respCycle = parents[getParentId(wbLineAddr)]->access(req);
+                respCycle = parents[parentId]->access(req);
+                if (unlikely(network && parentNodes[parentId] >= 0)) network->traverse(selfNode, parentNodes[parentId], req, respCycle);
             }
             break;
         case M:
+        case O:
             {
-                MemReq req = {wbLineAddr, PUTX, selfId, state, cycle, &ccLock, *state, srcId, 0 /*no flags*/, pc, no_approx}; // XXX: don't approximate modified
-                respCycle = parents[getParentId(wbLineAddr)]->access(req);
+                uint32_t parentId = getParentId(wbLineAddr);
+                MemReq req = {wbLineAddr, PUTX, selfId, state, cycle, &ccLock, *state, srcId, 0 /*no flags*/, pc, approxTypes[lineId]}; //the victim's own type, not the triggering access's
+                respCycle = parents[parentId]->access(req);
+                if (unlikely(network && parentNodes[parentId] >= 0)) network->traverse(selfNode, parentNodes[parentId], req, respCycle);
             }
             break;
 
@@ -85,9 +100,11 @@ uint64_t MESIBottomCC::processEviction(Address wbLineAddr, uint32_t lineId, bool
     return respCycle;
 }
 
-uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint64_t cycle, uint32_t srcId, uint32_t flags, Address pc = 0, ApproxType approxType = no_approx) {
+template <CoherenceProtocol P>
+uint64_t MESIBottomCC<P>::processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint64_t cycle, uint32_t srcId, uint32_t flags, Address pc, ApproxType approxType) {
     uint64_t respCycle = cycle;
     MESIState* state = &array[lineId];
+    if (*state == I) approxTypes[lineId] = approxType; //record the type of the data we fill
     switch (type) {
         // A PUTS/PUTX does nothing w.r.t. higher coherence levels --- it dies here
         case PUTS: //Clean writeback, nothing to do (except profiling)
@@ -95,7 +112,7 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
             profPUTS.inc();
             break;
         case PUTX: //Dirty writeback
-            assert(*state == M || *state == E);
+            assert(*state == M || *state == E || *state == O); //O if a child owned the line while we did too (MOESI)
             if (*state == E) {
                 //Silent transition, record that block was written to
                 *state = M;
@@ -107,24 +124,31 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
                 uint32_t parentId = getParentId(lineAddr);
                 MemReq req = {lineAddr, GETS, selfId, state, cycle, &ccLock, *state, srcId, flags, pc, approxType};
                 uint32_t nextLevelLat = parents[parentId]->access(req) - cycle;
+                if (unlikely(network && parentNodes[parentId] >= 0)) network->traverse(selfNode, parentNodes[parentId], req, cycle + nextLevelLat);
                 uint32_t netLat = parentRTTs[parentId];
                 profGETNextLevelLat.inc(nextLevelLat);
                 profGETNetLat.inc(netLat);
                 respCycle += nextLevelLat + netLat;
                 profGETSMiss.inc();
-                assert(*state == S || *state == E);
+                profFetches.inc();
+                assert(*state == S || *state == E || *state == F || *state == M); //M if an exclusive cache handed over a dirty line
             } else {
                 profGETSHit.inc();
             }
             break;
         case GETX:
-            if (*state == I || *state == S) {
+            if (*state == I || *state == S || *state == O || *state == F) {
                 //Profile before access, state changes
-                if (*state == I) profGETXMissIM.inc();
-                else profGETXMissSM.inc();
+                if (*state == I) {
+                    profGETXMissIM.inc();
+                    profFetches.inc();
+                } else {
+                    profGETXMissSM.inc();
+                }
                 uint32_t parentId = getParentId(lineAddr);
                 MemReq req = {lineAddr, GETX, selfId, state, cycle, &ccLock, *state, srcId, flags, pc, approxType};
                 uint32_t nextLevelLat = parents[parentId]->access(req) - cycle;
+                if (unlikely(network && parentNodes[parentId] >= 0)) network->traverse(selfNode, parentNodes[parentId], req, cycle + nextLevelLat);
                 uint32_t netLat = parentRTTs[parentId];
                 profGETNextLevelLat.inc(nextLevelLat);
                 profGETNetLat.inc(netLat);
@@ -151,34 +175,43 @@ uint64_t MESIBottomCC::processAccess(Address lineAddr, uint32_t lineId, AccessTy
     return respCycle;
 }
 
-void MESIBottomCC::processWritebackOnAccess(Address lineAddr, uint32_t lineId, AccessType type) {
+template <CoherenceProtocol P>
+void MESIBottomCC<P>::processWritebackOnAccess(Address lineAddr, uint32_t lineId, AccessType type) {
     MESIState* state = &array[lineId];
-    assert(*state == M || *state == E);
+    assert(*state == M || *state == E || *state == O);
     if (*state == E) {
         //Silent transition to M if in E
         *state = M;
     }
 }
 
-void MESIBottomCC::processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback) {
+template <CoherenceProtocol P>
+void MESIBottomCC<P>::processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback) {
     MESIState* state = &array[lineId];
     assert(*state != I);
     switch (type) {
         case INVX: //lose exclusivity
             //Hmmm, do we have to propagate loss of exclusivity down the tree? (nah, topcc will do this automatically -- it knows the final state, always!)
             assert_msg(*state == E || *state == M, "Invalid state %s", MESIStateName(*state));
-            if (*state == M) *reqWriteback = true;
-            *state = S;
+            if (P == PROTO_MOESI && (*state == M || *reqWriteback)) {
+                //Keep the dirty data (ours or our children's) as the owner; reqWriteback tells our parent we have it
+                *state = O;
+                *reqWriteback = true;
+            } else {
+                if (*state == M) *reqWriteback = true;
+                *state = S;
+            }
             profINVX.inc();
             break;
         case INV: //invalidate
             assert(*state != I);
-            if (*state == M) *reqWriteback = true;
+            if (*state == M || *state == O) *reqWriteback = true;
             *state = I;
             profINV.inc();
             break;
         case FWD: //forward
-            assert_msg(*state == S, "Invalid state %s on FWD", MESIStateName(*state));
+            assert_msg(*state == S || *state == O || *state == F, "Invalid state %s on FWD", MESIStateName(*state));
+            if (*state == F) *state = S; //the requester becomes the forwarder
             profFWD.inc();
             break;
         default: panic("!?");
@@ -187,7 +220,8 @@ void MESIBottomCC::processInval(Address lineAddr, uint32_t lineId, InvType type,
 }
 
 
-uint64_t MESIBottomCC::processNonInclusiveWriteback(Address lineAddr, AccessType type, uint64_t cycle, MESIState* state, uint32_t srcId, uint32_t flags, Address pc = 0) {
+template <CoherenceProtocol P>
+uint64_t MESIBottomCC<P>::processNonInclusiveWriteback(Address lineAddr, AccessType type, uint64_t cycle, MESIState* state, uint32_t srcId, uint32_t flags, Address pc) {
     if (!nonInclusiveHack) panic("Non-inclusive %s on line 0x%lx, this cache should be inclusive", AccessTypeName(type), lineAddr);
 
     //info("Non-inclusive wback, forwarding");
@@ -197,129 +231,413 @@ uint64_t MESIBottomCC::processNonInclusiveWriteback(Address lineAddr, AccessType
 }
 
 
+template <CoherenceProtocol P>
+void MESIBottomCC<P>::processLocalFill(uint32_t lineId, AccessType type, ApproxType approxType) {
+    MESIState* state = &array[lineId];
+    assert(*state == I);
+    approxTypes[lineId] = approxType;
+    //We're the last level, so we have implicit exclusive permission to any line
+    *state = (type == PUTX || type == GETX)? M : E;
+    if (type == PUTS || type == PUTX) profVictimFills.inc();
+}
+
+template <CoherenceProtocol P>
+uint64_t MESIBottomCC<P>::processBypassAccess(Address lineAddr, AccessType type, uint64_t cycle, uint32_t srcId, uint32_t flags, Address pc, ApproxType approxType, MESIState* state) {
+    assert(type == GETS || type == GETX);
+    *state = I;
+    uint32_t parentId = getParentId(lineAddr);
+    MemReq req = {lineAddr, type, selfId, state, cycle, &ccLock, *state, srcId, flags, pc, approxType};
+    uint32_t nextLevelLat = parents[parentId]->access(req) - cycle;
+    if (unlikely(network && parentNodes[parentId] >= 0)) network->traverse(selfNode, parentNodes[parentId], req, cycle + nextLevelLat);
+    uint32_t netLat = parentRTTs[parentId];
+    profGETNextLevelLat.inc(nextLevelLat);
+    profGETNetLat.inc(netLat);
+    if (type == GETS) profGETSMiss.inc();
+    else profGETXMissIM.inc();
+    profFetches.inc();
+    profBypasses.inc();
+    return cycle + nextLevelLat + netLat;
+}
+
+template <CoherenceProtocol P>
+bool MESIBottomCC<P>::processMove(uint32_t lineId) {
+    MESIState* state = &array[lineId];
+    assert(*state == E || *state == M);
+    bool dirty = *state == M;
+    *state = I;
+    return dirty;
+}
+
+template <CoherenceProtocol P>
+void MESIBottomCC<P>::processDecoupledWriteback(Address lineAddr, uint64_t cycle, uint32_t srcId, ApproxType approxType) {
+    //Preserve the single-record invariant: if the access already has a timing record, start the writeback along
+    //with it (the writeback's end does not matter, as with eviction writebacks)
+    EventRecorder* evRec = zinfo->eventRecorders[srcId];
+    TimingRecord accRec;
+    accRec.clear();
+    if (evRec && evRec->hasRecord()) accRec = evRec->popRecord();
+
+    MESIState state = M;
+    MemReq req = {lineAddr, PUTX, selfId, &state, cycle, &ccLock, state, srcId, MemReq::NONINCLWB, 0, approxType};
+    parents[getParentId(lineAddr)]->access(req);
+    profPUTX.inc();
+
+    if (evRec && evRec->hasRecord()) {
+        TimingRecord wbRec = evRec->popRecord();
+        wbRec.endEvent = nullptr; //nothing waits on writebacks
+        if (accRec.isValid()) {
+            wbRec.respCycle = MIN(wbRec.reqCycle, accRec.respCycle); //so the merged record ends with the access
+            evRec->pushRecord(MergeTimingRecords(evRec, accRec, wbRec));
+        } else {
+            evRec->pushRecord(wbRec);
+        }
+    } else if (accRec.isValid()) {
+        evRec->pushRecord(accRec);
+    }
+}
+
+
 /* MESITopCC implementation */
 
-void MESITopCC::init(const g_vector<BaseCache*>& _children, Network* network, const char* name) {
+template <CoherenceProtocol P>
+void MESITopCC<P>::init(const g_vector<BaseCache*>& _children, Network* network, const char* name) {
     if (_children.size() > MAX_CACHE_CHILDREN) {
         panic("[%s] Children size (%d) > MAX_CACHE_CHILDREN (%d)", name, (uint32_t)_children.size(), MAX_CACHE_CHILDREN);
     }
     children.resize(_children.size());
     childrenRTTs.resize(_children.size());
+    int32_t selfNode = (network)? network->getNodeId(name) : -1;
     for (uint32_t c = 0; c < children.size(); c++) {
         children[c] = _children[c];
-        childrenRTTs[c] = (network)? network->getRTT(name, children[c]->getName()) : 0;
+        int32_t childNode = (selfNode >= 0)? network->getNodeId(children[c]->getName()) : -1;
+        childrenRTTs[c] = (childNode >= 0)? network->getRTT(selfNode, childNode) : 0;
+    }
+
+    //Size sharer sets now that we know how many children we have
+    uint32_t sharerBits;
+    switch (dir.format) {
+        case FULL_MAP:
+            sharerBits = children.size();
+            break;
+        case LIMITED_PTR:
+            if (dir.pointers == 0 || dir.pointers >= LIMITED_PTR_OVERFLOW) panic("[%s] Invalid number of directory pointers %d", name, dir.pointers);
+            sharerBits = 16*(dir.pointers + 1); //count (or overflow marker) + pointers
+            break;
+        case COARSE_VECTOR:
+            if (dir.groupSize == 0) panic("[%s] Directory groupSize must be > 0", name);
+            sharerBits = (children.size() + dir.groupSize - 1)/dir.groupSize;
+            break;
+        default: panic("!?");
+    }
+    entryWords = MAX(1u, (sharerBits + 63)/64);
+
+    if (dir.sparseEntries) {
+        if (dir.sparseWays == 0 || dir.sparseEntries % dir.sparseWays) {
+            panic("[%s] Sparse directory entries (%d) must be a multiple of its ways (%d)", name, dir.sparseEntries, dir.sparseWays);
+        }
+        numEntries = dir.sparseEntries;
+        sparseSets = numEntries/dir.sparseWays;
+        sparseTags = gm_calloc<SparseTag>(numEntries); //all invalid
+        if (!decoupled) {
+            lineEntries = gm_calloc<int32_t>(numLines);
+            for (uint32_t i = 0; i < numLines; i++) lineEntries[i] = -1;
+        }
+    } else {
+        if (decoupled) panic("[%s] Non-inclusive and exclusive caches need a sparse directory", name);
+        numEntries = numLines;
     }
+    entries = gm_calloc<Entry>(numEntries);
+    sharerWords = gm_calloc<uint64_t>(((uint64_t)numEntries)*entryWords);
+    for (uint32_t i = 0; i < numEntries; i++) resetEntry(&entries[i]);
 }
 
-uint64_t MESITopCC::sendInvalidates(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId) {
-    //Send down downgrades/invalidates
-    Entry* e = &array[lineId];
+template <CoherenceProtocol P>
+void MESITopCC<P>::initStats(AggregateStat* parentStat) {
+    profInvSent.init("dirINV", "Invalidates/downgrades sent to children");
+    profInvSpurious.init("dirSpurINV", "Invalidates/downgrades sent to children without the line (imprecise sharer sets)");
+    profC2C.init("c2c", "Cache-to-cache transfers (GETS data supplied by a child, not by this cache)");
+    parentStat->append(&profInvSent);
+    parentStat->append(&profInvSpurious);
+    parentStat->append(&profC2C);
+    if (decoupled) {
+        profBackInvAvoided.init("backInvAvoided", "Back-invalidations avoided on evictions (non-inclusive/exclusive)");
+        parentStat->append(&profBackInvAvoided);
+    }
+    if (sparseTags) {
+        profDirEvictions.init("dirEvict", "Sparse directory evictions");
+        profDirEvictionInvs.init("dirEvictINV", "Invalidates due to sparse directory evictions");
+        parentStat->append(&profDirEvictions);
+        parentStat->append(&profDirEvictionInvs);
+    }
+}
 
-    //Don't propagate downgrades if sharers are not exclusive.
-    if (type == INVX && !e->isExclusive()) {
-        return cycle;
+template <CoherenceProtocol P>
+void MESITopCC<P>::addSharer(uint64_t* sharers, uint32_t childId) {
+    if (dir.format == LIMITED_PTR) {
+        uint16_t* ptrs = (uint16_t*)sharers;
+        if (ptrs[0] == LIMITED_PTR_OVERFLOW) return;
+        if (ptrs[0] == dir.pointers) {
+            ptrs[0] = LIMITED_PTR_OVERFLOW; //from now on, broadcast
+        } else {
+            ptrs[++ptrs[0]] = childId;
+        }
+    } else {
+        uint32_t bit = (dir.format == COARSE_VECTOR)? childId/dir.groupSize : childId;
+        sharers[bit/64] |= 1ul << (bit % 64);
     }
+}
 
-    uint64_t maxCycle = cycle; //keep maximum cycle only, we assume all invals are sent in parallel
-    if (!e->isEmpty()) {
-        uint32_t numChildren = children.size();
-        uint32_t sentInvs = 0;
-        for (uint32_t c = 0; c < numChildren; c++) {
-            if (e->sharers[c]) {
-                InvReq req = {lineAddr, type, reqWriteback, cycle, srcId};
-                uint64_t respCycle = children[c]->invalidate(req);
-                respCycle += childrenRTTs[c];
-                maxCycle = MAX(respCycle, maxCycle);
-                if (type == INV) e->sharers[c] = false;
-                sentInvs++;
+template <CoherenceProtocol P>
+void MESITopCC<P>::removeSharer(uint64_t* sharers, uint32_t childId) {
+    //Only precise sets can forget a sharer; imprecise ones stay conservative until they're cleared
+    if (dir.format == LIMITED_PTR) {
+        uint16_t* ptrs = (uint16_t*)sharers;
+        if (ptrs[0] == LIMITED_PTR_OVERFLOW) return;
+        for (uint32_t i = 1; i <= ptrs[0]; i++) {
+            if (ptrs[i] == childId) {
+                ptrs[i] = ptrs[ptrs[0]--];
+                return;
             }
         }
-        assert(sentInvs == e->numSharers);
-        if (type == INV) {
-            e->numSharers = 0;
+        panic("Removing child %d, not in the sharer set", childId);
+    } else if (dir.format == FULL_MAP) {
+        sharers[childId/64] &= ~(1ul << (childId % 64));
+    }
+}
+
+template <CoherenceProtocol P>
+bool MESITopCC<P>::mayInclude(uint64_t* sharers, uint32_t childId) {
+    if (dir.format == LIMITED_PTR) {
+        uint16_t* ptrs = (uint16_t*)sharers;
+        if (ptrs[0] == LIMITED_PTR_OVERFLOW) return true;
+        for (uint32_t i = 1; i <= ptrs[0]; i++) if (ptrs[i] == childId) return true;
+        return false;
+    } else {
+        uint32_t bit = (dir.format == COARSE_VECTOR)? childId/dir.groupSize : childId;
+        return sharers[bit/64] & (1ul << (bit % 64));
+    }
+}
+
+template <CoherenceProtocol P>
+typename MESITopCC<P>::Entry* MESITopCC<P>::allocEntry(Address lineAddr, uint32_t lineId, uint64_t cycle, uint32_t srcId) {
+    Entry* e = getEntry(lineAddr, lineId);
+    if (e) {
+        if (sparseTags) sparseTags[e - entries].lastUse = useCounter++;
+        return e;
+    }
+
+    //Sparse directory miss: take a free way, or evict the LRU one
+    uint32_t first = (lineAddr % sparseSets)*dir.sparseWays;
+    uint32_t victim = first;
+    for (uint32_t w = first; w < first + dir.sparseWays; w++) {
+        if (!sparseTags[w].valid) {
+            victim = w;
+            break;
+        }
+        if (sparseTags[w].lastUse < sparseTags[victim].lastUse) victim = w;
+    }
+
+    SparseTag* tag = &sparseTags[victim];
+    if (tag->valid) {
+        //We can't track the victim's sharers anymore, so invalidate them (its line, if we hold it, stays). We
+        //don't charge this latency to the access; like cache evictions, it's off the critical path.
+        Address victimAddr = tag->lineAddr;
+        int32_t victimLineId = tag->lineId;
+        profDirEvictions.inc();
+        profDirEvictionInvs.inc(entries[victim].numSharers);
+        bool wb = false;
+        sendInvalidates(victimAddr, victimLineId, INV, &wb, cycle, srcId);
+        clearEntry(victimAddr, victimLineId);
+        if (wb) {
+            hasDirtyDirVictim = true;
+            dirtyDirVictimAddr = victimAddr;
+            dirtyDirVictimId = victimLineId;
+        }
+    }
+
+    tag->lineAddr = lineAddr;
+    tag->lineId = decoupled? -1 : lineId;
+    tag->lastUse = useCounter++;
+    tag->valid = true;
+    if (lineEntries) lineEntries[lineId] = victim;
+    return &entries[victim];
+}
+
+template <CoherenceProtocol P>
+void MESITopCC<P>::resetEntry(Entry* e) {
+    e->numSharers = 0;
+    e->owner = NO_OWNER;
+    e->exclusive = false;
+    uint64_t* sharers = getSharers(e);
+    for (uint32_t w = 0; w < entryWords; w++) sharers[w] = 0;
+}
+
+template <CoherenceProtocol P>
+void MESITopCC<P>::clearEntry(Address lineAddr, uint32_t lineId) {
+    Entry* e = getEntry(lineAddr, lineId);
+    if (!e) return;
+    resetEntry(e);
+    if (sparseTags) {
+        sparseTags[e - entries].valid = false;
+        if (lineEntries) lineEntries[lineId] = -1;
+    }
+}
+
+template <CoherenceProtocol P>
+uint64_t MESITopCC<P>::sendInvalidates(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId, int32_t skipChild) {
+    //Send down downgrades/invalidates
+    Entry* e = getEntry(lineAddr, lineId);
+    if (!e || e->isEmpty()) return cycle; //no sharers (sparse directories don't even track the line)
+
+    if (type == INVX) {
+        //Don't propagate downgrades if sharers are not exclusive.
+        if (!e->isExclusive()) return cycle;
+
+        //The exclusive sharer is tracked precisely, even if the sharer set is not
+        uint32_t c = e->owner;
+        bool childWriteback = false;
+        InvReq req = {lineAddr, INVX, &childWriteback, cycle, srcId, false};
+        uint64_t respCycle = children[c]->invalidate(req) + childrenRTTs[c];
+        profInvSent.inc();
+        e->exclusive = false;
+        if (P == PROTO_MOESI && childWriteback) {
+            //Child kept the dirty data in O, so it's still the owner and we don't get the data
         } else {
-            //TODO: This is kludgy -- once the sharers format is more sophisticated, handle downgrades with a different codepath
-            assert(e->exclusive);
-            assert(e->numSharers == 1);
-            e->exclusive = false;
+            e->owner = NO_OWNER;
+            if (childWriteback) *reqWriteback = true;
         }
+        return respCycle;
     }
+
+    uint64_t maxCycle = cycle; //keep maximum cycle only, we assume all invals are sent in parallel
+    bool imprecise = dir.format != FULL_MAP;
+    uint32_t sentInvs = 0;
+    forEachSharer(getSharers(e), [&](uint32_t c) {
+        if ((int32_t)c == skipChild) return; //requester, may be covered by an imprecise set
+        InvReq req = {lineAddr, type, reqWriteback, cycle, srcId, imprecise};
+        uint64_t respCycle = children[c]->invalidate(req);
+        respCycle += childrenRTTs[c];
+        maxCycle = MAX(respCycle, maxCycle);
+        sentInvs++;
+    });
+    assert(sentInvs == e->numSharers || (imprecise && sentInvs > e->numSharers));
+    profInvSent.inc(sentInvs);
+    profInvSpurious.inc(sentInvs - e->numSharers);
+    resetEntry(e);
     return maxCycle;
 }
 
+template <CoherenceProtocol P>
+uint64_t MESITopCC<P>::forwardToOwner(Address lineAddr, Entry* e, uint64_t cycle, uint32_t srcId) {
+    uint32_t c = e->owner;
+    bool unusedWriteback = false; //FWDs don't transfer ownership
+    InvReq req = {lineAddr, FWD, &unusedWriteback, cycle, srcId, false};
+    return children[c]->invalidate(req) + childrenRTTs[c];
+}
+
 
-uint64_t MESITopCC::processEviction(Address wbLineAddr, uint32_t lineId, bool* reqWriteback, uint64_t cycle, uint32_t srcId) {
-    if (nonInclusiveHack) {
+template <CoherenceProtocol P>
+uint64_t MESITopCC<P>::processEviction(Address wbLineAddr, uint32_t lineId, bool* reqWriteback, uint64_t cycle, uint32_t srcId) {
+    if (decoupled) {
+        // Children keep their copies, and we keep tracking them
+        Entry* e = getEntry(wbLineAddr, lineId);
+        if (e) profBackInvAvoided.inc(e->numSharers);
+        return cycle;
+    } else if (nonInclusiveHack) {
         // Don't invalidate anything, just clear our entry
-        array[lineId].clear();
+        clearEntry(wbLineAddr, lineId);
         return cycle;
     } else {
         //Send down invalidates
-        return sendInvalidates(wbLineAddr, lineId, INV, reqWriteback, cycle, srcId);
+        uint64_t respCycle = sendInvalidates(wbLineAddr, lineId, INV, reqWriteback, cycle, srcId);
+        clearEntry(wbLineAddr, lineId);
+        return respCycle;
     }
 }
 
-uint64_t MESITopCC::processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint32_t childId, bool haveExclusive,
+template <CoherenceProtocol P>
+uint64_t MESITopCC<P>::processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint32_t childId, bool haveExclusive,
                                   MESIState* childState, bool* inducedWriteback, uint64_t cycle, uint32_t srcId, uint32_t flags) {
-    Entry* e = &array[lineId];
+    Entry* e = getEntry(lineAddr, lineId);
     uint64_t respCycle = cycle;
     switch (type) {
         case PUTX:
-            assert(e->isExclusive());
+            //Only MOESI owners write back dirty data without exclusive permission
+            assert(e && (e->isExclusive() || (P == PROTO_MOESI && e->owner == childId)));
             if (flags & MemReq::PUTX_KEEPEXCL) {
-                assert(e->sharers[childId]);
+                assert(e->isExclusive());
+                assert(mayInclude(getSharers(e), childId));
                 assert(*childState == M);
                 *childState = E; //they don't hold dirty data anymore
                 break; //don't remove from sharer set. It'll keep exclusive perms.
             }
             //note NO break in general
         case PUTS:
-            assert(e->sharers[childId]);
-            e->sharers[childId] = false;
+            assert(e && mayInclude(getSharers(e), childId));
+            removeSharer(getSharers(e), childId);
             e->numSharers--;
+            if (e->owner == childId) e->owner = NO_OWNER;
+            if (e->isEmpty()) clearEntry(lineAddr, lineId); //resets imprecise sets, frees sparse entries
             *childState = I;
             break;
         case GETS:
-            if (e->isEmpty() && haveExclusive && !(flags & MemReq::NOEXCL)) {
+            if ((!e || e->isEmpty()) && haveExclusive && !(flags & MemReq::NOEXCL)) {
                 //Give in E state
+                e = allocEntry(lineAddr, lineId, cycle, srcId);
                 e->exclusive = true;
-                e->sharers[childId] = true;
+                e->owner = childId;
+                addSharer(getSharers(e), childId);
                 e->numSharers = 1;
                 *childState = E;
             } else {
-                //Give in S state
-                assert(e->sharers[childId] == false);
+                //Give in S state (F in MESIF)
+                assert(!e || dir.format != FULL_MAP || !mayInclude(getSharers(e), childId));
 
-                if (e->isExclusive()) {
+                if (e && e->isExclusive()) {
                     //Downgrade the exclusive sharer
-                    respCycle = sendInvalidates(lineAddr, lineId, INVX, inducedWriteback, cycle, srcId);
+                    respCycle = sendInvalidates(lineAddr, lineId, INVX, inducedWriteback, cycle, srcId, childId);
+                    //If it had dirty data, it supplies it (and keeps it in O if MOESI)
+                    if (*inducedWriteback || e->owner != NO_OWNER) profC2C.inc();
+                } else if (P != PROTO_MESI && e && e->owner != NO_OWNER) {
+                    //The owner has the only up-to-date copy (MOESI), or the forwarder supplies it instead of us (MESIF)
+                    respCycle = forwardToOwner(lineAddr, e, cycle, srcId);
+                    profC2C.inc();
                 }
 
+                e = allocEntry(lineAddr, lineId, cycle, srcId);
                 assert_msg(!e->isExclusive(), "Can't have exclusivity here. isExcl=%d excl=%d numSharers=%d", e->isExclusive(), e->exclusive, e->numSharers);
 
-                e->sharers[childId] = true;
+                addSharer(getSharers(e), childId);
                 e->numSharers++;
                 e->exclusive = false; //dsm: Must set, we're explicitly non-exclusive
-                *childState = S;
+                if (P == PROTO_MESIF) {
+                    e->owner = childId; //the requester becomes the forwarder
+                    *childState = F;
+                } else {
+                    *childState = S;
+                }
             }
             break;
         case GETX:
             assert(haveExclusive); //the current cache better have exclusive access to this line
 
-            // If child is in sharers list (this is an upgrade miss), take it out
-            if (e->sharers[childId]) {
+            // If child is a sharer (this is an upgrade miss), take it out. Imprecise sets can't tell, but the child can.
+            if ((*childState == S || *childState == O || *childState == F) && e && !e->isEmpty() && mayInclude(getSharers(e), childId)) {
                 assert_msg(!e->isExclusive(), "Spurious GETX, childId=%d numSharers=%d isExcl=%d excl=%d", childId, e->numSharers, e->isExclusive(), e->exclusive);
-                e->sharers[childId] = false;
+                removeSharer(getSharers(e), childId);
                 e->numSharers--;
+                if (e->isEmpty()) resetEntry(e); //drop imprecise leftovers, we're about to refill it
             }
 
             // Invalidate all other copies
-            respCycle = sendInvalidates(lineAddr, lineId, INV, inducedWriteback, cycle, srcId);
+            respCycle = sendInvalidates(lineAddr, lineId, INV, inducedWriteback, cycle, srcId, childId);
 
             // Set current sharer, mark exclusive
-            e->sharers[childId] = true;
+            e = allocEntry(lineAddr, lineId, cycle, srcId);
+            addSharer(getSharers(e), childId);
             e->numSharers++;
             e->exclusive = true;
+            e->owner = childId;
 
             assert(e->numSharers == 1);
 
@@ -332,13 +650,31 @@ uint64_t MESITopCC::processAccess(Address lineAddr, uint32_t lineId, AccessType
     return respCycle;
 }
 
-uint64_t MESITopCC::processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId) {
+template <CoherenceProtocol P>
+uint64_t MESITopCC<P>::processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId) {
     if (type == FWD) {//if it's a FWD, we should be inclusive for now, so we must have the line, just invLat works
         assert(!nonInclusiveHack); //dsm: ask me if you see this failing and don't know why
+        //...unless one of our children owns the line (MOESI), then it has the only up-to-date copy
+        Entry* e = getEntry(lineAddr, lineId);
+        if (P == PROTO_MOESI && e && e->owner != NO_OWNER) return forwardToOwner(lineAddr, e, cycle, srcId);
         return cycle;
     } else {
         //Just invalidate or downgrade down to children as needed
-        return sendInvalidates(lineAddr, lineId, type, reqWriteback, cycle, srcId);
+        uint64_t respCycle = sendInvalidates(lineAddr, lineId, type, reqWriteback, cycle, srcId);
+        if (type == INV) {
+            clearEntry(lineAddr, lineId);
+        } else if (P == PROTO_MOESI) {
+            //If a child owns dirty data, we become an owner too (our bcc goes to O)
+            Entry* e = getEntry(lineAddr, lineId);
+            if (e && e->owner != NO_OWNER) *reqWriteback = true;
+        }
+        return respCycle;
     }
 }
 
+template class MESIBottomCC<PROTO_MESI>;
+template class MESIBottomCC<PROTO_MOESI>;
+template class MESIBottomCC<PROTO_MESIF>;
+template class MESITopCC<PROTO_MESI>;
+template class MESITopCC<PROTO_MOESI>;
+template class MESITopCC<PROTO_MESIF>;
@@ -26,7 +26,7 @@
 #ifndef COHERENCE_CTRLS_H_
 #define COHERENCE_CTRLS_H_
 
-#include <bitset>
+#include "bithacks.h"
 #include "constants.h"
 #include "g_std/g_string.h"
 #include "g_std/g_vector.h"
@@ -63,6 +63,43 @@ class CC : public GlobAlloc {
 };
 
 
+/* MESI-family protocol variants. All share the same controllers, templated on the variant so that the common MESI
+ * path has no extra checks or virtual calls:
+ *  - MOESI: a child downgraded from M keeps its dirty data in O, supplies it to later requesters, and writes it
+ *    back only when evicted. Parents don't absorb the dirty data on downgrades.
+ *  - MESIF: the last child to get a shared copy holds it in F, and supplies it to the next requester (which
+ *    becomes the new forwarder) instead of the parent.
+ * Protocols must match across the whole hierarchy.
+ */
+enum CoherenceProtocol {PROTO_MESI, PROTO_MOESI, PROTO_MESIF};
+
+/* Sharer set representations. FULL_MAP keeps one bit per child and is precise. LIMITED_PTR keeps up to pointers
+ * child ids, and broadcasts invalidations to all children once it overflows. COARSE_VECTOR keeps one bit per group
+ * of groupSize children. Imprecise sets may invalidate children that don't have the line; these invalidates are
+ * marked as such, and children ignore them (but still pay the lookup).
+ */
+enum SharerFormat {FULL_MAP, LIMITED_PTR, COARSE_VECTOR};
+
+/* Inclusion policy w.r.t. our children. Inclusive caches hold every line their children hold, and evicting a line
+ * back-invalidates it from children. Non-inclusive and exclusive caches track children's lines in a sparse directory
+ * decoupled from the data array, so evictions don't back-invalidate, and children's evictions fill the cache:
+ *  - NON_INCLUSIVE: misses fill both us and the child; dirty child evictions are kept, clean ones dropped.
+ *  - EXCLUSIVE (victim cache): misses bypass us, all child evictions are kept, and hits that give the child
+ *    exclusive permission move the line to it (shared lines stay).
+ * Both are only supported on the last level, as we don't keep permissions for lines we don't hold.
+ */
+enum InclusionPolicy {INCLUSIVE, NON_INCLUSIVE, EXCLUSIVE};
+
+struct DirConfig {
+    SharerFormat format;
+    uint32_t pointers; // LIMITED_PTR only
+    uint32_t groupSize; // COARSE_VECTOR only
+    // If non-zero, entries live in a sparse directory of this many entries instead of one per line. Evicting
+    // a sparse directory entry invalidates all copies of its line in our children.
+    uint32_t sparseEntries;
+    uint32_t sparseWays;
+};
+
 /* A MESI coherence controller is decoupled in two:
  *  - The BOTTOM controller, which deals with keeping coherence state with respect to the upper level and issues
  *    requests (accesses) to upper levels.
@@ -77,13 +114,19 @@ class CC : public GlobAlloc {
 class Cache;
 class Network;
 
-/* NOTE: To avoid virtual function overheads, there is no BottomCC interface, since we only have a MESI controller for now */
+/* NOTE: To avoid virtual function overheads, there is no BottomCC interface; protocol variants are template parameters */
 
+template <CoherenceProtocol P>
 class MESIBottomCC : public GlobAlloc {
     private:
         MESIState* array;
+        ApproxType* approxTypes; //type of each line's data, recorded at fill; dirty writebacks carry it
         g_vector<MemObject*> parents;
         g_vector<uint32_t> parentRTTs;
+        // Only set if the network models contention, to simulate our traversals to parents in the weave phase
+        Network* network;
+        int32_t selfNode;
+        g_vector<int32_t> parentNodes;
         uint32_t numLines;
         uint32_t selfId;
 
@@ -94,6 +137,8 @@ class MESIBottomCC : public GlobAlloc {
         //Counter profWBIncl, profWBCoh /* writebacks due to inclusion or coherence, received from downstream, does not include PUTS */;
         // TODO: Measuring writebacks is messy, do if needed
         Counter profGETNextLevelLat, profGETNetLat;
+        Counter profFetches;
+        Counter profVictimFills, profBypasses; //non-inclusive/exclusive caches only
 
         bool nonInclusiveHack;
 
@@ -102,10 +147,12 @@ class MESIBottomCC : public GlobAlloc {
         PAD();
 
     public:
-        MESIBottomCC(uint32_t _numLines, uint32_t _selfId, bool _nonInclusiveHack) : numLines(_numLines), selfId(_selfId), nonInclusiveHack(_nonInclusiveHack) {
+        MESIBottomCC(uint32_t _numLines, uint32_t _selfId, bool _nonInclusiveHack) : network(nullptr), selfNode(-1), numLines(_numLines), selfId(_selfId), nonInclusiveHack(_nonInclusiveHack) {
             array = gm_calloc<MESIState>(numLines);
+            approxTypes = gm_calloc<ApproxType>(numLines);
             for (uint32_t i = 0; i < numLines; i++) {
                 array[i] = I;
+                approxTypes[i] = no_approx;
             }
             futex_init(&ccLock);
         }
@@ -130,6 +177,7 @@ class MESIBottomCC : public GlobAlloc {
             profFWD.init("FWD", "Forwards (from upper level)");
             profGETNextLevelLat.init("latGETnl", "GET request latency on next level");
             profGETNetLat.init("latGETnet", "GET request latency on network to next level");
+            profFetches.init("fetch", "Data fetches from the next level (memory, on the LLC)");
 
             parentStat->append(&profGETSHit);
             parentStat->append(&profGETXHit);
@@ -143,6 +191,14 @@ class MESIBottomCC : public GlobAlloc {
             parentStat->append(&profFWD);
             parentStat->append(&profGETNextLevelLat);
             parentStat->append(&profGETNetLat);
+            parentStat->append(&profFetches);
+        }
+
+        void initDecoupledStats(AggregateStat* parentStat) {
+            profVictimFills.init("victimFill", "Lines filled by evictions from lower level");
+            profBypasses.init("bypass", "GETs fetched from next level without filling (exclusive)");
+            parentStat->append(&profVictimFills);
+            parentStat->append(&profBypasses);
         }
 
         uint64_t processEviction(Address wbLineAddr, uint32_t lineId, bool lowerLevelWriteback, uint64_t cycle, uint32_t srcId, Address pc, ApproxType approxType);
@@ -155,6 +211,20 @@ class MESIBottomCC : public GlobAlloc {
 
         uint64_t processNonInclusiveWriteback(Address lineAddr, AccessType type, uint64_t cycle, MESIState* state, uint32_t srcId, uint32_t flags, Address pc);
 
+        /* Non-inclusive/exclusive (last-level) caches only */
+
+        //Fills an invalid line without going to the next level: with a child eviction, or because a child supplies the data
+        void processLocalFill(uint32_t lineId, AccessType type, ApproxType approxType);
+
+        //Fetches a line from the next level without filling it; returns the response cycle and the permissions we got
+        uint64_t processBypassAccess(Address lineAddr, AccessType type, uint64_t cycle, uint32_t srcId, uint32_t flags, Address pc, ApproxType approxType, MESIState* state);
+
+        //Invalidates a line we're handing over to a child; returns whether it was dirty
+        bool processMove(uint32_t lineId);
+
+        //Writes back dirty data for a line we may not hold, without disturbing the access's timing record
+        void processDecoupledWriteback(Address lineAddr, uint64_t cycle, uint32_t srcId, ApproxType approxType);
+
         inline void lock() {
             futex_lock(&ccLock);
         }
@@ -176,19 +246,15 @@ class MESIBottomCC : public GlobAlloc {
 
 
 //Implements the "top" part: Keeps directory information, handles downgrades and invalidates
+template <CoherenceProtocol P>
 class MESITopCC : public GlobAlloc {
     private:
         struct Entry {
-            uint32_t numSharers;
-            std::bitset<MAX_CACHE_CHILDREN> sharers;
+            uint32_t numSharers; //always precise, even if the sharer set is not
+            // Precise id of the child that holds the line exclusively, or its O owner (MOESI) or F forwarder (MESIF)
+            uint16_t owner;
             bool exclusive;
 
-            void clear() {
-                exclusive = false;
-                numSharers = 0;
-                sharers.reset();
-            }
-
             bool isEmpty() {
                 return numSharers == 0;
             }
@@ -198,29 +264,59 @@ class MESITopCC : public GlobAlloc {
             }
         };
 
-        Entry* array;
+        // Sparse directory tags
+        struct SparseTag {
+            Address lineAddr;
+            int32_t lineId; //only if the directory is not decoupled
+            uint64_t lastUse;
+            bool valid;
+        };
+
+        DirConfig dir;
+        Entry* entries; //one per line, or sparseEntries if sparse
+        uint32_t numEntries;
+        uint64_t* sharerWords; //entryWords per entry, format-dependent
+        uint32_t entryWords;
+
+        // Sparse directory only
+        SparseTag* sparseTags;
+        int32_t* lineEntries; //lineId -> entry, -1 if line has no entry (and thus no sharers); null if decoupled
+        uint32_t sparseSets;
+        uint64_t useCounter;
+        // Last directory victim that pulled dirty data from children; lineId is -1 if decoupled
+        bool hasDirtyDirVictim;
+        Address dirtyDirVictimAddr;
+        int32_t dirtyDirVictimId;
+
+        // If set, entries are found by address and are independent of our lines (non-inclusive/exclusive caches)
+        bool decoupled;
+
         g_vector<BaseCache*> children;
         g_vector<uint32_t> childrenRTTs;
         uint32_t numLines;
 
         bool nonInclusiveHack;
 
+        Counter profInvSent, profInvSpurious, profDirEvictions, profDirEvictionInvs;
+        Counter profC2C, profBackInvAvoided;
+
         PAD();
         lock_t ccLock;
         PAD();
 
     public:
-        MESITopCC(uint32_t _numLines, bool _nonInclusiveHack) : numLines(_numLines), nonInclusiveHack(_nonInclusiveHack) {
-            array = gm_calloc<Entry>(numLines);
-            for (uint32_t i = 0; i < numLines; i++) {
-                array[i].clear();
-            }
-
+        MESITopCC(uint32_t _numLines, bool _nonInclusiveHack, InclusionPolicy inclusion, const DirConfig& _dir) : dir(_dir),
+            entries(nullptr), numEntries(0), sharerWords(nullptr), entryWords(0), sparseTags(nullptr), lineEntries(nullptr),
+            sparseSets(0), useCounter(0), hasDirtyDirVictim(false), dirtyDirVictimAddr(0), dirtyDirVictimId(-1),
+            decoupled(inclusion != INCLUSIVE), numLines(_numLines), nonInclusiveHack(_nonInclusiveHack)
+        {
             futex_init(&ccLock);
         }
 
         void init(const g_vector<BaseCache*>& _children, Network* network, const char* name);
 
+        void initStats(AggregateStat* parentStat);
+
         uint64_t processEviction(Address wbLineAddr, uint32_t lineId, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
 
         uint64_t processAccess(Address lineAddr, uint32_t lineId, AccessType type, uint32_t childId, bool haveExclusive,
@@ -228,6 +324,22 @@ class MESITopCC : public GlobAlloc {
 
         uint64_t processInval(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
 
+        // If a sparse directory entry was evicted during the last access and its children had dirty data, returns
+        // true and the line, whose dirty data is now ours; lineId is -1 if decoupled (we may not hold the line)
+        inline bool popDirtyDirVictim(Address* lineAddr, int32_t* lineId) {
+            if (!hasDirtyDirVictim) return false;
+            hasDirtyDirVictim = false;
+            *lineAddr = dirtyDirVictimAddr;
+            *lineId = dirtyDirVictimId;
+            return true;
+        }
+
+        // Whether a child holds the line exclusively, or owns or forwards it, and will supply the data to requesters
+        inline bool hasSupplier(Address lineAddr, uint32_t lineId) {
+            Entry* e = getEntry(lineAddr, lineId);
+            return e && !e->isEmpty() && (e->isExclusive() || (P != PROTO_MESI && e->owner != NO_OWNER));
+        }
+
         inline void lock() {
             futex_lock(&ccLock);
         }
@@ -238,11 +350,66 @@ class MESITopCC : public GlobAlloc {
 
         /* Replacement policy query interface */
         inline uint32_t numSharers(uint32_t lineId) {
-            return array[lineId].numSharers;
+            if (decoupled) return 0; //evicting our lines doesn't affect children
+            Entry* e = getEntry(0 /*not needed*/, lineId);
+            return e? e->numSharers : 0;
         }
 
     private:
-        uint64_t sendInvalidates(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId);
+        uint64_t sendInvalidates(Address lineAddr, uint32_t lineId, InvType type, bool* reqWriteback, uint64_t cycle, uint32_t srcId, int32_t skipChild = -1);
+
+        inline Entry* getEntry(Address lineAddr, uint32_t lineId) {
+            if (!sparseTags) return &entries[lineId];
+            if (lineEntries) {
+                int32_t idx = lineEntries[lineId];
+                return (idx == -1)? nullptr : &entries[idx];
+            }
+            uint32_t first = (lineAddr % sparseSets)*dir.sparseWays;
+            for (uint32_t w = first; w < first + dir.sparseWays; w++) {
+                if (sparseTags[w].valid && sparseTags[w].lineAddr == lineAddr) return &entries[w];
+            }
+            return nullptr;
+        }
+
+        inline uint64_t* getSharers(Entry* e) {
+            return &sharerWords[(e - entries)*entryWords];
+        }
+
+        Entry* allocEntry(Address lineAddr, uint32_t lineId, uint64_t cycle, uint32_t srcId);
+        void clearEntry(Address lineAddr, uint32_t lineId); //drops all sharers, and frees the entry if sparse
+
+        void addSharer(uint64_t* sharers, uint32_t childId);
+        void removeSharer(uint64_t* sharers, uint32_t childId);
+        bool mayInclude(uint64_t* sharers, uint32_t childId);
+        void resetEntry(Entry* e);
+
+        uint64_t forwardToOwner(Address lineAddr, Entry* e, uint64_t cycle, uint32_t srcId);
+
+        // Calls f(childId) on every child the sharer set may include
+        template <typename Visitor> inline void forEachSharer(uint64_t* sharers, Visitor f) {
+            uint32_t numChildren = children.size();
+            if (dir.format == LIMITED_PTR) {
+                uint16_t* ptrs = (uint16_t*)sharers;
+                if (ptrs[0] == LIMITED_PTR_OVERFLOW) {
+                    for (uint32_t c = 0; c < numChildren; c++) f(c);
+                } else {
+                    for (uint32_t i = 1; i <= ptrs[0]; i++) f(ptrs[i]);
+                }
+            } else {
+                uint32_t stride = (dir.format == COARSE_VECTOR)? dir.groupSize : 1;
+                for (uint32_t w = 0; w < entryWords; w++) {
+                    uint64_t bits = sharers[w];
+                    while (bits) {
+                        uint32_t first = (w*64 + __builtin_ctzl(bits))*stride;
+                        bits &= bits - 1;
+                        for (uint32_t c = first; c < MIN(first + stride, numChildren); c++) f(c);
+                    }
+                }
+            }
+        }
+
+        static const uint16_t LIMITED_PTR_OVERFLOW = 0xffff;
+        static const uint16_t NO_OWNER = 0xffff;
 };
 
 static inline bool CheckForMESIRace(AccessType& type, MESIState* state, MESIState initialState) {
@@ -257,16 +424,17 @@ static inline bool CheckForMESIRace(AccessType& type, MESIState* state, MESIStat
                 //If it was already invalidated (INV), just skip access altogether, we're already done
                 skipAccess = true;
             } else {
-                //We were downgraded (INVX), still need to do the PUT
-                assert(*state == S);
+                //We were downgraded (INVX, or FWD from F), still need to do the PUT
+                assert(*state == S || *state == O);
                 //If we wanted to do a PUTX, just change it to a PUTS b/c now the line is not exclusive anymore
-                if (type == PUTX) type = PUTS;
+                //(unless we kept the dirty data in O, MOESI)
+                if (type == PUTX && *state == S) type = PUTS;
             }
         } else if (type == GETX) { //...or it is a GETX
-            //In this case, the line MUST have been in S and have been INValidated
-            assert(initialState == S);
-            assert(*state == I);
-            //Do nothing. This is still a valid GETX, only it is not an upgrade miss anymore
+            //In this case, the line MUST have been shared (S/O/F) and have been INValidated (or lost F on a FWD)
+            assert(initialState == S || initialState == O || initialState == F);
+            assert(*state == I || *state == S);
+            //Do nothing. This is still a valid GETX, only it may not be an upgrade miss anymore
         } else { //no GETSs can race with INVs, if we are doing a GETS it's because the line was invalid to begin with!
             panic("Invalid true race happened (?)");
         }
@@ -275,32 +443,42 @@ static inline bool CheckForMESIRace(AccessType& type, MESIState* state, MESIStat
 }
 
 // Non-terminal CC; accepts GETS/X and PUTS/X accesses
+template <CoherenceProtocol P>
 class MESICC : public CC {
     private:
-        MESITopCC* tcc;
-        MESIBottomCC* bcc;
+        MESITopCC<P>* tcc;
+        MESIBottomCC<P>* bcc;
         uint32_t numLines;
         bool nonInclusiveHack;
+        InclusionPolicy inclusion;
+        DirConfig dirConfig;
         g_string name;
 
     public:
         //Initialization
-        MESICC(uint32_t _numLines, bool _nonInclusiveHack, g_string& _name) : tcc(nullptr), bcc(nullptr),
-            numLines(_numLines), nonInclusiveHack(_nonInclusiveHack), name(_name) {}
+        MESICC(uint32_t _numLines, bool _nonInclusiveHack, InclusionPolicy _inclusion, const DirConfig& _dirConfig, g_string& _name) : tcc(nullptr), bcc(nullptr),
+            numLines(_numLines), nonInclusiveHack(_nonInclusiveHack), inclusion(_inclusion), dirConfig(_dirConfig), name(_name) {}
 
         void setParents(uint32_t childId, const g_vector<MemObject*>& parents, Network* network) {
-            bcc = new MESIBottomCC(numLines, childId, nonInclusiveHack);
+            if (inclusion != INCLUSIVE) {
+                //We give children exclusive permission on lines we don't hold, which is only safe at the last level
+                for (MemObject* p : parents) {
+                    if (dynamic_cast<BaseCache*>(p)) panic("[%s] Non-inclusive and exclusive caches must be last-level caches", name.c_str());
+                }
+            }
+            bcc = new MESIBottomCC<P>(numLines, childId, nonInclusiveHack);
             bcc->init(parents, network, name.c_str());
         }
 
         void setChildren(const g_vector<BaseCache*>& children, Network* network) {
-            tcc = new MESITopCC(numLines, nonInclusiveHack);
+            tcc = new MESITopCC<P>(numLines, nonInclusiveHack, inclusion, dirConfig);
             tcc->init(children, network, name.c_str());
         }
 
         void initStats(AggregateStat* cacheStat) {
-            //no tcc stats
             bcc->initStats(cacheStat);
+            tcc->initStats(cacheStat);
+            if (inclusion != INCLUSIVE) bcc->initDecoupledStats(cacheStat);
         }
 
         //Access methods
@@ -327,9 +505,11 @@ class MESICC : public CC {
 
         bool shouldAllocate(const MemReq& req) {
             if ((req.type == GETS) || (req.type == GETX)) {
-                return true;
+                return inclusion != EXCLUSIVE; //exclusive caches are only filled by child evictions
             } else {
                 assert((req.type == PUTS) || (req.type == PUTX));
+                if (inclusion == EXCLUSIVE) return true;
+                if (inclusion == NON_INCLUSIVE) return req.type == PUTX; //keep dirty data, drop clean lines
                 if (!nonInclusiveHack) {
                     panic("[%s] We lost inclusion on this line! 0x%lx, type %s, childId %d, childState %s", name.c_str(),
                             req.lineAddr, AccessTypeName(req.type), req.childId, MESIStateName(*req.state));
@@ -346,6 +526,7 @@ class MESICC : public CC {
         }
 
         uint64_t processAccess(const MemReq& req, int32_t lineId, uint64_t startCycle, uint64_t* getDoneCycle = nullptr) {
+            if (inclusion != INCLUSIVE) return processDecoupledAccess(req, lineId, startCycle, getDoneCycle);
             uint64_t respCycle = startCycle;
             //Handle non-inclusive writebacks by bypassing
             //NOTE: Most of the time, these are due to evictions, so the line is not there. But the second condition can trigger in NUCA-initiated
@@ -375,6 +556,12 @@ class MESICC : public CC {
                         //Essentially, if tcc induced a writeback, bcc may need to do an E->M transition to reflect that the cache now has dirty data
                         bcc->processWritebackOnAccess(req.lineAddr, lineId, req.type);
                     }
+                    Address dirVictimAddr;
+                    int32_t dirVictimId;
+                    if (tcc->popDirtyDirVictim(&dirVictimAddr, &dirVictimId)) {
+                        //Same for a sparse directory eviction that invalidated dirty copies of another line
+                        bcc->processWritebackOnAccess(dirVictimAddr, dirVictimId, GETX);
+                    }
                 }
             }
             return respCycle;
@@ -396,6 +583,10 @@ class MESICC : public CC {
         }
 
         uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) {
+            if (lineId == -1) { //spurious invalidate from an imprecise sharer set, we don't have the line
+                bcc->unlock();
+                return startCycle;
+            }
             uint64_t respCycle = tcc->processInval(req.lineAddr, lineId, req.type, req.writeback, startCycle, req.srcId); //send invalidates or downgrades to children
             bcc->processInval(req.lineAddr, lineId, req.type, req.writeback); //adjust our own state
 
@@ -406,12 +597,85 @@ class MESICC : public CC {
         //Repl policy interface
         uint32_t numSharers(uint32_t lineId) {return tcc->numSharers(lineId);}
         bool isValid(uint32_t lineId) {return bcc->isValid(lineId);}
+
+    private:
+        // Non-inclusive and exclusive accesses. The directory tracks children's lines regardless of whether we hold
+        // them, so a GET may be served by us, by a child that holds the line exclusively (or owns/forwards it), or
+        // by memory; and dirty data pulled from children must be kept or written back if we don't hold the line.
+        uint64_t processDecoupledAccess(const MemReq& req, int32_t lineId, uint64_t startCycle, uint64_t* getDoneCycle) {
+            uint64_t respCycle = startCycle;
+            bool present = lineId != -1 && bcc->isValid(lineId);
+            bool filled = false; //line was invalid and we filled it on this access
+            if (!present && lineId != -1 && !shouldAllocate(req)) lineId = -1; //stale tag we can't use
+            bool isPrefetch = req.flags & MemReq::PREFETCH;
+            assert(!isPrefetch || req.type == GETS);
+            uint32_t flags = req.flags & ~MemReq::PREFETCH;
+
+            if ((req.type == PUTS) || (req.type == PUTX)) {
+                //Child eviction: keep the line if we allocated for it, then drop the child from the directory
+                if (present) {
+                    respCycle = bcc->processAccess(req.lineAddr, lineId, req.type, startCycle, req.srcId, flags, req.pc, req.approxType);
+                } else if (lineId != -1) {
+                    bcc->processLocalFill(lineId, req.type, req.approxType);
+                }
+                bool lowerLevelWriteback = false;
+                return tcc->processAccess(req.lineAddr, lineId, req.type, req.childId, false, req.state, &lowerLevelWriteback, respCycle, req.srcId, req.flags);
+            }
+
+            bool haveExclusive;
+            MESIState bypassState = I;
+            if (present) {
+                respCycle = bcc->processAccess(req.lineAddr, lineId, req.type, startCycle, req.srcId, flags, req.pc, req.approxType);
+                haveExclusive = bcc->isExclusive(lineId);
+            } else if (tcc->hasSupplier(req.lineAddr, lineId)) {
+                //A child has the line and we're the last level, so we have implicit exclusive permission; no need to fetch
+                if (isPrefetch) return respCycle;
+                if (lineId != -1) {
+                    bcc->processLocalFill(lineId, req.type, req.approxType);
+                    filled = true;
+                }
+                haveExclusive = true;
+            } else if (lineId != -1) {
+                respCycle = bcc->processAccess(req.lineAddr, lineId, req.type, startCycle, req.srcId, flags, req.pc, req.approxType);
+                haveExclusive = bcc->isExclusive(lineId);
+                filled = true;
+            } else {
+                if (isPrefetch) return respCycle; //nowhere to put it
+                respCycle = bcc->processBypassAccess(req.lineAddr, req.type, startCycle, req.srcId, flags, req.pc, req.approxType, &bypassState);
+                haveExclusive = (bypassState == E) || (bypassState == M);
+            }
+            if (getDoneCycle) *getDoneCycle = respCycle;
+            if (isPrefetch) return respCycle;
+
+            bool lowerLevelWriteback = false;
+            respCycle = tcc->processAccess(req.lineAddr, lineId, req.type, req.childId, haveExclusive, req.state,
+                    &lowerLevelWriteback, respCycle, req.srcId, flags);
+            if (lowerLevelWriteback) {
+                //The child we downgraded had dirty data: keep it if we hold the line, else write it back (GETX hands it to the requester)
+                if (present || filled) bcc->processWritebackOnAccess(req.lineAddr, lineId, req.type);
+                else if (req.type == GETS) bcc->processDecoupledWriteback(req.lineAddr, respCycle, req.srcId, req.approxType);
+            }
+
+            Address dirVictimAddr;
+            int32_t dirVictimId;
+            if (tcc->popDirtyDirVictim(&dirVictimAddr, &dirVictimId)) {
+                //A directory eviction pulled dirty data of a line we may not hold (and whose type we don't know)
+                bcc->processDecoupledWriteback(dirVictimAddr, respCycle, req.srcId, no_approx);
+            }
+
+            if (inclusion == EXCLUSIVE && (present || filled) && (*req.state == E || *req.state == M)) {
+                //The child now holds the only copy, so move it there; it becomes responsible for our dirty data
+                if (bcc->processMove(lineId) && *req.state == E) *req.state = M;
+            }
+            return respCycle;
+        }
 };
 
 // Terminal CC, i.e., without children --- accepts GETS/X, but not PUTS/X
+template <CoherenceProtocol P>
 class MESITerminalCC : public CC {
     private:
-        MESIBottomCC* bcc;
+        MESIBottomCC<P>* bcc;
         uint32_t numLines;
         g_string name;
 
@@ -420,7 +684,7 @@ class MESITerminalCC : public CC {
         MESITerminalCC(uint32_t _numLines, const g_string& _name) : bcc(nullptr), numLines(_numLines), name(_name) {}
 
         void setParents(uint32_t childId, const g_vector<MemObject*>& parents, Network* network) {
-            bcc = new MESIBottomCC(numLines, childId, false /*inclusive*/);
+            bcc = new MESIBottomCC<P>(numLines, childId, false /*inclusive*/);
             bcc->init(parents, network, name.c_str());
         }
 
@@ -486,6 +750,10 @@ class MESITerminalCC : public CC {
         }
 
         uint64_t processInv(const InvReq& req, int32_t lineId, uint64_t startCycle) {
+            if (lineId == -1) { //spurious invalidate from an imprecise sharer set, we don't have the line
+                bcc->unlock();
+                return startCycle;
+            }
             bcc->processInval(req.lineAddr, lineId, req.type, req.writeback); //adjust our own state
             bcc->unlock();
             return startCycle; //no extra delay in terminal caches
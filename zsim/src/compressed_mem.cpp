@@ -0,0 +1,71 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "compressed_mem.h"
+#include <math.h>
+#include "log.h"
+
+CompressedMemory::CompressedMemory(MemObject* _mem, uint32_t _lineSize, const double* ratios, const char* _name)
+    : mem(_mem), lineSize(_lineSize), name(_name)
+{
+    for (uint32_t t = 0; t < NUM_TYPES; t++) {
+        if (ratios[t] < 1.0) panic("%s: compression ratio %f for type %d must be >= 1.0", name.c_str(), ratios[t], t);
+        compBytes[t] = (uint32_t)ceil(lineSize/ratios[t]);
+        assert(compBytes[t] >= 1 && compBytes[t] <= lineSize);
+    }
+    info("%s: compressed line sizes: exact %d, uint %d, fp %d bytes", name.c_str(),
+            compBytes[no_approx], compBytes[approx_uint], compBytes[approx_fp]);
+}
+
+void CompressedMemory::initStats(AggregateStat* parentStat) {
+    mem->initStats(parentStat);
+
+    AggregateStat* compStats = new AggregateStat();
+    compStats->init(name.c_str(), "Memory compression stats");
+    profAccs.init("accs", "Memory accesses (reads and dirty writebacks) by data type (exact, uint, fp)", NUM_TYPES);
+    compStats->append(&profAccs);
+    profRawBytes.init("rawBytes", "Bytes that would be transferred without compression"); compStats->append(&profRawBytes);
+    profCompBytes.init("compBytes", "Bytes actually transferred"); compStats->append(&profCompBytes);
+    auto savedStat = makeLambdaStat([this]() { return profRawBytes.get() - profCompBytes.get(); });
+    savedStat->init("savedBytes", "Memory bandwidth saved by compression, in bytes");
+    compStats->append(savedStat);
+    parentStat->append(compStats);
+}
+
+uint64_t CompressedMemory::access(MemReq& req) {
+    if (req.type == PUTS) return mem->access(req);  // not a real access
+
+    uint32_t type = req.approxType;
+    assert(type < NUM_TYPES);
+    uint32_t bytes = compBytes[type];
+    profAccs.atomicInc(type);
+    profRawBytes.atomicInc(lineSize);
+    profCompBytes.atomicInc(bytes);
+
+    req.compBytes = bytes;
+    uint64_t respCycle = mem->access(req);
+    req.compBytes = 0;
+    return respCycle;
+}
@@ -0,0 +1,68 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef COMPRESSED_MEM_H_
+#define COMPRESSED_MEM_H_
+
+/* Memory-compression layer between the LLC and a memory controller. Each line
+ * is assumed to compress by a fixed ratio that depends on its approximate data
+ * type (MemReq::approxType, i.e., the registered approx region it belongs to,
+ * or exact data). The compressed size is passed down in MemReq::compBytes, so
+ * controllers that model the data bus (DDRMemory, WeaveBWMemory) transfer
+ * fewer bytes. Others just ignore it.
+ *
+ * NOTE: Writebacks carry the approxType of the access that caused the eviction,
+ * not of the evicted line, so writeback compressibility is approximate.
+ */
+
+#include "g_std/g_string.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+class CompressedMemory : public MemObject {
+    private:
+        static const uint32_t NUM_TYPES = type_max + 1;
+
+        MemObject* const mem;
+        const uint32_t lineSize;
+        uint32_t compBytes[NUM_TYPES];  // per ApproxType
+        g_string name;
+
+        VectorCounter profAccs;
+        Counter profRawBytes;
+        Counter profCompBytes;
+
+    public:
+        // ratios is indexed by ApproxType; each must be >= 1.0
+        CompressedMemory(MemObject* _mem, uint32_t _lineSize, const double* ratios, const char* _name);
+
+        uint64_t access(MemReq& req);
+        void initStats(AggregateStat* parentStat);
+
+        // Network nodes and memory stats use the controller's name
+        const char* getName() {return mem->getName();}
+};
+
+#endif  // COMPRESSED_MEM_H_
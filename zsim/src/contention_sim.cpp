@@ -58,9 +58,14 @@ void ContentionSim::SimThreadTrampoline(void* arg) {
     csim->simThreadLoop(thid);
 }
 
-ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
+ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _workStealing, PQFarEngine farEngine) {
     numDomains = _numDomains;
     numSimThreads = _numSimThreads;
+    if (numSimThreads > numDomains) {
+        warn("More contention threads (%d) than domains (%d), using %d threads", numSimThreads, numDomains, numDomains);
+        numSimThreads = numDomains;
+    }
+    workStealing = _workStealing && numDomains > numSimThreads; //with one domain per thread, there is nothing to steal
     threadsDone = 0;
     limit = 0;
     lastLimit = 0;
@@ -70,12 +75,15 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
     simThreads = gm_calloc<SimThreadData>(numSimThreads);
 
     for (uint32_t i = 0; i < numDomains; i++) {
-        new (&domains[i].pq) PrioQueue<TimingEvent, PQ_BLOCKS>();
+        new (&domains[i].pq) PrioQueue<TimingEvent, PQ_BLOCKS>(farEngine);
         domains[i].curCycle = 0;
         futex_init(&domains[i].pqLock);
     }
 
-    if ((numDomains % numSimThreads) != 0) panic("numDomains(%d) must be a multiple of numSimThreads(%d) for now", numDomains, numSimThreads);
+    //Domains need not divide evenly among threads; home ranges differ by at most one domain, and work stealing evens out the rest
+    if ((numDomains % numSimThreads) != 0 && !workStealing) {
+        warn("numDomains (%d) is not a multiple of contention threads (%d) and work stealing is disabled, weave phase will be imbalanced", numDomains, numSimThreads);
+    }
 
     for (uint32_t i = 0; i < numSimThreads; i++) {
         futex_init(&simThreads[i].wakeLock);
@@ -98,22 +106,37 @@ ContentionSim::ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads) {
     }
 
     lastCrossing = gm_calloc<CrossingEventInfo>(numDomains*numDomains*MAX_THREADS); //TODO: refine... this allocs too much
+
+    numSources = zinfo->numCores;
+    staging = gm_memalign<StagingBuffer>(CACHE_LINE_BYTES, numDomains*numSources);
+    for (uint32_t i = 0; i < numDomains*numSources; i++) staging[i].count = 0;
 }
 
 void ContentionSim::postInit() {
-    for (uint32_t i = 0; i < zinfo->numCores; i++) {
+    uint32_t i;
+    for (i = 0; i < zinfo->numCores; i++) {
         TimingCore* tcore = dynamic_cast<TimingCore*>(zinfo->cores[i]);
         if (tcore) {
             skipContention = false;
-            return;
+            break;
         }
         OOOCore* ocore = dynamic_cast<OOOCore*>(zinfo->cores[i]);
         if (ocore) {
             skipContention = false;
-            return;
+            break;
         }
     }
-    skipContention = true;
+    if (i == zinfo->numCores) skipContention = true;
+
+#if PQ_RECORD_STREAMS
+    for (uint32_t d = 0; d < numDomains; d++) {
+        std::stringstream ss;
+        ss << zinfo->outputDir << "/pq-domain-" << d << ".stream";
+        FILE* f = fopen(ss.str().c_str(), "w");
+        if (!f) panic("Could not open %s", ss.str().c_str());
+        domains[d].pq.setRecordFile(f);
+    }
+#endif
 }
 
 void ContentionSim::initStats(AggregateStat* parentStat) {
@@ -138,8 +161,24 @@ void ContentionSim::initStats(AggregateStat* parentStat) {
         new (&domains[i].profTime) ClockStat();
         domains[i].profTime.init("time", "Weave simulation time");
         domStat->append(&domains[i].profTime);
+        new (&domains[i].profSteals) Counter();
+        domains[i].profSteals.init("steals", "Times this domain was claimed by a thread other than its home thread");
+        domStat->append(&domains[i].profSteals);
         objStat->append(domStat);
     }
+    for (uint32_t i = 0; i < numSimThreads; i++) {
+        std::stringstream ss;
+        ss << "thread-" << i;
+        AggregateStat* thStat = new AggregateStat();
+        thStat->init(gm_strdup(ss.str().c_str()), "Simulation thread stats");
+        new (&simThreads[i].profBusy) ClockStat();
+        new (&simThreads[i].profIdle) ClockStat();
+        simThreads[i].profBusy.init("busy", "Weave time spent simulating domains");
+        simThreads[i].profIdle.init("idle", "Weave time spent waiting for a domain to steal");
+        thStat->append(&simThreads[i].profBusy);
+        thStat->append(&simThreads[i].profIdle);
+        objStat->append(thStat);
+    }
     parentStat->append(objStat);
 }
 
@@ -157,6 +196,12 @@ void ContentionSim::simulatePhase(uint64_t limit) {
         if (ocore) ocore->cSimStart();
     }
 
+    //Every domain starts the phase held by its home thread
+    for (uint32_t i = 0; i < numDomains; i++) domains[i].simState = DOM_HELD;
+    domainsDone = 0;
+    freeDomains = 0;
+    idleThreads = 0;
+
     inCSim = true;
     __sync_synchronize();
 
@@ -216,6 +261,30 @@ void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle) {
     futex_unlock(&domains[domain].pqLock);
 }
 
+void ContentionSim::enqueueSynced(TimingEvent* ev, uint64_t cycle, uint32_t srcId) {
+    assert(!inCSim);
+    assert(ev && ev->domain != -1);
+    assert(ev->domain < (int32_t)numDomains);
+    if (srcId >= numSources) {
+        enqueueSynced(ev, cycle);
+        return;
+    }
+
+    StagingBuffer& sb = staging[ev->domain*numSources + srcId];
+    if (sb.count == STAGING_SLOTS) {
+        enqueueSynced(ev, cycle); //full, take the slow path
+        return;
+    }
+
+    assert_msg(cycle >= lastLimit, "Enqueued (staged) event before last limit! cycle %ld min %ld", cycle, lastLimit);
+    assert_msg(cycle < lastLimit+10*zinfo->phaseLength+10000, "Queued (staged) event too far into the future, cycle %ld lastLimit %ld", cycle, lastLimit);
+    ev->privCycle = cycle;
+    assert(ev->numParents == 0);
+    sb.slots[sb.count].ev = ev;
+    sb.slots[sb.count].cycle = cycle;
+    sb.count++;
+}
+
 void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec) {
     CrossingStack& cs = evRec->getCrossingStack();
     bool isFirst = cs.empty();
@@ -246,7 +315,7 @@ void ContentionSim::enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t
             //We can't queue --- queue directly (synced, we're in phase 1)
             assert(cycle >= srcDomCycle);
             //info("Queuing xing %ld %ld (lst eve too old at cycle %ld)", cycle, srcDomCycle, last->cycle);
-            enqueueSynced(ev, cycle);
+            enqueueSynced(ev, cycle, srcId);
         }
         //Store this one as the last req
         last->cycle = cycle;
@@ -288,128 +357,219 @@ void ContentionSim::simThreadLoop(uint32_t thid) {
     info("Finished contention simulation thread %d", thid);
 }
 
+void ContentionSim::drainStaging(uint32_t domain) {
+    PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domains[domain].pq;
+    for (uint32_t src = 0; src < numSources; src++) {
+        StagingBuffer& sb = staging[domain*numSources + src];
+        for (uint32_t i = 0; i < sb.count; i++) pq.enqueue(sb.slots[i].ev, sb.slots[i].cycle);
+        sb.count = 0;
+    }
+}
+
 void ContentionSim::simulatePhaseThread(uint32_t thid) {
-    uint32_t thDomains = simThreads[thid].supDomain - simThreads[thid].firstDomain;
-    uint32_t numFinished = 0;
+    SimThreadData& st = simThreads[thid];
+    uint32_t thDomains = st.supDomain - st.firstDomain;
+    st.profBusy.start();
 
-    if (thDomains == 1) {
-        DomainData& domain = domains[simThreads[thid].firstDomain];
-        domain.profTime.start();
-        PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain.pq;
-        while (pq.size() && pq.firstCycle() < limit) {
-            uint64_t domCycle = domain.curCycle;
-            uint64_t cycle;
-            TimingEvent* te = pq.dequeue(cycle);
-            assert(cycle >= domCycle);
-            if (cycle != domCycle) {
-                domCycle = cycle;
-                domain.curCycle = cycle;
-            }
-            te->run(cycle);
-            uint64_t newCycle = pq.size()? pq.firstCycle() : limit;
-            assert(newCycle >= domCycle);
-            if (newCycle != domCycle) domain.curCycle = newCycle;
-#if POST_MORTEM
-            simThreads[thid].logVec.push_back(std::make_pair(cycle, te));
-#endif
-        }
-        domain.curCycle = limit;
-        domain.profTime.end();
+    //Home domains are drained before any event runs; other threads only read their curCycle, which draining does not change
+    for (uint32_t i = st.firstDomain; i < st.supDomain; i++) drainStaging(i);
 
-#if POST_MORTEM
-        //Post-mortem
-        if (limit % 10000000 == 0)  {
-            futex_lock(&postMortemLock); //serialize output
-            uint32_t uniqueEvs = 0;
-            std::unordered_map<TimingEvent*, std::string> evsSeen;
-            for (std::pair<uint64_t, TimingEvent*> p : simThreads[thid].logVec) {
-                uint64_t cycle = p.first;
-                TimingEvent* te = p.second;
-                std::string desc = evsSeen[te];
-                if (desc == "") { //non-existnt
-                    std::stringstream ss;
-                    ss << uniqueEvs << " " << typeid(*te).name();
-                    CrossingEvent* ce = dynamic_cast<CrossingEvent*>(te);
-                    if (ce) {
-                        ss << " slack " << (ce->preSlack + ce->postSlack) << " osc " << ce->origStartCycle << " cnt " << ce->simCount;
-                    }
-
-                    evsSeen[te] = ss.str();
-                    uniqueEvs++;
-                    desc = ss.str();
-                }
-                info("[%d] %ld %s", thid, cycle, desc.c_str());
-            }
-            futex_unlock(&postMortemLock);
-        }
-        simThreads[thid].logVec.clear();
-#endif
+    std::priority_queue<DomainData*, std::vector<DomainData*>, CompareDomains> domPq;
+    uint32_t heldDomains = 0;
 
+    if (thDomains == 1) {
+        //Fast path; we can only steal once our single home domain is done
+        DomainData* domain = &domains[st.firstDomain];
+        simulateSingleDomain(thid, *domain);
+        finishDomain(domain);
     } else {
-        //info("XXX %d / %d %d %d", thid, thDomains, simThreads[thid].supDomain, simThreads[thid].firstDomain);
-
-        std::priority_queue<DomainData*, std::vector<DomainData*>, CompareDomains> domPq;
-        for (uint32_t i = simThreads[thid].firstDomain; i < simThreads[thid].supDomain; i++) {
+        for (uint32_t i = st.firstDomain; i < st.supDomain; i++) {
             domPq.push(&domains[i]);
+            heldDomains++;
         }
+    }
 
-        std::vector<DomainData*> sq1;
-        std::vector<DomainData*> sq2;
+    std::vector<DomainData*> sq1;
+    std::vector<DomainData*> sq2;
 
-        std::vector<DomainData*>& stalledQueue = sq1;
-        std::vector<DomainData*>& nextStalledQueue = sq2;
+    std::vector<DomainData*>& stalledQueue = sq1;
+    std::vector<DomainData*>& nextStalledQueue = sq2;
+
+    while (true) {
+        if (!heldDomains) {
+            if (!workStealing) break;
+            DomainData* domain = waitForDomain(thid);
+            if (!domain) break; //all domains done
+            domPq.push(domain);
+            heldDomains++;
+        }
 
-        while (numFinished < thDomains) {
-            while (domPq.size()) {
-                DomainData* domain = domPq.top();
-                domPq.pop();
-                PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
-                if (!pq.size() || pq.firstCycle() > limit) {
-                    numFinished++;
-                    domain->curCycle = limit;
+        while (domPq.size()) {
+            DomainData* domain = domPq.top();
+            domPq.pop();
+            PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
+            if (!pq.size() || pq.firstCycle() > limit) {
+                finishDomain(domain);
+                heldDomains--;
+            } else {
+                //info("YYY %d %ld %ld %d", heldDomains, domPq.size(), domain->curCycle, domain->prio);
+                uint64_t cycle;
+                TimingEvent* te = pq.dequeue(cycle);
+                //uint64_t nextCycle = pq.size()? pq.firstCycle() : cycle;
+                if (cycle != domain->curCycle) domain->curCycle = cycle;
+                te->run(cycle);
+                domain->curCycle = pq.size()? pq.firstCycle() : limit;
+                domain->queuePrio = domain->curCycle;
+                if (workStealing && heldDomains > 1 && idleThreads > freeDomains) {
+                    donateDomain(domain);
+                    heldDomains--;
+                } else if (domain->prio == 0) {
+                    domPq.push(domain);
                 } else {
-                    //info("YYY %d %ld %ld %d", numFinished, domPq.size(), domain->curCycle, domain->prio);
-                    uint64_t cycle;
-                    TimingEvent* te = pq.dequeue(cycle);
-                    //uint64_t nextCycle = pq.size()? pq.firstCycle() : cycle;
-                    if (cycle != domain->curCycle) domain->curCycle = cycle;
-                    te->run(cycle);
-                    domain->curCycle = pq.size()? pq.firstCycle() : limit;
-                    domain->queuePrio = domain->curCycle;
-                    if (domain->prio == 0) domPq.push(domain);
-                    else stalledQueue.push_back(domain);
+                    stalledQueue.push_back(domain);
                 }
             }
+        }
 
-            while (stalledQueue.size()) {
-                DomainData* domain = stalledQueue.back();
-                stalledQueue.pop_back();
-                PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
-                if (!pq.size() || pq.firstCycle() > limit) {
-                    numFinished++;
-                    domain->curCycle = limit;
-                } else {
-                    //info("SSS %d %ld %ld", numFinished, stalledQueue.size(), domain->curCycle);
-                    uint64_t cycle;
-                    TimingEvent* te = pq.dequeue(cycle);
-                    if (cycle != domain->curCycle) domain->curCycle = cycle;
-                    te->state = EV_RUNNING;
-                    te->simulate(cycle);
-                    domain->curCycle = pq.size()? pq.firstCycle() : limit;
-                    domain->queuePrio = domain->curCycle;
-                    if (domain->prio == 0) domPq.push(domain);
-                    else nextStalledQueue.push_back(domain);
+        while (stalledQueue.size()) {
+            DomainData* domain = stalledQueue.back();
+            stalledQueue.pop_back();
+            PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain->pq;
+            if (!pq.size() || pq.firstCycle() > limit) {
+                finishDomain(domain);
+                heldDomains--;
+            } else {
+                //info("SSS %d %ld %ld", heldDomains, stalledQueue.size(), domain->curCycle);
+                uint64_t cycle;
+                TimingEvent* te = pq.dequeue(cycle);
+                if (cycle != domain->curCycle) domain->curCycle = cycle;
+                te->state = EV_RUNNING;
+                te->simulate(cycle);
+                domain->curCycle = pq.size()? pq.firstCycle() : limit;
+                domain->queuePrio = domain->curCycle;
+                if (domain->prio == 0) domPq.push(domain);
+                else nextStalledQueue.push_back(domain);
+            }
+
+            //All our domains are waiting on others; adopt any donated domain that nobody claimed,
+            //since we may be waiting on it
+            if (workStealing && freeDomains) {
+                DomainData* claimed = claimDomain();
+                if (claimed) {
+                    domPq.push(claimed);
+                    heldDomains++;
                 }
-                if (domPq.size()) break;
             }
-            if (!stalledQueue.size()) std::swap(stalledQueue, nextStalledQueue);
+            if (domPq.size()) break;
         }
+        if (!stalledQueue.size()) std::swap(stalledQueue, nextStalledQueue);
     }
 
+    st.profBusy.end();
     //info("Phase done");
     __sync_synchronize();
 }
 
+void ContentionSim::simulateSingleDomain(uint32_t thid, DomainData& domain) {
+    domain.profTime.start();
+    PrioQueue<TimingEvent, PQ_BLOCKS>& pq = domain.pq;
+    while (pq.size() && pq.firstCycle() < limit) {
+        uint64_t domCycle = domain.curCycle;
+        uint64_t cycle;
+        TimingEvent* te = pq.dequeue(cycle);
+        assert(cycle >= domCycle);
+        if (cycle != domCycle) {
+            domCycle = cycle;
+            domain.curCycle = cycle;
+        }
+        te->run(cycle);
+        uint64_t newCycle = pq.size()? pq.firstCycle() : limit;
+        assert(newCycle >= domCycle);
+        if (newCycle != domCycle) domain.curCycle = newCycle;
+#if POST_MORTEM
+        simThreads[thid].logVec.push_back(std::make_pair(cycle, te));
+#endif
+    }
+    domain.curCycle = limit;
+    domain.profTime.end();
+
+#if POST_MORTEM
+    //Post-mortem
+    if (limit % 10000000 == 0)  {
+        futex_lock(&postMortemLock); //serialize output
+        uint32_t uniqueEvs = 0;
+        std::unordered_map<TimingEvent*, std::string> evsSeen;
+        for (std::pair<uint64_t, TimingEvent*> p : simThreads[thid].logVec) {
+            uint64_t cycle = p.first;
+            TimingEvent* te = p.second;
+            std::string desc = evsSeen[te];
+            if (desc == "") { //non-existnt
+                std::stringstream ss;
+                ss << uniqueEvs << " " << typeid(*te).name();
+                CrossingEvent* ce = dynamic_cast<CrossingEvent*>(te);
+                if (ce) {
+                    ss << " slack " << (ce->preSlack + ce->postSlack) << " osc " << ce->origStartCycle << " cnt " << ce->simCount;
+                }
+
+                evsSeen[te] = ss.str();
+                uniqueEvs++;
+                desc = ss.str();
+            }
+            info("[%d] %ld %s", thid, cycle, desc.c_str());
+        }
+        futex_unlock(&postMortemLock);
+    }
+    simThreads[thid].logVec.clear();
+#endif
+}
+
+void ContentionSim::finishDomain(DomainData* domain) {
+    assert(domain->simState == DOM_HELD);
+    domain->curCycle = limit;
+    domain->simState = DOM_DONE;
+    __sync_fetch_and_add(&domainsDone, 1);
+}
+
+void ContentionSim::donateDomain(DomainData* domain) {
+    assert(domain->simState == DOM_HELD);
+    __sync_synchronize(); //everything we did on this domain must be visible to the thread that claims it
+    domain->simState = DOM_FREE;
+    __sync_fetch_and_add(&freeDomains, 1);
+}
+
+ContentionSim::DomainData* ContentionSim::claimDomain() {
+    for (uint32_t i = 0; i < numDomains; i++) {
+        DomainData* domain = &domains[i];
+        if (domain->simState == DOM_FREE && __sync_bool_compare_and_swap(&domain->simState, DOM_FREE, DOM_HELD)) {
+            __sync_fetch_and_sub(&freeDomains, 1);
+            domain->profSteals.inc(); //only the holder touches this
+            return domain;
+        }
+    }
+    return nullptr;
+}
+
+ContentionSim::DomainData* ContentionSim::waitForDomain(uint32_t thid) {
+    SimThreadData& st = simThreads[thid];
+    st.profBusy.end();
+    st.profIdle.start();
+    __sync_fetch_and_add(&idleThreads, 1);
+
+    DomainData* domain = nullptr;
+    while (domainsDone < numDomains) {
+        if (freeDomains) {
+            domain = claimDomain();
+            if (domain) break;
+        }
+        _mm_pause();
+    }
+
+    __sync_fetch_and_sub(&idleThreads, 1);
+    st.profIdle.end();
+    st.profBusy.start();
+    return domain;
+}
+
 void ContentionSim::finish() {
     assert(!terminate);
     terminate = true;
@@ -49,6 +49,9 @@ class CrossingEvent;
 
 #define PQ_BLOCKS 1024
 
+//Per-(domain, source) staging slots for bound-phase enqueues; 31 entries + count fill 8 cache lines
+#define STAGING_SLOTS 31
+
 class ContentionSim : public GlobAlloc {
     private:
         struct CompareEvents : public std::binary_function<TimingEvent*, TimingEvent*, bool> {
@@ -62,6 +65,23 @@ class ContentionSim : public GlobAlloc {
 
         CrossingEventInfo* lastCrossing; //indexed by [srcId*doms*doms + srcDom*doms + dstDom]
 
+        /* Bound-phase enqueues from a given source (core) are staged in a
+         * per-(domain, source) buffer that only that source's thread writes,
+         * so they need no locking. Each weave thread drains the buffers of its
+         * home domains into their PrioQueues at the start of the phase. If a
+         * buffer fills up, we fall back to the locked PrioQueue enqueue.
+         */
+        struct StagingBuffer {
+            uint64_t count;
+            struct {
+                TimingEvent* ev;
+                uint64_t cycle;
+            } slots[STAGING_SLOTS];
+        } ATTR_LINE_ALIGNED;
+
+        StagingBuffer* staging; //indexed by [domain*numSources + srcId]
+        uint32_t numSources;
+
         struct DomainData : public GlobAlloc {
             PrioQueue<TimingEvent, PQ_BLOCKS> pq;
 
@@ -74,9 +94,12 @@ class ContentionSim : public GlobAlloc {
             uint32_t prio;
             uint64_t queuePrio;
 
+            volatile uint32_t simState; //DomainSimState, only meaningful during the weave phase
+
             PAD();
 
             ClockStat profTime;
+            Counter profSteals;
 
 #if PROFILE_CROSSINGS
             VectorCounter profIncomingCrossingSims;
@@ -89,11 +112,23 @@ class ContentionSim : public GlobAlloc {
              bool operator()(DomainData* d1, DomainData* d2) const;
         };
 
+        /* Work stealing: at the start of each phase, every thread holds its
+         * home domains [firstDomain, supDomain). Threads that run out of
+         * domains become idle and ask for work; busy threads holding more than
+         * one domain donate the domain they just ran (DOM_FREE), and idle
+         * threads claim it. A domain is only ever simulated by the thread that
+         * holds it, so its PrioQueue needs no locking during the weave phase.
+         */
+        enum DomainSimState {DOM_HELD, DOM_FREE, DOM_DONE};
+
         struct SimThreadData {
             lock_t wakeLock; //used to sleep/wake up simulation thread
             uint32_t firstDomain;
             uint32_t supDomain; //supreme, ie first not included
 
+            ClockStat profBusy;
+            ClockStat profIdle;
+
             std::vector<std::pair<uint64_t, TimingEvent*> > logVec;
         };
 
@@ -106,6 +141,7 @@ class ContentionSim : public GlobAlloc {
         uint32_t numDomains;
         uint32_t numSimThreads;
         bool skipContention;
+        bool workStealing;
 
         PAD();
 
@@ -122,11 +158,18 @@ class ContentionSim : public GlobAlloc {
 
         PAD();
 
+        //RW, work stealing
+        volatile uint32_t domainsDone;
+        volatile uint32_t freeDomains; //domains donated but not yet claimed
+        volatile uint32_t idleThreads; //threads waiting to claim a domain
+
+        PAD();
+
         //lock_t testLock;
         lock_t postMortemLock;
 
     public:
-        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads);
+        ContentionSim(uint32_t _numDomains, uint32_t _numSimThreads, bool _workStealing, PQFarEngine farEngine);
 
         void initStats(AggregateStat* parentStat);
 
@@ -134,6 +177,7 @@ class ContentionSim : public GlobAlloc {
 
         void enqueue(TimingEvent* ev, uint64_t cycle);
         void enqueueSynced(TimingEvent* ev, uint64_t cycle);
+        void enqueueSynced(TimingEvent* ev, uint64_t cycle, uint32_t srcId); //wait-free if srcId is a core
         void enqueueCrossing(CrossingEvent* ev, uint64_t cycle, uint32_t srcId, uint32_t srcDomain, uint32_t dstDomain, EventRecorder* evRec);
 
         void simulatePhase(uint64_t limit);
@@ -162,6 +206,13 @@ class ContentionSim : public GlobAlloc {
     private:
         void simThreadLoop(uint32_t thid);
         void simulatePhaseThread(uint32_t thid);
+        void drainStaging(uint32_t domain);
+        void simulateSingleDomain(uint32_t thid, DomainData& domain);
+
+        void finishDomain(DomainData* domain);
+        void donateDomain(DomainData* domain);
+        DomainData* claimDomain();
+        DomainData* waitForDomain(uint32_t thid);
 
         static void SimThreadTrampoline(void* arg);
 };
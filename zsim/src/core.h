@@ -48,8 +48,9 @@ struct InstrFuncPtrs {  // NOLINT(whitespace)
     // Same as load/store functions, but last arg indicated whether op is executing
     void (*predLoadPtr)(THREADID, ADDRINT, ADDRINT, BOOL);
     void (*predStorePtr)(THREADID, ADDRINT, ADDRINT, BOOL);
+    // Memory read of an atomic (LOCK-prefixed) instruction; its write still goes through storePtr
+    void (*rmwPtr)(THREADID, ADDRINT, ADDRINT);
     uint64_t type;
-    uint64_t pad[1];
     //NOTE: By having the struct be a power of 2 bytes, indirect calls are simpler (w/ gcc 4.4 -O3, 6->5 instructions, and those instructions are simpler)
 };
 
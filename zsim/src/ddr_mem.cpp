@@ -25,11 +25,14 @@
 
 #include "ddr_mem.h"
 #include <algorithm>
+#include <math.h>
 #include <string>
+#include <string.h>
 #include <vector>
 #include "bithacks.h"
 #include "config.h"  // for Tokenize
 #include "contention_sim.h"
+#include "ddr_sched.h"
 #include "event_recorder.h"
 #include "timing_event.h"
 #include "zsim.h"
@@ -43,13 +46,17 @@ class DDRMemoryAccEvent : public TimingEvent {
         DDRMemory* mem;
         Address addr;
         bool write;
+        uint32_t srcId;
+        uint32_t burstCycles;
 
     public:
-        DDRMemoryAccEvent(DDRMemory* _mem, bool _isWrite, Address _addr, int32_t domain, uint32_t preDelay, uint32_t postDelay)
-            : TimingEvent(preDelay, postDelay, domain), mem(_mem), addr(_addr), write(_isWrite) {}
+        DDRMemoryAccEvent(DDRMemory* _mem, bool _isWrite, Address _addr, uint32_t _srcId, uint32_t _burstCycles, int32_t domain, uint32_t preDelay, uint32_t postDelay)
+            : TimingEvent(preDelay, postDelay, domain), mem(_mem), addr(_addr), write(_isWrite), srcId(_srcId), burstCycles(_burstCycles) {}
 
         Address getAddr() const {return addr;}
         bool isWrite() const {return write;}
+        uint32_t getSrcId() const {return srcId;}
+        uint32_t getBurstCycles() const {return burstCycles;}
 
         void simulate(uint64_t startCycle) {
             mem->enqueue(this, startCycle);
@@ -151,19 +158,51 @@ class SchedEvent : public TimingEvent, public GlobAlloc {
 /* Init & bound phase functionality */
 
 DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerChannel, uint32_t _banksPerRank,
-        uint32_t _sysFreqMHz, const char* tech, const char* addrMapping, uint32_t _controllerSysLatency,
-        uint32_t _queueDepth, uint32_t _rowHitLimit, bool _deferredWrites, bool _closedPage,
-        uint32_t _domain, g_string& _name)
+        uint32_t _sysFreqMHz, const char* tech, const char* addrMapping, AddrMapper::HashType addrHash,
+        uint32_t _controllerSysLatency,
+        uint32_t _queueDepth, uint32_t _rowHitLimit, bool _deferredWrites, bool _closedPage, uint32_t _powerDownIdle,
+        uint32_t _domain, g_string& _name, DDRSchedPolicy* _sched)
     : lineSize(_lineSize), ranksPerChannel(_ranksPerChannel), banksPerRank(_banksPerRank),
       controllerSysLatency(_controllerSysLatency), queueDepth(_queueDepth), rowHitLimit(_rowHitLimit),
-      deferredWrites(_deferredWrites), closedPage(_closedPage), domain(_domain), name(_name)
+      deferredWrites(_deferredWrites), closedPage(_closedPage), powerDownIdle(_powerDownIdle), domain(_domain), sched(_sched), name(_name)
 {
     sysFreqKHz = 1000 * _sysFreqMHz;
     initTech(tech);  // sets all tXX and memFreqKHz
-    if (memFreqKHz >= sysFreqKHz/2) {
-        panic("You may need to tweak the scheduling code, which works with system cycles." \
-            "With these frequencies, events (which run on system cycles) can't hit us every memory cycle.");
+
+    /* The scheduling code works with system cycles, so events can't hit us
+     * every memory cycle if memFreq >= sysFreq/2. Fast devices (e.g., DDR4-3200
+     * and up with a 2-3 GHz system) then run the controller at a fraction of
+     * the DRAM clock, like real gear-2/gear-4 controllers, rounding timings up.
+     */
+    uint32_t gear = 1;
+    while (memFreqKHz/gear >= sysFreqKHz/2) gear *= 2;
+    if (gear > 1) {
+        auto g = [gear](uint32_t& t) { t = (t + gear - 1)/gear; };
+        g(tBL); g(tCL); g(tRCD); g(tRTP); g(tRP); g(tRRD); g(tRAS); g(tFAW); g(tWTR); g(tWR); g(tRFC); g(tREFI);
+        g(tRRD_L); g(tCCD_S); g(tCCD_L); g(tXP);
+        memFreqKHz /= gear;
+        info("%s: %s clock too fast for %d MHz system, controller runs at 1/%d DRAM clock (%ld MHz)",
+                name.c_str(), tech, _sysFreqMHz, gear, memFreqKHz/1000);
     }
+    if (banksPerRank % bankGroups != 0) {
+        panic("%s: %d banks/rank can't be split in %d bank groups (%s)", name.c_str(), banksPerRank, bankGroups, tech);
+    }
+
+    // Energies, computed on the controller clock (so they include any rounding above)
+    // ACT/PRE and burst energies follow Micron's TN-41-01 power calculations
+    double tCKns = 1e6/memFreqKHz;
+    double rankVDD = VDD*devicesPerRank;  // mA*V*ns = pJ
+    uint32_t tRC = tRAS + tRP;
+    actEnergy = rankVDD*(IDD0*tRC - (IDD3N*tRAS + IDD2N*tRP))*tCKns;
+    rdEnergy = rankVDD*(IDD4R - IDD3N)*tCKns;
+    wrEnergy = rankVDD*(IDD4W - IDD3N)*tCKns;
+    refEnergy = rankVDD*(IDD5 - IDD3N)*tRFC*tCKns;
+    actStbyEnergy = rankVDD*IDD3N*tCKns;
+    preStbyEnergy = rankVDD*IDD2N*tCKns;
+    actPdEnergy = rankVDD*IDD3P*tCKns;
+    prePdEnergy = rankVDD*IDD2P*tCKns;
+    assert(actEnergy > 0.0 && rdEnergy > 0.0 && wrEnergy > 0.0 && refEnergy > 0.0);
+    if (powerDownIdle) info("%s: ranks power down after %d idle cycles, tXP %d", name.c_str(), powerDownIdle, tXP);
 
     minRdLatency = controllerSysLatency + memToSysCycle(tCL+tBL-1);
     minWrLatency = controllerSysLatency;
@@ -174,8 +213,8 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
     rdQueue.init(queueDepth);
     wrQueue.init(queueDepth);
 
-    info("%s: domain %d, %d ranks/ch %d banks/rank, tech %s, boundLat %d rd / %d wr",
-            name.c_str(), domain, ranksPerChannel, banksPerRank, tech, minRdLatency, minWrLatency);
+    info("%s: domain %d, %d ranks/ch %d banks/rank (%d groups), tech %s, boundLat %d rd / %d wr",
+            name.c_str(), domain, ranksPerChannel, banksPerRank, bankGroups, tech, minRdLatency, minWrLatency);
 
     minRespCycle = tCL + tBL + 1; // We subtract tCL + tBL from this on some checks; this avoids overflows
 
@@ -185,37 +224,30 @@ DDRMemory::DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerCh
     rankActWindows.resize(ranksPerChannel);
     for (uint32_t i = 0; i < ranksPerChannel; i++) rankActWindows[i].init(4);  // we only model FAW; for TAW (other technologies) change this to 2
 
+    rankLastActCycle.resize(ranksPerChannel, 0);
+    rankLastColCycle.resize(ranksPerChannel, 0);
+    groupLastActCycle.resize(ranksPerChannel*bankGroups, 0);
+    groupLastColCycle.resize(ranksPerChannel*bankGroups, 0);
+    rankLastCmdCycle.resize(ranksPerChannel, 0);
+    rankPendingReqs.resize(ranksPerChannel, 0);
+    rankBusyCycle.resize(ranksPerChannel, 0);
+
     // We get line addresses, and for a 64-byte line, there are _colSize/(JEDEC_BUS_WIDTH/8) lines/page
     uint32_t colBits = ilog2(_colSize/(JEDEC_BUS_WIDTH/8)*64/lineSize);
-    uint32_t bankBits = ilog2(banksPerRank);
-    uint32_t rankBits = ilog2(ranksPerChannel);
 
-    // Parse config string, has to be some combination of rank, bank, and col separated by semicolons
+    // addrMapping has to be some combination of rank, bank, and col separated by colons
     // (row is always MSB bits, since we don't actually know how many bits it is to begin with...)
-    std::vector<std::string> tokens;
-    Tokenize(addrMapping, tokens, ":");
-    if (tokens.size() != 3) panic("Invalid addrMapping %s, need all row/col/rank tokens separated by colons", addrMapping);
-    std::reverse(tokens.begin(), tokens.end()); // want lowest bits first
-
-    colMask = rankMask = bankMask = 0;
-    uint32_t startBit = 0;
-    auto computeShiftAndMask = [&startBit, addrMapping](const std::string& field, const uint32_t fieldBits, uint32_t& shift, uint32_t& mask) {
-        if (mask) panic("Repeated field %s in addrMapping %s", field.c_str(), addrMapping);
-        shift = startBit;
-        mask = (1 << fieldBits) - 1;
-        startBit += fieldBits;
-    };
-    for (auto t : tokens) {
-        if (t == "col")       computeShiftAndMask(t, colBits,  colShift,  colMask);
-        else if (t == "rank") computeShiftAndMask(t, rankBits, rankShift, rankMask);
-        else if (t == "bank") computeShiftAndMask(t, bankBits, bankShift, bankMask);
-        else panic("Invalid token %s in addrMapping %s (only row/col/rank)", t.c_str(), addrMapping);
-    }
-    rowShift = startBit;  // row has no mask
-
-    info("%s: Address mapping %s row %d:%ld col %d:%d rank %d:%d bank %d:%d",
-            name.c_str(), addrMapping, 63, rowShift, ilog2(colMask << colShift), colShift,
-            ilog2(rankMask << rankShift), rankShift, ilog2(bankMask << bankShift), bankShift);
+    // Only rank and bank bits are hashed, since permuting columns within a row buys nothing
+    addrMapper = new AddrMapper(name.c_str(), addrMapping, addrHash);
+    addrMapper->addField("col", 1 << colBits, false);
+    addrMapper->addField("rank", ranksPerChannel);
+    addrMapper->addField("bank", banksPerRank);
+    addrMapper->init();
+
+    statCores = std::max(1u, zinfo->numCores);
+    coreReads = gm_calloc<uint64_t>(statCores);
+    coreTotalLat = gm_calloc<uint64_t>(statCores);
+    coreLatHist = gm_calloc<uint32_t>(statCores*CORE_NUMBINS);
 
     // Weave phase events
     new RefreshEvent(this, memToSysCycle(tREFI), domain);
@@ -235,9 +267,86 @@ void DDRMemory::initStats(AggregateStat* parentStat) {
     profReadHits.init("rdhits", "Read row hits"); memStats->append(&profReadHits);
     profWriteHits.init("wrhits", "Write row hits"); memStats->append(&profWriteHits);
     latencyHist.init("mlh", "latency histogram for memory requests", NUMBINS); memStats->append(&latencyHist);
+    if (bankGroups > 1) {
+        profBGStalls.init("bgStalls", "RD/WR commands delayed by same-bank-group spacing (tCCD_L)"); memStats->append(&profBGStalls);
+    }
+
+    auto coreReadsStat = makeLambdaVectorStat([this](uint32_t c) { return coreReads[c]; }, statCores);
+    coreReadsStat->init("coreRd", "Read requests per core");
+    memStats->append(coreReadsStat);
+    auto coreAvgLatStat = makeLambdaVectorStat([this](uint32_t c) -> uint64_t {
+            return coreReads[c]? coreTotalLat[c]/coreReads[c] : 0;
+        }, statCores);
+    coreAvgLatStat->init("coreAvgLat", "Average read latency per core (sysCycles)");
+    memStats->append(coreAvgLatStat);
+    auto coreP99LatStat = makeLambdaVectorStat([this](uint32_t c) { return getCoreLatPercentile(c, 99); }, statCores);
+    coreP99LatStat->init("coreP99Lat", "99th percentile read latency per core (sysCycles, upper bound of its histogram bin)");
+    memStats->append(coreP99LatStat);
+
+    AggregateStat* energyStats = new AggregateStat();
+    energyStats->init("energy", "DRAM power states and energy (pJ)");
+    profActs.init("acts", "ACT (and PRE) commands"); energyStats->append(&profActs);
+    profRefs.init("refs", "Per-rank refreshes"); energyStats->append(&profRefs);
+    profRdBusCycles.init("rdBusCycles", "Data bus cycles used by reads"); energyStats->append(&profRdBusCycles);
+    profWrBusCycles.init("wrBusCycles", "Data bus cycles used by writes"); energyStats->append(&profWrBusCycles);
+    profActStbyCycles.init("actStbyCycles", "Rank-cycles in active standby"); energyStats->append(&profActStbyCycles);
+    profPreStbyCycles.init("preStbyCycles", "Rank-cycles in precharge standby"); energyStats->append(&profPreStbyCycles);
+    profActPdCycles.init("actPdCycles", "Rank-cycles in active power-down"); energyStats->append(&profActPdCycles);
+    profPrePdCycles.init("prePdCycles", "Rank-cycles in precharge power-down"); energyStats->append(&profPrePdCycles);
+    profPdExits.init("pdExits", "Requests that woke up a powered-down rank (and waited tXP)"); energyStats->append(&profPdExits);
+
+    auto actEnergyStat = makeLambdaStat([this]() { return (uint64_t)(profActs.get()*actEnergy); });
+    actEnergyStat->init("actEnergy", "ACT/PRE energy");
+    auto rdEnergyStat = makeLambdaStat([this]() { return (uint64_t)(profRdBusCycles.get()*rdEnergy); });
+    rdEnergyStat->init("rdEnergy", "Read burst energy");
+    auto wrEnergyStat = makeLambdaStat([this]() { return (uint64_t)(profWrBusCycles.get()*wrEnergy); });
+    wrEnergyStat->init("wrEnergy", "Write burst energy");
+    auto refEnergyStat = makeLambdaStat([this]() { return (uint64_t)(profRefs.get()*refEnergy); });
+    refEnergyStat->init("refEnergy", "Refresh energy");
+    auto bgEnergyStat = makeLambdaStat([this]() { return (uint64_t)getBackgroundEnergy(); });
+    bgEnergyStat->init("bgEnergy", "Background (standby and power-down) energy, up to the current phase");
+    auto totalEnergy = [this]() {
+        return profActs.get()*actEnergy + profRdBusCycles.get()*rdEnergy + profWrBusCycles.get()*wrEnergy +
+            profRefs.get()*refEnergy + getBackgroundEnergy();
+    };
+    auto totalEnergyStat = makeLambdaStat([totalEnergy]() { return (uint64_t)totalEnergy(); });
+    totalEnergyStat->init("totalEnergy", "Total DRAM energy");
+    auto energyPerBitStat = makeLambdaStat([this, totalEnergy]() -> uint64_t {
+            uint64_t bits = (profReads.get() + profWrites.get())*lineSize*8;
+            return bits? (uint64_t)(1e3*totalEnergy()/bits) : 0;
+        });
+    energyPerBitStat->init("fJPerBit", "Total energy per bit read or written, in fJ");
+    energyStats->append(actEnergyStat);
+    energyStats->append(rdEnergyStat);
+    energyStats->append(wrEnergyStat);
+    energyStats->append(refEnergyStat);
+    energyStats->append(bgEnergyStat);
+    energyStats->append(totalEnergyStat);
+    energyStats->append(energyPerBitStat);
+    memStats->append(energyStats);
+
+    if (sched) {
+        AggregateStat* schedStats = new AggregateStat();
+        schedStats->init("sched", "Scheduling policy stats");
+        sched->initStats(schedStats);
+        memStats->append(schedStats);
+    }
     parentStat->append(memStats);
 }
 
+uint64_t DDRMemory::getCoreLatPercentile(uint32_t core, uint32_t pct) const {
+    uint64_t reads = coreReads[core];
+    if (!reads) return 0;
+    uint64_t target = (reads*pct + 99)/100;  // ceil
+    uint64_t seen = 0;
+    const uint32_t* hist = &coreLatHist[core*CORE_NUMBINS];
+    for (uint32_t b = 0; b < CORE_NUMBINS; b++) {
+        seen += hist[b];
+        if (seen >= target) return (b+1)*CORE_BINSIZE;
+    }
+    panic("Histogram and read count mismatch");
+}
+
 /* Bound phase interface */
 
 uint64_t DDRMemory::access(MemReq& req) {
@@ -262,8 +371,11 @@ uint64_t DDRMemory::access(MemReq& req) {
         bool isWrite = (req.type == PUTX);
         uint64_t respCycle = req.cycle + (isWrite? minWrLatency : minRdLatency);
         if (zinfo->eventRecorders[req.srcId]) {
+            // Compressed lines take fewer bursts (rounded up to whole memory cycles)
+            uint32_t burstCycles = req.compBytes? std::max(1u, (tBL*req.compBytes + lineSize - 1)/lineSize) : tBL;
+            burstCycles = std::min(burstCycles, tBL);
             DDRMemoryAccEvent* memEv = new (zinfo->eventRecorders[req.srcId]) DDRMemoryAccEvent(this,
-                    isWrite, req.lineAddr, domain, preDelay, isWrite? postDelayWr : postDelayRd);
+                    isWrite, req.lineAddr, req.srcId, burstCycles, domain, preDelay, isWrite? postDelayWr : postDelayRd);
             memEv->setMinStartCycle(req.cycle);
             TimingRecord tr = {req.lineAddr, req.cycle, respCycle, req.type, memEv, memEv};
             zinfo->eventRecorders[req.srcId]->pushRecord(tr);
@@ -281,10 +393,11 @@ uint64_t DDRMemory::access(MemReq& req) {
 // Change or reorder to define your own mappings
 DDRMemory::AddrLoc DDRMemory::mapLineAddr(Address lineAddr) {
     AddrLoc l;
-    l.col  = (lineAddr >> colShift)  & colMask;
-    l.rank = (lineAddr >> rankShift) & rankMask;
-    l.bank = (lineAddr >> bankShift) & bankMask;
-    l.row  = lineAddr >> rowShift;
+    uint32_t vals[NUM_FIELDS];
+    l.row  = addrMapper->map(lineAddr, vals);
+    l.col  = vals[COL_FIELD];
+    l.rank = vals[RANK_FIELD];
+    l.bank = vals[BANK_FIELD];
 
     //info("0x%lx r%ld:c%d b%d:r%d", lineAddr, l.row, l.col, l.bank, l.rank);
     assert(l.rank < ranksPerChannel);
@@ -306,6 +419,9 @@ void DDRMemory::enqueue(DDRMemoryAccEvent* ev, uint64_t sysCycle) {
     req->addr = ev->getAddr();
     req->loc = mapLineAddr(ev->getAddr());
     req->write = ev->isWrite();
+    req->srcId = ev->getSrcId();
+    req->burstCycles = ev->getBurstCycles();
+    req->marked = false;
 
     req->arrivalCycle = memCycle;
     req->startSysCycle = sysCycle;
@@ -319,7 +435,8 @@ void DDRMemory::enqueue(DDRMemoryAccEvent* ev, uint64_t sysCycle) {
         queue(req, memCycle);
 
         // If needed, schedule an event to handle this new request
-        if (!req->prev /* first in bank */) {
+        // (with a scheduling policy, any request may be the next one to issue)
+        if (!req->prev /* first in bank */ || sched) {
             uint64_t minSchedCycle = std::max(memCycle, minRespCycle - tCL - tBL);
             if (nextSchedCycle > minSchedCycle) minSchedCycle = std::max(minSchedCycle, findMinCmdCycle(*req));
             if (nextSchedCycle > minSchedCycle) {
@@ -354,6 +471,7 @@ void DDRMemory::queue(Request* req, uint64_t memCycle) {
     }
 
     req->arrivalCycle = memCycle;  // if this comes from the overflow queue, update
+    if (rankPendingReqs[req->loc.rank]++ == 0) rankBusyCycle[req->loc.rank] = memCycle;
 
     // Test: Skip writes
 #if 0
@@ -439,7 +557,7 @@ uint64_t DDRMemory::tick(uint64_t sysCycle) {
         queue(req, memCycle);
 
         // This request may be schedulable before trySchedule's minSchedCycle
-        if (!req->prev /*first in bank queue*/) {
+        if (!req->prev /*first in bank queue*/ || sched) {
             uint64_t minQueuedSchedCycle = std::max(memCycle, minRespCycle - tCL - tBL);
             if (minSchedCycle > minQueuedSchedCycle) minSchedCycle = std::max(minQueuedSchedCycle, findMinCmdCycle(*req));
             if (minSchedCycle > minQueuedSchedCycle) {
@@ -467,11 +585,71 @@ void DDRMemory::recycleEvent(SchedEvent* ev) {
     eventFreelist = ev;
 }
 
+inline uint64_t DDRMemory::minBGActCycle(const AddrLoc& loc) const {
+    if (bankGroups == 1) return 0;
+    return std::max(rankLastActCycle[loc.rank] + tRRD, groupLastActCycle[bankGroupIdx(loc)] + tRRD_L);
+}
+
+inline uint64_t DDRMemory::minBGColCycle(const AddrLoc& loc) const {
+    if (bankGroups == 1) return 0;
+    return std::max(rankLastColCycle[loc.rank] + tCCD_S, groupLastColCycle[bankGroupIdx(loc)] + tCCD_L);
+}
+
+inline uint64_t DDRMemory::minWakeCycle(const Request& r) const {
+    if (!powerDownIdle) return 0;
+    uint64_t pdEntryCycle = rankLastCmdCycle[r.loc.rank] + powerDownIdle;
+    // Ranks with pending requests don't power down, so the rank wakes up when the oldest one arrived
+    assert(rankPendingReqs[r.loc.rank]);
+    uint64_t busyCycle = rankBusyCycle[r.loc.rank];
+    return (busyCycle > pdEntryCycle)? busyCycle + tXP : 0;
+}
+
+bool DDRMemory::rankHasOpenBanks(uint32_t rank) const {
+    for (const Bank& bank : banks[rank]) if (bank.open) return true;
+    return false;
+}
+
+void DDRMemory::accountRankIdle(uint32_t rank, uint64_t cmdCycle, uint64_t arrivalCycle) {
+    uint64_t& lastCmdCycle = rankLastCmdCycle[rank];
+    if (cmdCycle <= lastCmdCycle) return;  // commands may be recorded slightly out of order
+    uint64_t cycles = cmdCycle - lastCmdCycle;
+    uint64_t pdCycles = 0;
+    if (rankPendingReqs[rank]) arrivalCycle = std::min(arrivalCycle, rankBusyCycle[rank]);
+    if (powerDownIdle && arrivalCycle > lastCmdCycle + powerDownIdle) {
+        pdCycles = std::min(cycles, arrivalCycle - lastCmdCycle - powerDownIdle);
+    }
+    if (rankHasOpenBanks(rank)) {
+        profActStbyCycles.inc(cycles - pdCycles);
+        profActPdCycles.inc(pdCycles);
+    } else {
+        profPreStbyCycles.inc(cycles - pdCycles);
+        profPrePdCycles.inc(pdCycles);
+    }
+    lastCmdCycle = cmdCycle;
+}
+
+double DDRMemory::getBackgroundEnergy() {
+    double energy = profActStbyCycles.get()*actStbyEnergy + profPreStbyCycles.get()*preStbyEnergy +
+        profActPdCycles.get()*actPdEnergy + profPrePdCycles.get()*prePdEnergy;
+
+    // Add idle time since each rank's last command (without counting it, so this is just an estimate)
+    uint64_t curCycle = sysToMemCycle(zinfo->globPhaseCycles);
+    for (uint32_t rank = 0; rank < ranksPerChannel; rank++) {
+        if (curCycle <= rankLastCmdCycle[rank]) continue;
+        uint64_t cycles = curCycle - rankLastCmdCycle[rank];
+        uint64_t pdCycles = (powerDownIdle && !rankPendingReqs[rank] && cycles > powerDownIdle)? cycles - powerDownIdle : 0;
+        bool open = rankHasOpenBanks(rank);
+        energy += (cycles - pdCycles)*(open? actStbyEnergy : preStbyEnergy) + pdCycles*(open? actPdEnergy : prePdEnergy);
+    }
+    return energy;
+}
+
 uint64_t DDRMemory::findMinCmdCycle(const Request& r) const {
     const Bank& bank = banks[r.loc.rank][r.loc.bank];
     uint64_t minCmdCycle = std::max(r.arrivalCycle, bank.lastCmdCycle + 1);
     if (r.loc.row == bank.openRow && bank.open) {
         // Row buffer hit
+        minCmdCycle = std::max(minCmdCycle, minWakeCycle(r));
     } else {
         // Either row closed, or row buffer miss
         uint64_t preCycle;
@@ -483,9 +661,11 @@ uint64_t DDRMemory::findMinCmdCycle(const Request& r) const {
         }
         uint64_t actCycle = std::max(r.arrivalCycle, std::max(preCycle + tRP, bank.lastActCycle + tRRD));
         actCycle = std::max(actCycle, rankActWindows[r.loc.rank].minActCycle() + tFAW);
+        actCycle = std::max(actCycle, minBGActCycle(r.loc));
+        actCycle = std::max(actCycle, minWakeCycle(r));
         minCmdCycle = actCycle + tRCD;
     }
-    return minCmdCycle;
+    return std::max(minCmdCycle, minBGColCycle(r.loc));
 }
 
 uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
@@ -516,7 +696,24 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
     Request* r = nullptr;
     RequestQueue<Request>::iterator ir = queue.begin();
     uint64_t minSchedCycle = -1ul;
-    while (ir != queue.end()) {
+    if (sched) {
+        // The policy picks among all ready requests, not just the heads of bank queues
+        sched->beginSchedule(queue, curCycle);
+        uint64_t bestPrio = -1ul;
+        for (RequestQueue<Request>::iterator it = queue.begin(); it != queue.end(); it.inc()) {
+            uint64_t minCmdCycle = findMinCmdCycle(**it);
+            minSchedCycle = std::min(minSchedCycle, minCmdCycle);
+            if (minCmdCycle > curCycle) continue;
+            const Bank& b = banks[(*it)->loc.rank][(*it)->loc.bank];
+            uint64_t prio = sched->priority(*it, b.open && (*it)->loc.row == b.openRow, curCycle);
+            if (prio < bestPrio) {  // strict, so ties go to the oldest request
+                bestPrio = prio;
+                r = *it;
+                ir = it;
+            }
+        }
+    }
+    while (!sched && ir != queue.end()) {
         //Bank& bank = banks[(*ir)->loc.rank][(*ir)->loc.bank];
         //if ((isWriteQueue? bank.wrReqs : bank.rdReqs).front() == *ir) {
         if (!(*ir)->prev) {  // FASTAH!
@@ -551,9 +748,12 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
     uint64_t minCmdCycle = std::max(curCycle, minRespCycle - tCL);
     if (lastCmdWasWrite && !r->write) minCmdCycle = std::max(minCmdCycle, minRespCycle + tWTR);
     bool rowHit = false;
+    uint64_t wakeCycle = minWakeCycle(*r);
+    if (wakeCycle) profPdExits.inc();
     if (r->loc.row == bank.openRow && bank.open) {
         // Row buffer hit
         rowHit = true;
+        minCmdCycle = std::max(minCmdCycle, wakeCycle);
     } else {
         // Either row closed, or row buffer miss
         uint64_t preCycle;
@@ -567,21 +767,45 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
 
         uint64_t actCycle = std::max(r->arrivalCycle, std::max(preCycle + tRP, bank.lastActCycle + tRRD));
         actCycle = std::max(actCycle, rankActWindows[r->loc.rank].minActCycle() + tFAW);
+        actCycle = std::max(actCycle, minBGActCycle(r->loc));
+        actCycle = std::max(actCycle, wakeCycle);
+        accountRankIdle(r->loc.rank, actCycle, r->arrivalCycle);  // before the ACT opens the bank
 
         // Record ACT
+        profActs.inc();
         bank.open = true;
         bank.openRow = r->loc.row;
         if (preIssued) bank.minPreCycle = preCycle + tRAS;
         rankActWindows[r->loc.rank].addActivation(actCycle);
         bank.lastActCycle = actCycle;
+        if (bankGroups > 1) {
+            // ACTs may be recorded slightly out of order (see ActWindow)
+            rankLastActCycle[r->loc.rank] = std::max(rankLastActCycle[r->loc.rank], actCycle);
+            uint64_t& groupAct = groupLastActCycle[bankGroupIdx(r->loc)];
+            groupAct = std::max(groupAct, actCycle);
+        }
 
         minCmdCycle = std::max(minCmdCycle, actCycle + tRCD);
     }
 
     // Figure out data bus constraints, find actual time at which command is issued
     uint64_t cmdCycle = std::max(minCmdCycle, minRespCycle - tCL);
-    minRespCycle = cmdCycle + tCL + tBL;
+    if (bankGroups > 1) {
+        uint64_t bgColCycle = minBGColCycle(r->loc);
+        if (bgColCycle > cmdCycle) {
+            if (groupLastColCycle[bankGroupIdx(r->loc)] + tCCD_L == bgColCycle) profBGStalls.inc();
+            cmdCycle = bgColCycle;
+        }
+        rankLastColCycle[r->loc.rank] = cmdCycle;
+        groupLastColCycle[bankGroupIdx(r->loc)] = cmdCycle;
+    }
+    // Compressed lines free the data bus early, but reads still respond after a full-line time, which
+    // stands in for decompression (otherwise, reads could beat the bound-phase latency)
+    minRespCycle = cmdCycle + tCL + r->burstCycles;
+    uint64_t dataCycle = cmdCycle + tCL + tBL;
     lastCmdWasWrite = r->write;
+    accountRankIdle(r->loc.rank, cmdCycle, r->arrivalCycle);
+    (r->write? profWrBusCycles : profRdBusCycles).inc(r->burstCycles);
 
     // Record PRE
     // if closed-page, close (auto-precharge) if no more row buffer hits
@@ -597,13 +821,14 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
     assert(bank.lastCmdCycle < cmdCycle);
     bank.lastCmdCycle = cmdCycle;
     bank.curRowHits = r->rowHitSeq;
+    if (sched) sched->served(r, rowHit, getServiceCycles(rowHit), curCycle);
 
     // Issue response
     if (r->ev) {
         auto ev = r->ev;
         assert(!ev->isWrite() && !r->write);  // reads only
 
-        uint64_t doneSysCycle = memToSysCycle(minRespCycle) + controllerSysLatency;
+        uint64_t doneSysCycle = memToSysCycle(dataCycle) + controllerSysLatency;
         assert(doneSysCycle >= sysCycle);
 
         ev->release();
@@ -615,6 +840,11 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
         if (rowHit) profReadHits.inc();
         uint32_t bucket = std::min(NUMBINS-1, scDelay/BINSIZE);
         latencyHist.inc(bucket, 1);
+
+        uint32_t core = std::min(r->srcId, statCores-1);  // srcIds are core ids
+        coreReads[core]++;
+        coreTotalLat[core] += scDelay;
+        coreLatHist[core*CORE_NUMBINS + std::min(CORE_NUMBINS-1, scDelay/CORE_BINSIZE)]++;
     } else {
         uint32_t scDelay = memToSysCycle(minRespCycle) + controllerSysLatency - r->startSysCycle;
         profWrites.inc();
@@ -625,8 +855,10 @@ uint64_t DDRMemory::trySchedule(uint64_t curCycle, uint64_t sysCycle) {
     DEBUG("Served 0x%lx lat %ld clocks", r->addr, minRespCycle-curCycle);
 
     // Dequeue this req
+    assert(rankPendingReqs[r->loc.rank]);
+    rankPendingReqs[r->loc.rank]--;
+    (isWriteQueue? bank.wrReqs : bank.rdReqs).remove(r);  // the bank queue head, unless a policy picked it
     queue.remove(ir);
-    (isWriteQueue? bank.wrReqs : bank.rdReqs).pop_front();
 
     return (rdQueue.empty() && wrQueue.empty())? -1ul : minRespCycle - tCL;
 }
@@ -643,13 +875,17 @@ void DDRMemory::refresh(uint64_t sysCycle) {
 
     uint64_t refreshDoneCycle = minRefreshCycle + tRFC;
     assert(tRFC >= tRP);
-    for (auto& rankBanks : banks) {
-        for (auto& bank : rankBanks) {
+    for (uint32_t rank = 0; rank < ranksPerChannel; rank++) {
+        // Refreshes wake up powered-down ranks too, but we don't model their tXP
+        accountRankIdle(rank, minRefreshCycle, memCycle);
+        for (auto& bank : banks[rank]) {
             // Close and force the ACT to happen at least at tRFC
             // PRE <-tRP-> ACT, so discount tRP
             bank.minPreCycle = refreshDoneCycle - tRP;
             bank.open = false;
         }
+        accountRankIdle(rank, refreshDoneCycle, memCycle);  // tRFC, with all banks precharged
+        profRefs.inc();
     }
 
     DEBUG("Refresh %ld start %ld done %ld", memCycle, minRefreshCycle, refreshDoneCycle);
@@ -663,9 +899,88 @@ void DDRMemory::initTech(const char* techName) {
     double tCK;
 
     // tBL's below are for 64-byte lines; we adjust as needed
+    // Technologies without bank groups leave bankGroups = 1, and need not set tRRD_L and tCCD_S/L
+    bankGroups = 1;
+    tRRD_L = tCCD_S = tCCD_L = 0;
 
     // Please keep this orderly; go from faster to slower technologies
-    if (tech == "DDR3-1333-CL10") {
+    if (tech == "LPDDR5-6400") {
+        // JEDEC JESD209-5, bank-group mode (BL16), 16-bit channel, 16Gb die; 4:1 WCK:CK, so 64B take 2 bursts
+        tCK = 1.25;
+        tBL = 4;
+        tCL = 17;
+        tRCD = 15;
+        tRTP = 6;
+        tRP = 15;
+        tRRD = 4;
+        tRAS = 34;
+        tFAW = 16;
+        tWTR = 10;
+        tWR = 28;
+        tRFC = 224;
+        tREFI = 3120;
+        bankGroups = 4;
+        tRRD_L = 4;
+        tCCD_S = 4;
+        tCCD_L = 8;
+    } else if (tech == "DDR5-4800-CL40") {
+        // JEDEC JESD79-5, 40-39-39, x8 16Gb devices; channel is one 32-bit subchannel (BL16 carries 64B)
+        tCK = 0.416;
+        tBL = 8;
+        tCL = 40;
+        tRCD = 39;
+        tRTP = 18;
+        tRP = 39;
+        tRRD = 8;
+        tRAS = 77;
+        tFAW = 32;
+        tWTR = 24;
+        tWR = 72;
+        tRFC = 710;
+        tREFI = 9360;
+        bankGroups = 8;
+        tRRD_L = 12;
+        tCCD_S = 8;
+        tCCD_L = 12;
+    } else if (tech == "DDR4-3200-CL22") {
+        // JEDEC JESD79-4, 22-22-22, x8 8Gb devices (1KB page)
+        tCK = 0.625;
+        tBL = 4;
+        tCL = 22;
+        tRCD = 22;
+        tRTP = 12;
+        tRP = 22;
+        tRRD = 4;
+        tRAS = 52;
+        tFAW = 34;
+        tWTR = 12;
+        tWR = 24;
+        tRFC = 560;
+        tREFI = 12480;
+        bankGroups = 4;
+        tRRD_L = 8;
+        tCCD_S = 4;
+        tCCD_L = 8;
+    } else if (tech == "HBM2-2000") {
+        // JEDEC JESD235, one 64-bit pseudo-channel, BL4 (64B take 2 bursts), 8Gb dies
+        tCK = 1.0;
+        tBL = 4;
+        tCL = 14;
+        tRCD = 14;
+        tRTP = 4;
+        tRP = 14;
+        tRRD = 4;
+        tRAS = 33;
+        tFAW = 16;
+        tWTR = 8;
+        tWR = 16;
+        tRFC = 350;
+        tREFI = 3900;
+        bankGroups = 4;
+        tRRD_L = 6;
+        tCCD_S = 4;
+        tCCD_L = 8;
+    } else if (tech == "DDR3-1333-CL10") {
         // from DRAMSim2/ini/DDR3_micron_16M_8B_x4_sg15.ini (Micron)
         tCK = 1.5;  // ns; all other in mem cycles
         tBL = 4;
@@ -719,7 +1034,44 @@ void DDRMemory::initTech(const char* techName) {
     assert(tCK > 0.0);
     assert(tBL && tCL && tRCD && tRTP && tRP && tRRD && tRAS && tFAW && tWTR && tWR && tRFC && tREFI);
 
+    // Device currents (IDD2P is fast-exit precharge power-down) and power-down exit time, per generation.
+    // These are representative datasheet values (Micron parts unless noted), not per speed bin.
+    auto is = [&tech](const char* prefix) { return tech.compare(0, strlen(prefix), prefix) == 0; };
+    double tXPns;
+    if (is("LPDDR5")) {
+        // One x16 channel, VDD2H rail only
+        VDD = 1.05; IDD0 = 30; IDD2N = 10; IDD2P = 2; IDD3N = 15; IDD3P = 4; IDD4R = 200; IDD4W = 180; IDD5 = 50;
+        devicesPerRank = 1;
+        tXPns = 7.0;
+    } else if (is("DDR5")) {
+        // x8 16Gb devices, 4 per 32-bit subchannel
+        VDD = 1.1; IDD0 = 75; IDD2N = 55; IDD2P = 40; IDD3N = 70; IDD3P = 50; IDD4R = 230; IDD4W = 210; IDD5 = 300;
+        devicesPerRank = 4;
+        tXPns = 7.5;
+    } else if (is("DDR4")) {
+        // x8 8Gb devices
+        VDD = 1.2; IDD0 = 58; IDD2N = 39; IDD2P = 25; IDD3N = 54; IDD3P = 40; IDD4R = 165; IDD4W = 148; IDD5 = 250;
+        devicesPerRank = JEDEC_BUS_WIDTH/8;
+        tXPns = 6.0;
+    } else if (is("HBM2")) {
+        // Per pseudo-channel, roughly a 1/16th of an 8-high stack's currents
+        VDD = 1.2; IDD0 = 40; IDD2N = 20; IDD2P = 6; IDD3N = 25; IDD3P = 10; IDD4R = 110; IDD4W = 120; IDD5 = 120;
+        devicesPerRank = 1;
+        tXPns = 7.5;
+    } else {
+        // DDR3, x4 2Gb devices (see pageSize default)
+        VDD = 1.5; IDD0 = 65; IDD2N = 32; IDD2P = 12; IDD3N = 38; IDD3P = 27; IDD4R = 150; IDD4W = 155; IDD5 = 190;
+        devicesPerRank = JEDEC_BUS_WIDTH/4;
+        tXPns = 6.0;
+    }
+    tXP = std::max(3u, (uint32_t)ceil(tXPns/tCK));
+
+    if (!tRRD_L) tRRD_L = tRRD;
     if (isPow2(lineSize) && lineSize >= 64) {
+        // Longer lines keep the data bus busy for more bursts after each column command
+        uint32_t extraBL = lineSize*tBL/64 - tBL;
+        tCCD_S += extraBL;
+        tCCD_L += extraBL;
         tBL = lineSize*tBL/64;
     } else if (lineSize == 32) {
         tBL = tBL/2;
@@ -729,6 +1081,30 @@ void DDRMemory::initTech(const char* techName) {
         panic("Unsupported line size %d", lineSize);
     }
 
+    if (!tCCD_S) tCCD_S = tBL;
+    if (!tCCD_L) tCCD_L = tBL;
+
     memFreqKHz = (uint64_t)(1e9/tCK/1e3);
 }
 
+void DDRMemory::getTechGeometry(const char* techName, uint32_t& ranksPerChannel, uint32_t& banksPerRank) {
+    std::string tech(techName);
+    auto is = [&tech](const char* prefix) { return tech.compare(0, strlen(prefix), prefix) == 0; };
+    if (is("LPDDR5")) {
+        ranksPerChannel = 1;
+        banksPerRank = 16;
+    } else if (is("DDR5")) {
+        ranksPerChannel = 2;
+        banksPerRank = 32;
+    } else if (is("DDR4")) {
+        ranksPerChannel = 2;
+        banksPerRank = 16;
+    } else if (is("HBM2")) {
+        ranksPerChannel = 1;
+        banksPerRank = 16;
+    } else {
+        ranksPerChannel = 4;
+        banksPerRank = 8;  // DDR3 std is 8
+    }
+}
+
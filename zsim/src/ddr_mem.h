@@ -28,6 +28,7 @@
 
 #include <deque>
 
+#include "addr_map.h"
 #include "g_std/g_string.h"
 #include "intrusive_list.h"
 #include "memory_hierarchy.h"
@@ -130,12 +131,13 @@ class RequestQueue {
 };
 
 class DDRMemoryAccEvent;
+class DDRSchedPolicy;
 class SchedEvent;
 
 // Single-channel controller. For multiple channels, use multiple controllers.
 class DDRMemory : public MemObject {
-    private:
-
+    public:
+        // Public so that scheduling policies (ddr_sched.h) can inspect requests
         struct AddrLoc {
             uint64_t row;
             uint32_t bank;
@@ -149,6 +151,9 @@ class DDRMemory : public MemObject {
             bool write;
 
             uint64_t rowHitSeq; // sequence number used to throttle max # row hits
+            uint32_t srcId;  // requesting core
+            bool marked;  // in the current batch (PAR-BS)
+            uint32_t burstCycles;  // data bus occupancy; < tBL for compressed lines
 
             // Cycle accounting
             uint64_t arrivalCycle;  // in memCycles
@@ -159,6 +164,7 @@ class DDRMemory : public MemObject {
             DDRMemoryAccEvent* ev;
         };
 
+    private:
         struct Bank {
             uint64_t openRow;
             bool open;  // false indicates a PRE has been issued
@@ -192,8 +198,12 @@ class DDRMemory : public MemObject {
         const uint32_t rowHitLimit; // row hits not prioritized in FR-FCFS beyond this point
         const bool deferredWrites;
         const bool closedPage;
+        const uint32_t powerDownIdle;  // idle memCycles before a rank enters power-down; 0 -> never
         const uint32_t domain;
 
+        // Scheduling policy; if nullptr, FR-FCFS with rowHitLimit, decided at arrival time in per-bank queues
+        DDRSchedPolicy* const sched;
+
         // DRAM timing parameters -- initialized in initTech()
         // All parameters are in memory clocks (multiples of tCK)
         uint32_t tBL;    // burst length (== tTrans)
@@ -201,7 +211,7 @@ class DDRMemory : public MemObject {
         uint32_t tRCD;   // ACT to CAS
         uint32_t tRTP;   // RD to PRE
         uint32_t tRP;    // PRE to ACT
-        uint32_t tRRD;   // ACT to ACT
+        uint32_t tRRD;   // ACT to ACT (to a different bank group, i.e., tRRD_S, if there are bank groups)
         uint32_t tRAS;   // ACT to PRE
         uint32_t tFAW;   // No more than 4 ACTs per rank in this window
         uint32_t tWTR;   // end of WR burst to RD command
@@ -209,11 +219,27 @@ class DDRMemory : public MemObject {
         uint32_t tRFC;   // Refresh to ACT (refresh leaves rows closed)
         uint32_t tREFI;  // Refresh interval
 
-        // Address mapping information
-        uint32_t colShift, colMask;
-        uint32_t rankShift, rankMask;
-        uint32_t bankShift, bankMask;
-        uint64_t rowShift;  // row's always top
+        // Bank groups (DDR4 onwards): consecutive ACTs or column commands to the same group are spaced further apart
+        uint32_t bankGroups;  // per rank; 1 -> no bank-group constraints
+        uint32_t tRRD_L; // ACT to ACT, same bank group
+        uint32_t tCCD_S; // RD/WR to RD/WR, different bank group
+        uint32_t tCCD_L; // RD/WR to RD/WR, same bank group
+        uint32_t tXP;    // power-down exit to any command
+
+        // Device power parameters -- also initialized in initTech()
+        // Currents are in mA per device (datasheet IDDs), and a rank has devicesPerRank devices
+        double VDD;
+        double IDD0, IDD2N, IDD2P, IDD3N, IDD3P, IDD4R, IDD4W, IDD5;
+        uint32_t devicesPerRank;
+
+        // Per-rank energy, in pJ, per ACT/PRE pair, RD/WR data-bus cycle, and refresh;
+        // and background energy per memCycle in each power state
+        double actEnergy, rdEnergy, wrEnergy, refEnergy;
+        double actStbyEnergy, preStbyEnergy, actPdEnergy, prePdEnergy;
+
+        // Address mapping (row's always top); fields are defined in this order
+        enum {COL_FIELD, RANK_FIELD, BANK_FIELD, NUM_FIELDS};
+        AddrMapper* addrMapper;
 
         uint32_t minRdLatency;
         uint32_t minWrLatency;
@@ -225,6 +251,22 @@ class DDRMemory : public MemObject {
         g_vector< g_vector<Bank> > banks; // indexed by rank, bank
         g_vector<ActWindow> rankActWindows;
 
+        // Bank-group timing state, only used if bankGroups > 1
+        g_vector<uint64_t> rankLastActCycle, rankLastColCycle;  // indexed by rank
+        g_vector<uint64_t> groupLastActCycle, groupLastColCycle;  // indexed by rank*bankGroups + group
+        Counter profBGStalls;
+
+        // Power state and energy accounting. Ranks spend the time between commands in standby, and if idle
+        // for more than powerDownIdle cycles, in power-down until a request arrives, which then waits tXP.
+        // Ranks with queued requests (e.g., deferred writes) stay awake from the first one's arrival
+        g_vector<uint64_t> rankLastCmdCycle;  // indexed by rank
+        g_vector<uint32_t> rankPendingReqs;  // indexed by rank
+        g_vector<uint64_t> rankBusyCycle;  // arrival of the oldest pending request, indexed by rank
+        Counter profActs, profRefs;  // refreshes are per rank
+        Counter profRdBusCycles, profWrBusCycles;
+        Counter profActStbyCycles, profPreStbyCycles, profActPdCycles, profPrePdCycles;  // rank-cycles
+        Counter profPdExits;
+
         // Event scheduling
         SchedEvent* nextSchedEvent;
         uint64_t nextSchedCycle;
@@ -239,6 +281,12 @@ class DDRMemory : public MemObject {
         Counter profReadHits, profWriteHits;  // row buffer hits
         VectorCounter latencyHist;
         static const uint32_t BINSIZE = 10, NUMBINS = 100;
+        // Per-core read latencies, for average and tail (p99) latency stats
+        uint32_t statCores;  // srcIds beyond this (e.g., in trace-driven sims) are folded into the last one
+        uint64_t* coreReads;
+        uint64_t* coreTotalLat;
+        uint32_t* coreLatHist;  // numCores x CORE_NUMBINS
+        static const uint32_t CORE_BINSIZE = 16, CORE_NUMBINS = 256;
         PAD();
 
         //In KHz, though it does not matter so long as they are consistent and fine-grain enough (not Hz because we multiply
@@ -259,9 +307,10 @@ class DDRMemory : public MemObject {
 
     public:
         DDRMemory(uint32_t _lineSize, uint32_t _colSize, uint32_t _ranksPerChannel, uint32_t _banksPerRank,
-            uint32_t _sysFreqMHz, const char* tech, const char* addrMapping, uint32_t _controllerSysLatency,
-            uint32_t _queueDepth, uint32_t _rowHitLimit, bool _deferredWrites, bool _closedPage,
-            uint32_t _domain, g_string& _name);
+            uint32_t _sysFreqMHz, const char* tech, const char* addrMapping, AddrMapper::HashType addrHash,
+            uint32_t _controllerSysLatency,
+            uint32_t _queueDepth, uint32_t _rowHitLimit, bool _deferredWrites, bool _closedPage, uint32_t _powerDownIdle,
+            uint32_t _domain, g_string& _name, DDRSchedPolicy* _sched = nullptr);
 
         void initStats(AggregateStat* parentStat);
         const char* getName() {return name.c_str();}
@@ -277,6 +326,12 @@ class DDRMemory : public MemObject {
         uint64_t tick(uint64_t sysCycle);
         void recycleEvent(SchedEvent* ev);
 
+        // Default geometry for a technology (e.g., DDR4 has 16 banks/rank in 4 groups)
+        static void getTechGeometry(const char* tech, uint32_t& ranksPerChannel, uint32_t& banksPerRank);
+
+        // Bank occupancy of an access, for scheduling policies that track service
+        uint32_t getServiceCycles(bool rowHit) const { return rowHit? tBL : tRP + tRCD + tBL; }
+
     private:
         AddrLoc mapLineAddr(Address lineAddr);
 
@@ -285,6 +340,20 @@ class DDRMemory : public MemObject {
         inline uint64_t trySchedule(uint64_t curCycle, uint64_t sysCycle);
         uint64_t findMinCmdCycle(const Request& r) const;
 
+        // Bank-group constraints on the earliest ACT and RD/WR to a bank (0 if there are no bank groups)
+        inline uint32_t bankGroupIdx(const AddrLoc& loc) const { return loc.rank*bankGroups + loc.bank % bankGroups; }
+        inline uint64_t minBGActCycle(const AddrLoc& loc) const;
+        inline uint64_t minBGColCycle(const AddrLoc& loc) const;
+        uint64_t getCoreLatPercentile(uint32_t core, uint32_t pct) const;
+
+        // Earliest first command (ACT or RD/WR) to a rank that may have powered down (0 if it did not)
+        inline uint64_t minWakeCycle(const Request& r) const;
+        // Accounts background cycles for rank from its last command up to cmdCycle, and makes cmdCycle the last.
+        // The rank may be powered down until arrivalCycle or its oldest pending request, whichever is earlier
+        void accountRankIdle(uint32_t rank, uint64_t cmdCycle, uint64_t arrivalCycle);
+        bool rankHasOpenBanks(uint32_t rank) const;
+        double getBackgroundEnergy();
+
         void initTech(const char* tech);
 };
 
@@ -0,0 +1,178 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ddr_sched.h"
+#include <algorithm>
+#include <vector>
+
+/* BLISS */
+
+BLISSSchedPolicy::BLISSSchedPolicy(uint32_t numCores, uint32_t _threshold, uint32_t _clearInterval)
+    : DDRSchedPolicy(numCores), threshold(_threshold), clearInterval(_clearInterval), lastSrc(-1u), streak(0), nextClearCycle(_clearInterval)
+{
+    blacklisted.resize(this->numCores, false);
+}
+
+void BLISSSchedPolicy::beginSchedule(RequestQueue<Request>& queue, uint64_t memCycle) {
+    if (memCycle >= nextClearCycle) {
+        for (uint32_t c = 0; c < blacklisted.size(); c++) blacklisted[c] = false;
+        nextClearCycle = memCycle + clearInterval;
+    }
+}
+
+uint64_t BLISSSchedPolicy::priority(const Request* r, bool rowHit, uint64_t memCycle) {
+    return (blacklisted[coreIdx(r)]? 2 : 0) | (rowHit? 0 : 1);
+}
+
+void BLISSSchedPolicy::served(const Request* r, bool rowHit, uint32_t serviceCycles, uint64_t memCycle) {
+    uint32_t c = coreIdx(r);
+    if (c == lastSrc) {
+        streak++;
+        if (streak == threshold && !blacklisted[c]) {
+            blacklisted[c] = true;
+            profBlacklistings.inc();
+        }
+    } else {
+        lastSrc = c;
+        streak = 1;
+    }
+}
+
+void BLISSSchedPolicy::initStats(AggregateStat* parentStat) {
+    profBlacklistings.init("blacklistings", "Cores blacklisted for getting too many consecutive requests served");
+    parentStat->append(&profBlacklistings);
+}
+
+/* ATLAS */
+
+ATLASSchedPolicy::ATLASSchedPolicy(uint32_t numCores, uint32_t _quantum, uint32_t _starvationThreshold)
+    : DDRSchedPolicy(numCores), quantum(_quantum), starvationThreshold(_starvationThreshold), nextQuantumCycle(_quantum)
+{
+    curService.resize(this->numCores, 0);
+    totalService.resize(this->numCores, 0);
+    coreRank.resize(this->numCores, 0);  // all equal until the first quantum ends
+}
+
+void ATLASSchedPolicy::beginSchedule(RequestQueue<Request>& queue, uint64_t memCycle) {
+    if (memCycle < nextQuantumCycle) return;
+    std::vector<uint32_t> order(numCores);
+    for (uint32_t c = 0; c < numCores; c++) {
+        totalService[c] = (7*totalService[c] + curService[c])/8;
+        curService[c] = 0;
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return totalService[a] < totalService[b]; });
+    for (uint32_t i = 0; i < numCores; i++) coreRank[order[i]] = i;
+    while (nextQuantumCycle <= memCycle) nextQuantumCycle += quantum;
+    profQuanta.inc();
+}
+
+uint64_t ATLASSchedPolicy::priority(const Request* r, bool rowHit, uint64_t memCycle) {
+    bool starved = memCycle - r->arrivalCycle > starvationThreshold;
+    return (((uint64_t)(starved? 0 : 1)) << 33) | (((uint64_t)coreRank[coreIdx(r)]) << 1) | (rowHit? 0 : 1);
+}
+
+void ATLASSchedPolicy::served(const Request* r, bool rowHit, uint32_t serviceCycles, uint64_t memCycle) {
+    curService[coreIdx(r)] += serviceCycles;
+    if (memCycle - r->arrivalCycle > starvationThreshold) profStarved.inc();
+}
+
+void ATLASSchedPolicy::initStats(AggregateStat* parentStat) {
+    profQuanta.init("quanta", "Quanta (core rankings recomputed)");
+    profStarved.init("starved", "Requests served after the starvation threshold");
+    parentStat->append(&profQuanta);
+    parentStat->append(&profStarved);
+}
+
+/* PAR-BS */
+
+PARBSSchedPolicy::PARBSSchedPolicy(uint32_t _numCores, uint32_t ranks, uint32_t _banksPerRank, uint32_t _markingCap)
+    : DDRSchedPolicy(_numCores), numBanks(ranks*_banksPerRank), banksPerRank(_banksPerRank), markingCap(_markingCap), markedLeft(0)
+{
+    batchLoad.resize(numCores*numBanks, 0);
+    coreRank.resize(numCores, 0);
+}
+
+void PARBSSchedPolicy::formBatch(RequestQueue<Request>& queue) {
+    assert(!markedLeft);
+    for (uint32_t i = 0; i < batchLoad.size(); i++) batchLoad[i] = 0;
+
+    // Queues are in arrival order, so this marks the oldest requests
+    for (RequestQueue<Request>::iterator it = queue.begin(); it != queue.end(); it.inc()) {
+        Request* r = *it;
+        if (r->write) continue;  // batches only hold reads; writes are drained separately
+        uint32_t& load = batchLoad[coreIdx(r)*numBanks + r->loc.rank*banksPerRank + r->loc.bank];
+        if (load < markingCap) {
+            load++;
+            r->marked = true;
+            markedLeft++;
+        }
+    }
+
+    // No reads to batch (e.g., this is the write queue): keep the current ranking
+    if (!markedLeft) return;
+
+    // Shortest job first: rank by max bank load, then total load
+    std::vector<uint32_t> maxLoad(numCores, 0);
+    std::vector<uint32_t> totalLoad(numCores, 0);
+    std::vector<uint32_t> order(numCores);
+    for (uint32_t c = 0; c < numCores; c++) {
+        for (uint32_t b = 0; b < numBanks; b++) {
+            uint32_t load = batchLoad[c*numBanks + b];
+            maxLoad[c] = std::max(maxLoad[c], load);
+            totalLoad[c] += load;
+        }
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&maxLoad, &totalLoad](uint32_t a, uint32_t b) {
+        return (maxLoad[a] != maxLoad[b])? maxLoad[a] < maxLoad[b] : totalLoad[a] < totalLoad[b];
+    });
+    for (uint32_t i = 0; i < numCores; i++) coreRank[order[i]] = i;
+
+    profBatches.inc();
+    profMarked.inc(markedLeft);
+}
+
+void PARBSSchedPolicy::beginSchedule(RequestQueue<Request>& queue, uint64_t memCycle) {
+    if (!markedLeft) formBatch(queue);
+}
+
+uint64_t PARBSSchedPolicy::priority(const Request* r, bool rowHit, uint64_t memCycle) {
+    return (((uint64_t)(r->marked? 0 : 1)) << 33) | (((uint64_t)coreRank[coreIdx(r)]) << 1) | (rowHit? 0 : 1);
+}
+
+void PARBSSchedPolicy::served(const Request* r, bool rowHit, uint32_t serviceCycles, uint64_t memCycle) {
+    if (r->marked) {
+        assert(markedLeft);
+        markedLeft--;
+    }
+}
+
+void PARBSSchedPolicy::initStats(AggregateStat* parentStat) {
+    profBatches.init("batches", "Request batches formed");
+    profMarked.init("marked", "Requests marked in batches");
+    parentStat->append(&profBatches);
+    parentStat->append(&profMarked);
+}
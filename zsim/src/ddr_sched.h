@@ -0,0 +1,143 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DDR_SCHED_H_
+#define DDR_SCHED_H_
+
+/* Request scheduling policies for DDRMemory. By default, DDRMemory uses
+ * FR-FCFS with a cap on consecutive row hits (rowHitLimit), which it decides
+ * at arrival time by ordering per-bank queues. A policy instead picks, at each
+ * scheduling decision, the ready request with the lowest priority value
+ * (ties go to the oldest request). Policies only use what a real controller
+ * knows at that point: queued requests, their requesting cores, and the
+ * current state of each bank.
+ */
+
+#include <algorithm>
+#include "ddr_mem.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "stats.h"
+
+class DDRSchedPolicy : public GlobAlloc {
+    protected:
+        const uint32_t numCores;  // per-core tables are this size
+
+        // Index into per-core tables. Requests from non-core sources (e.g., trace-driven runs) fold into the last one
+        inline uint32_t coreIdx(const DDRMemory::Request* r) const {
+            return std::min(r->srcId, numCores - 1);
+        }
+
+    public:
+        typedef DDRMemory::Request Request;
+
+        explicit DDRSchedPolicy(uint32_t _numCores) : numCores(std::max(1u, _numCores)) {}
+        virtual ~DDRSchedPolicy() {}
+
+        // Called before each scheduling decision, with the queue the decision is made on
+        virtual void beginSchedule(RequestQueue<Request>& queue, uint64_t memCycle) {}
+
+        // Priority of a ready request; lower is better
+        virtual uint64_t priority(const Request* r, bool rowHit, uint64_t memCycle) = 0;
+
+        // Called when the request's RD/WR command issues, with its bank occupancy
+        virtual void served(const Request* r, bool rowHit, uint32_t serviceCycles, uint64_t memCycle) {}
+
+        virtual void initStats(AggregateStat* parentStat) {}
+};
+
+/* BLISS (Subramanian et al., ICCD 2014): cores that get too many consecutive
+ * requests served are blacklisted, and lose priority until the blacklist is
+ * cleared. Otherwise, FR-FCFS.
+ */
+class BLISSSchedPolicy : public DDRSchedPolicy {
+    private:
+        const uint32_t threshold;
+        const uint32_t clearInterval;  // in memCycles
+        g_vector<bool> blacklisted;
+        uint32_t lastSrc;
+        uint32_t streak;
+        uint64_t nextClearCycle;
+        Counter profBlacklistings;
+
+    public:
+        BLISSSchedPolicy(uint32_t numCores, uint32_t _threshold, uint32_t _clearInterval);
+        void beginSchedule(RequestQueue<Request>& queue, uint64_t memCycle);
+        uint64_t priority(const Request* r, bool rowHit, uint64_t memCycle);
+        void served(const Request* r, bool rowHit, uint32_t serviceCycles, uint64_t memCycle);
+        void initStats(AggregateStat* parentStat);
+};
+
+/* ATLAS (Kim et al., HPCA 2010): cores are ranked by least attained service,
+ * tracked with an exponential moving average across quanta. Requests that have
+ * waited past a starvation threshold go first; then requests from
+ * higher-ranked cores; then row hits; then the oldest requests.
+ */
+class ATLASSchedPolicy : public DDRSchedPolicy {
+    private:
+        const uint32_t quantum;  // in memCycles
+        const uint32_t starvationThreshold;  // in memCycles
+        g_vector<uint64_t> curService;  // this quantum
+        g_vector<uint64_t> totalService;  // moving average, alpha = 7/8
+        g_vector<uint32_t> coreRank;  // 0 is the highest
+        uint64_t nextQuantumCycle;
+        Counter profQuanta, profStarved;
+
+    public:
+        ATLASSchedPolicy(uint32_t numCores, uint32_t _quantum, uint32_t _starvationThreshold);
+        void beginSchedule(RequestQueue<Request>& queue, uint64_t memCycle);
+        uint64_t priority(const Request* r, bool rowHit, uint64_t memCycle);
+        void served(const Request* r, bool rowHit, uint32_t serviceCycles, uint64_t memCycle);
+        void initStats(AggregateStat* parentStat);
+};
+
+/* PAR-BS (Mutlu and Moscibroda, ISCA 2008): when the current batch drains,
+ * marks up to markingCap of the oldest requests of each core to each bank as
+ * a new batch. Marked requests go first, and within a batch cores are ranked
+ * shortest-job-first (fewest marked requests to their most loaded bank, then
+ * fewest in total); then row hits; then the oldest requests.
+ */
+class PARBSSchedPolicy : public DDRSchedPolicy {
+    private:
+        const uint32_t numBanks;  // across all ranks
+        const uint32_t banksPerRank;
+        const uint32_t markingCap;
+        g_vector<uint32_t> batchLoad;  // numCores x numBanks, marked requests when the batch formed
+        g_vector<uint32_t> coreRank;
+        uint32_t markedLeft;
+        Counter profBatches, profMarked;
+
+    public:
+        PARBSSchedPolicy(uint32_t _numCores, uint32_t ranks, uint32_t _banksPerRank, uint32_t _markingCap);
+        void beginSchedule(RequestQueue<Request>& queue, uint64_t memCycle);
+        uint64_t priority(const Request* r, bool rowHit, uint64_t memCycle);
+        void served(const Request* r, bool rowHit, uint32_t serviceCycles, uint64_t memCycle);
+        void initStats(AggregateStat* parentStat);
+
+    private:
+        void formBatch(RequestQueue<Request>& queue);
+};
+
+#endif  // DDR_SCHED_H_
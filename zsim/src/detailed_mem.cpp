@@ -135,6 +135,11 @@ bool MemChannelBase::IsRowBufferHit(uint32_t row, uint32_t rank, uint32_t bank)
     return ((ranks[rank]->GetBankOpen(bank) == true) && (ranks[rank]->GetLastRow(bank) == row));
 }
 
+bool MemChannelBase::GetOpenRow(uint32_t rank, uint32_t bank, uint32_t& row) {
+    row = ranks[rank]->GetLastRow(bank);
+    return ranks[rank]->GetBankOpen(bank);
+}
+
 
 uint32_t MemChannelBase::UpdateRefreshNum(uint32_t rank, uint64_t arrivalCycle) {
     //////////////////////////////////////////////////////////////////////
@@ -597,122 +602,17 @@ bool MemChannelBase::CheckContinuousAccess(uint64_t arrivalCycle, uint32_t rank,
      }
 }
 
-// See also MemControllerBase::ReturnChannel
+// See also MemControllerBase::ReturnChannel and MemParam::LoadConfigMain for the available layouts
 void MemChannelBase::AddressMap(Address addr, uint32_t& row, uint32_t& col, uint32_t& rank, uint32_t& bank) {
-    // FIXME (dsm): This is needlessly complex. See how addressing is done in DDRMemory (along with sizing)
-    //
     // Address is cache line address. it has already shifted for containg process id.
-    // interleaveType == 0: | Row | ColH | Bank | Rank | Chnl | ColL | DataBus |
-    // interleaveType == 1: | Row | ColH | Rank | Bank | Chnl | ColL | DataBus |
-    // interleaveType == 2: | Row | Bank | ColH | Rank | Chnl | ColL | DataBus |
-    // interleaveType == 3: | Row | Rank | ColH | Bank | Chnl | ColL | DataBus |
-    // interleaveType == 4: | Row | Bank | Rank | ColH | Chnl | ColL | DataBus |
-    // interleaveType == 5: | Row | Rank | Bank | ColH | Chnl | ColL | DataBus |
-    // interleaveType == 6: | Row | Rank | Bank | Chnl | Column | DataBus |
-    // interleaveType == 7: | Row | Rank | Chnl | Bank | Column | DataBus |
-    // interleaveType == 8: | Row | Chnl | Rank | Bank | Column | DataBus |
-
-    uint32_t colLowWidth = 0;
-    uint32_t colLow = 0;
-    if (mParam->channelDataWidthLog < mParam->byteOffsetWidth) {
-        colLowWidth = mParam->byteOffsetWidth - mParam->channelDataWidthLog;
-        colLow = addr & ((1L << colLowWidth) - 1);
-        addr >>= colLowWidth;
-    }
-
-    uint32_t chnl = (uint32_t)-1;
-    if (mParam->interleaveType >= 0 && mParam->interleaveType <= 5) {
-        // for non-power of 2 channels
-        chnl = addr % mParam->channelCount;
-        addr /= mParam->channelCount;
-    }
-
-    uint32_t colHighWidth = mParam->colAddrWidth - colLowWidth;
-    uint32_t colHigh = 0;
-    if (mParam->interleaveType >= 4) {
-        colHigh = addr & ((1L << colHighWidth) - 1);
-        col = (colHigh << colLowWidth) | colLow;
-        addr >>= colHighWidth;
-    }
-
-    switch(mParam->interleaveType) {
-    case 0:
-        rank = addr & ((1L << mParam->rankWidth) - 1);
-        addr >>= mParam->rankWidth;
-        bank = addr & ((1L << mParam->bankWidth) - 1);
-        addr >>= mParam->bankWidth;
-        colHigh = addr & ((1L << colHighWidth) - 1);
-        addr >>= colHighWidth;
-        col = (colHigh << colLowWidth) | colLow;
-        break;
-    case 1:
-        bank = addr & ((1L << mParam->bankWidth) - 1);
-        addr >>= mParam->bankWidth;
-        rank = addr & ((1L << mParam->rankWidth) - 1);
-        addr >>= mParam->rankWidth;
-        colHigh = addr & ((1L << colHighWidth) - 1);
-        addr >>= colHighWidth;
-        col = (colHigh << colLowWidth) | colLow;
-        break;
-    case 2:
-        rank = addr & ((1L << mParam->rankWidth) - 1);
-        addr >>= mParam->rankWidth;
-        colHigh = addr & ((1L << colHighWidth) - 1);
-        addr >>= colHighWidth;
-        col = (colHigh << colLowWidth) | colLow;
-        bank = addr & ((1L << mParam->bankWidth) - 1);
-        addr >>= mParam->bankWidth;
-        break;
-    case 3:
-        bank = addr & ((1L << mParam->bankWidth) - 1);
-        addr >>= mParam->bankWidth;
-        colHigh = addr & ((1L << colHighWidth) - 1);
-        addr >>= colHighWidth;
-        col = (colHigh << colLowWidth) | colLow;
-        rank = addr & ((1L << mParam->rankWidth) - 1);
-        addr >>= mParam->rankWidth;
-        break;
-    case 4:
-        rank = addr & ((1L << mParam->rankWidth) - 1);
-        addr >>= mParam->rankWidth;
-        bank = addr & ((1L << mParam->bankWidth) - 1);
-        addr >>= mParam->bankWidth;
-        break;
-    case 5:
-        bank = addr & ((1L << mParam->bankWidth) - 1);
-        addr >>= mParam->bankWidth;
-        rank = addr & ((1L << mParam->rankWidth) - 1);
-        addr >>= mParam->rankWidth;
-        break;
-    case 6:
-        chnl = addr % mParam->channelCount;
-        addr /= mParam->channelCount;
-        bank = addr & ((1L << mParam->bankWidth) - 1);
-        addr >>= mParam->bankWidth;
-        rank = addr & ((1L << mParam->rankWidth) - 1);
-        addr >>= mParam->rankWidth;
-        break;
-    case 7:
-        bank = addr & ((1L << mParam->bankWidth) - 1);
-        addr >>= mParam->bankWidth;
-        chnl = addr % mParam->channelCount;
-        addr /= mParam->channelCount;
-        rank = addr & ((1L << mParam->rankWidth) - 1);
-        addr >>= mParam->rankWidth;
-        break;
-    case 8:
-        bank = addr & ((1L << mParam->bankWidth) - 1);
-        addr >>= mParam->bankWidth;
-        rank = addr & ((1L << mParam->rankWidth) - 1);
-        addr >>= mParam->rankWidth;
-        chnl = addr % mParam->channelCount;
-        addr /= mParam->channelCount;
-        break;
-    }
-
-    assert(myId == chnl);
-
-    row = addr;
+    uint32_t vals[MemParam::ADDR_FIELDS];
+    Address rowAddr = mParam->addrMapper->map(addr, vals);
+    assert(myId == vals[MemParam::ADDR_CHNL]);
+
+    col = (vals[MemParam::ADDR_COLH] << mParam->colLowWidth) | vals[MemParam::ADDR_COLL];
+    rank = vals[MemParam::ADDR_RANK];
+    bank = vals[MemParam::ADDR_BANK];
+    row = rowAddr;
     //row != addr & ((1L<<mParam->rowAddrWidth)-1);
     // row address may contains large number, even if it exceed memory capacity size.
     // Becase memory model receives PID + VA as a access address.
@@ -842,55 +742,134 @@ uint64_t MemChannelBase::GetBackGroundEnergy(uint64_t memCycle, uint64_t lastMem
 
 ////////////////////////////////////////////////////////////////////////
 // Default Memory Scheduler Class
+void MemSchedulerDefault::RequestQueue::Push(Entry* e) {
+    e->next = nullptr;
+    e->prev = age.tail;
+    if (age.tail) age.tail->next = e;
+    else age.head = e;
+    age.tail = e;
+    size++;
+
+    if (indexRows) {
+        EntryList& row = rows[e->rowKey];  // value-initialized (empty) if new
+        e->rowNext = nullptr;
+        e->rowPrev = row.tail;
+        if (row.tail) row.tail->rowNext = e;
+        else row.head = e;
+        row.tail = e;
+    }
+}
+
+void MemSchedulerDefault::RequestQueue::Remove(Entry* e) {
+    if (e->prev) e->prev->next = e->next;
+    else age.head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else age.tail = e->prev;
+    assert(size);
+    size--;
+
+    if (indexRows) {
+        if (!e->rowPrev && !e->rowNext) {
+            rows.erase(e->rowKey);  // last request to this row
+        } else {
+            EntryList& row = rows[e->rowKey];
+            if (e->rowPrev) e->rowPrev->rowNext = e->rowNext;
+            else row.head = e->rowNext;
+            if (e->rowNext) e->rowNext->rowPrev = e->rowPrev;
+            else row.tail = e->rowPrev;
+        }
+    }
+}
+
+MemSchedulerDefault::Entry* MemSchedulerDefault::RequestQueue::OldestInRow(uint64_t rowKey) const {
+    assert(indexRows);
+    g_unordered_map<uint64_t, EntryList>::const_iterator it = rows.find(rowKey);
+    return (it == rows.end())? nullptr : it->second.head;
+}
+
 MemSchedulerDefault::MemSchedulerDefault(uint32_t id, MemParam* mParam, MemChannelBase* mChnl)
-    : MemSchedulerBase(id, mParam, mChnl)
+    : MemSchedulerBase(id, mParam, mChnl), rdQueue(true), wrQueue(true), wrDoneQueue(false)
 {
     prioritizedAccessType = READ;
     wrQueueSize = mParam->schedulerQueueCount;
     wrQueueHighWatermark = mParam->schedulerQueueCount * 2 / 3;
     wrQueueLowWatermark = mParam->schedulerQueueCount * 1 / 3;
+    freeEntries = nullptr;
+    nextSeq = 0;
 }
 
 MemSchedulerDefault::~MemSchedulerDefault() {}
 
+MemSchedulerDefault::Entry* MemSchedulerDefault::AllocEntry(MemAccessEventBase* ev, Address addr) {
+    Entry* e = freeEntries;
+    if (e) freeEntries = e->next;
+    else e = gm_malloc<Entry>();
+    e->ev = ev;
+    e->addr = addr;
+    e->seq = nextSeq++;
+    e->rowKey = GetRowKey(addr);
+    return e;
+}
+
+void MemSchedulerDefault::FreeEntry(Entry* e) {
+    e->next = freeEntries;
+    freeEntries = e;
+}
+
+uint64_t MemSchedulerDefault::GetRowKey(Address addr) {
+    uint32_t row, col, rank, bank;
+    mChnl->AddressMap(addr, row, col, rank, bank);
+    return (((uint64_t)(rank * mParam->bankCount + bank)) << 32) | row;
+}
+
 bool MemSchedulerDefault::CheckSetEvent(MemAccessEventBase* ev) {
+    Address addr = ev->getAddr();
+
     // Write Queue Hit Check
-    g_vector<MemSchedQueueElem>::iterator it;
-    for(it = wrQueue.begin(); it != wrQueue.end(); it++) {
-        if (it->second == ev->getAddr()) {
-            if (ev->getType() == WRITE) {
-                wrQueue.erase(it);
-                wrQueue.push_back(MemSchedQueueElem(nullptr, ev->getAddr()));
-            }
-            return true;
+    g_unordered_map<Address, Entry*>::iterator it = wrAddrs.find(addr);
+    if (it != wrAddrs.end()) {
+        if (ev->getType() == WRITE) {
+            // Requeue as the youngest write
+            Entry* e = it->second;
+            wrQueue.Remove(e);
+            e->seq = nextSeq++;
+            wrQueue.Push(e);
         }
+        return true;
     }
 
     // Write Done Queue Hit Check
-    for(it = wrDoneQueue.begin(); it != wrDoneQueue.end(); it++) {
-        if (it->second == ev->getAddr()) {
-            if (ev->getType() == READ) {
-                // Update LRU
-                wrDoneQueue.erase(it);
-                wrDoneQueue.push_back(MemSchedQueueElem(nullptr, ev->getAddr()));
-            } else { // Write
-                // Update for New Data
-                wrDoneQueue.erase(it);
-                wrQueue.push_back(MemSchedQueueElem(nullptr, ev->getAddr()));
-            }
-            return true;
+    it = wrDoneAddrs.find(addr);
+    if (it != wrDoneAddrs.end()) {
+        Entry* e = it->second;
+        wrDoneQueue.Remove(e);
+        if (ev->getType() == READ) {
+            // Update LRU
+            wrDoneQueue.Push(e);
+        } else { // Write
+            // Update for New Data
+            wrDoneAddrs.erase(it);
+            e->seq = nextSeq++;
+            wrQueue.Push(e);
+            wrAddrs[addr] = e;
         }
+        return true;
     }
 
     // No Hit
     if (ev->getType() == READ) {
-        rdQueue.push_back(MemSchedQueueElem(ev, ev->getAddr()));
+        rdQueue.Push(AllocEntry(ev, addr));
     } else { // Write
-        wrQueue.push_back(MemSchedQueueElem(nullptr, ev->getAddr()));
-        if (wrQueue.size() + wrDoneQueue.size() == wrQueueSize) {
+        Entry* e = AllocEntry(nullptr, addr);
+        wrQueue.Push(e);
+        wrAddrs[addr] = e;
+        if (wrQueue.Size() + wrDoneQueue.Size() == wrQueueSize) {
             // Overflow case
-            if (wrDoneQueue.empty() == false) {
-                wrDoneQueue.erase(wrDoneQueue.begin());
+            if (!wrDoneQueue.Empty()) {
+                Entry* lru = wrDoneQueue.Oldest();
+                wrDoneQueue.Remove(lru);
+                wrDoneAddrs.erase(lru->addr);
+                FreeEntry(lru);
             } else {
                 // FIXME: Need to handle this - HK
                 warn("Write Buffer Overflow!!");
@@ -901,61 +880,58 @@ bool MemSchedulerDefault::CheckSetEvent(MemAccessEventBase* ev) {
 }
 
 bool MemSchedulerDefault::GetEvent(MemAccessEventBase*& ev, Address& addr, MemAccessType& type) {
-    bool bRet = false;
-
     // Check Priority
-    if (wrQueue.size() >= wrQueueHighWatermark)
+    if (wrQueue.Size() >= wrQueueHighWatermark)
         prioritizedAccessType = WRITE; // Write Priority
-    else if (wrQueue.size() <= wrQueueLowWatermark)
+    else if (wrQueue.Size() <= wrQueueLowWatermark)
         prioritizedAccessType = READ; // Read Priority
 
-    //info("Id%d: Read Queue = %ld, Write Queue = %ld, Schedule = %d",
-    //myId, rdQueue.size(), wrQueue.size(), prioritizedAccessType);
+    //info("Id%d: Read Queue = %d, Write Queue = %d, Schedule = %d",
+    //myId, rdQueue.Size(), wrQueue.Size(), prioritizedAccessType);
 
-    uint32_t idx;
-    g_vector<MemSchedQueueElem>::iterator it;
     if (prioritizedAccessType == READ) {
-        bRet = FindBestRequest(&rdQueue, idx);
-        if (bRet) {
-            it = rdQueue.begin() + idx;
-            ev = it->first;
+        Entry* e = FindBestRequest(rdQueue);
+        if (e) {
+            ev = e->ev;
             addr = ev->getAddr();
             type = ev->getType();
-            rdQueue.erase(it);
+            rdQueue.Remove(e);
+            FreeEntry(e);
+            return true;
         }
     }
 
-    if (!bRet) { // Write Priority or No Read Entry
-        bRet = FindBestRequest(&wrQueue, idx);
-        if (bRet) {
-            it = wrQueue.begin() + idx;
-            ev = nullptr;
-            addr = it->second;
-            type = WRITE;
-            wrQueue.erase(it);
-            wrDoneQueue.push_back(MemSchedQueueElem(nullptr, addr));
-        }
+    // Write Priority or No Read Entry
+    Entry* e = FindBestRequest(wrQueue);
+    if (e) {
+        ev = nullptr;
+        addr = e->addr;
+        type = WRITE;
+        wrQueue.Remove(e);
+        wrAddrs.erase(addr);
+        wrDoneQueue.Push(e);
+        wrDoneAddrs[addr] = e;
+        return true;
     }
 
-    return bRet;
+    return false;
 }
 
-bool MemSchedulerDefault::FindBestRequest(g_vector<MemSchedQueueElem> *queue, uint32_t& idx) {
-    idx = 0;
-    uint32_t tmpIdx = 0;
-    g_vector<MemSchedQueueElem>::iterator it;
-    for(it = queue->begin(); it!= queue->end(); it++) {
-        Address addr = it->second;
-        uint32_t row, col, rank, bank;
-        mChnl->AddressMap(addr, row, col, rank, bank);
-        if (mChnl->IsRowBufferHit(row, rank, bank) == true) {
-            idx = tmpIdx;
-            break;
+// FR-FCFS: the oldest request that hits in an open row, or the oldest request if none does
+MemSchedulerDefault::Entry* MemSchedulerDefault::FindBestRequest(const RequestQueue& queue) {
+    if (queue.Empty()) return nullptr;
+
+    Entry* best = nullptr;
+    for (uint32_t rank = 0; rank < mParam->rankCount; rank++) {
+        for (uint32_t bank = 0; bank < mParam->bankCount; bank++) {
+            uint32_t row;
+            if (!mChnl->GetOpenRow(rank, bank, row)) continue;
+            Entry* e = queue.OldestInRow((((uint64_t)(rank * mParam->bankCount + bank)) << 32) | row);
+            if (e && (!best || e->seq < best->seq)) best = e;
         }
-        tmpIdx++;
     }
 
-    return !queue->empty();
+    return best? best : queue.Oldest();
 }
 
 
@@ -1084,6 +1060,7 @@ uint32_t MemControllerBase::tick(uint64_t sysCycle) {
 
 void MemControllerBase::TickScheduler(uint64_t sysCycle) {
     for(uint32_t i = 0; i < mParam->channelCount; i++) {
+        queueDepthHist.inc(std::min(sches[i]->GetQueueDepth(), mParam->schedulerQueueCount));
         MemAccessEventBase* ev = nullptr;
         Address  addr = 0;
         MemAccessType type = READ;
@@ -1201,6 +1178,12 @@ void MemControllerBase::initStats(AggregateStat* parentStat) {
     latencyHist.init("mlh","latency histogram for memory requests", lhNumBins);
     memStats->append(&latencyHist);
 
+    if (mParam->schedulerQueueCount != 0) {
+        // Last bin counts depths >= schedulerQueueCount (reads are not bounded by it)
+        queueDepthHist.init("qdh", "scheduler queue depth (reads + writes) histogram, per channel and memory cycle", mParam->schedulerQueueCount + 1);
+        memStats->append(&queueDepthHist);
+    }
+
     parentStat->append(memStats);
 }
 
@@ -1236,47 +1219,10 @@ void MemControllerBase::finish(void) {
 
 // See also MemChannelBase::AddressMap
 uint64_t MemControllerBase::ReturnChannel(Address addr) {
-
     // addr is cache line address. it has already shifted for containg process id.
-
-    uint32_t colLowWidth = 0;
-    if (mParam->channelDataWidthLog < mParam->byteOffsetWidth) {
-        colLowWidth = mParam->byteOffsetWidth - mParam->channelDataWidthLog;
-        addr >>= colLowWidth;
-    }
-
-    uint64_t result = addr;
-
-    //for non-power of 2 channels, simply shift and get modulo
-    switch (mParam->interleaveType) {
-        case 0:
-        case 1:
-        case 2:
-        case 3:
-        case 4:
-        case 5:
-            // Cache block interleave
-            result  %= mParam->channelCount;
-            break;
-        case 6:
-            result >>= (mParam->colAddrWidth - colLowWidth);
-            result  %= mParam->channelCount;
-            break;
-        case 7:
-            result >>= (mParam->colAddrWidth - colLowWidth);
-            result >>= mParam->bankWidth;
-            result  %= mParam->channelCount;
-            break;
-        case 8:
-            result >>= (mParam->colAddrWidth - colLowWidth);
-            result >>= mParam->bankWidth;
-            result >>= mParam->rankWidth;
-            result  %= mParam->channelCount;
-            break;
-        default:
-            panic("Invalid interleaveType!");
-    }
-    return result;
+    uint32_t vals[MemParam::ADDR_FIELDS];
+    mParam->addrMapper->map(addr, vals);
+    return vals[MemParam::ADDR_CHNL];
 }
 
 uint64_t MemControllerBase::LatencySimulate(Address lineAddr, uint64_t sysCycle, MemAccessType type) {
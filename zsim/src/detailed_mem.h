@@ -28,6 +28,7 @@
 
 #include "detailed_mem_params.h"
 #include "g_std/g_string.h"
+#include "g_std/g_unordered_map.h"
 #include "memory_hierarchy.h"
 #include "stats.h"
 #include "timing_event.h"
@@ -168,6 +169,8 @@ class MemChannelBase : public GlobAlloc {
         virtual uint64_t LatencySimulate(Address lineAddr, uint64_t arrivalCycle, uint64_t lastPhaseCycle, MemAccessType type);
         virtual void AddressMap(Address addr, uint32_t& row, uint32_t& col, uint32_t& rank, uint32_t& bank);
         bool IsRowBufferHit(uint32_t row, uint32_t rank, uint32_t bank);
+        // Returns false if the bank is closed
+        bool GetOpenRow(uint32_t rank, uint32_t bank, uint32_t& row);
 
         virtual uint64_t GetActivateCount(void);
         virtual uint64_t GetPrechargeCount(void);
@@ -214,26 +217,77 @@ class MemSchedulerBase : public GlobAlloc {
         //
         // FIXME(dsm): refpointer? pointeref? Hmmm...
         virtual bool GetEvent(MemAccessEventBase*& ev, Address& addr, MemAccessType& type) = 0;
+
+        // Queued read and write requests, for the queue depth histogram
+        virtual uint32_t GetQueueDepth(void) = 0;
 };
 
+/* FR-FCFS scheduler with a read/write watermark policy. Each queue keeps its
+ * requests in arrival order, and also per (rank, bank, row), so finding the
+ * oldest row hit takes one lookup per bank instead of a walk over the queue,
+ * and all removals are O(1). Writes are retired into an LRU write-done buffer
+ * that serves later reads and writes to the same lines.
+ */
 class MemSchedulerDefault : public MemSchedulerBase {
     private:
+        struct Entry {
+            MemAccessEventBase* ev;  // nullptr for writes
+            Address addr;
+            uint64_t seq;  // arrival order
+            uint64_t rowKey;  // (rank, bank, row), see GetRowKey()
+            Entry* prev;
+            Entry* next;
+            Entry* rowPrev;
+            Entry* rowNext;
+        };
+
+        struct EntryList {
+            Entry* head;  // oldest
+            Entry* tail;
+        };
+
+        class RequestQueue {
+            private:
+                EntryList age;
+                uint32_t size;
+                bool indexRows;
+                g_unordered_map<uint64_t, EntryList> rows;  // only if indexRows
+
+            public:
+                explicit RequestQueue(bool _indexRows) : size(0), indexRows(_indexRows) { age.head = age.tail = nullptr; }
+                void Push(Entry* e);
+                void Remove(Entry* e);
+                Entry* Oldest(void) const { return age.head; }
+                Entry* OldestInRow(uint64_t rowKey) const;
+                uint32_t Size(void) const { return size; }
+                bool Empty(void) const { return size == 0; }
+        };
+
         MemAccessType prioritizedAccessType;
         uint32_t wrQueueSize;
         uint32_t wrQueueHighWatermark;
         uint32_t wrQueueLowWatermark;
 
-        g_vector <MemSchedQueueElem> rdQueue;
-        g_vector <MemSchedQueueElem> wrQueue;
-        g_vector <MemSchedQueueElem> wrDoneQueue;
+        RequestQueue rdQueue;
+        RequestQueue wrQueue;
+        RequestQueue wrDoneQueue;  // LRU order
+        g_unordered_map<Address, Entry*> wrAddrs;  // line -> entry in wrQueue
+        g_unordered_map<Address, Entry*> wrDoneAddrs;  // line -> entry in wrDoneQueue
+
+        Entry* freeEntries;
+        uint64_t nextSeq;
 
-        bool FindBestRequest(g_vector <MemSchedQueueElem> *queue, uint32_t& idx);
+        Entry* AllocEntry(MemAccessEventBase* ev, Address addr);
+        void FreeEntry(Entry* e);
+        uint64_t GetRowKey(Address addr);
+        Entry* FindBestRequest(const RequestQueue& queue);
 
     public:
         MemSchedulerDefault(uint32_t id, MemParam* mParam, MemChannelBase* mChnl);
         ~MemSchedulerDefault();
         bool CheckSetEvent(MemAccessEventBase* ev);
         bool GetEvent(MemAccessEventBase*& ev, Address& addr, MemAccessType& type);
+        uint32_t GetQueueDepth(void) { return rdQueue.Size() + wrQueue.Size(); }
 };
 
 // DRAM controller base class
@@ -285,6 +339,7 @@ class MemControllerBase : public MemObject {
         VectorCounter latencyHist;
         uint32_t lhBinSize;
         uint32_t lhNumBins;
+        VectorCounter queueDepthHist;  // sampled every memory cycle, per channel
 
         Counter profActivate;
         Counter profPrecharge;
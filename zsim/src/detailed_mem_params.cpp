@@ -123,6 +123,36 @@ void MemParam::LoadConfigMain(Config &cfg, uint32_t _cacheLineSize)
     channelDataWidthLog = ilog2(channelDataWidth);
     bankWidth   = ilog2(bankCount);
     byteOffsetWidth = ilog2(cacheLineSize);
+    colLowWidth = (channelDataWidthLog < byteOffsetWidth)? byteOffsetWidth - channelDataWidthLog : 0;
+
+    // Address is cache line address. it has already shifted for containg process id.
+    // interleaveType == 0: | Row | ColH | Bank | Rank | Chnl | ColL | DataBus |
+    // interleaveType == 1: | Row | ColH | Rank | Bank | Chnl | ColL | DataBus |
+    // interleaveType == 2: | Row | Bank | ColH | Rank | Chnl | ColL | DataBus |
+    // interleaveType == 3: | Row | Rank | ColH | Bank | Chnl | ColL | DataBus |
+    // interleaveType == 4: | Row | Bank | Rank | ColH | Chnl | ColL | DataBus |
+    // interleaveType == 5: | Row | Rank | Bank | ColH | Chnl | ColL | DataBus |
+    // interleaveType == 6: | Row | Rank | Bank | Chnl | Column | DataBus |
+    // interleaveType == 7: | Row | Rank | Chnl | Bank | Column | DataBus |
+    // interleaveType == 8: | Row | Chnl | Rank | Bank | Column | DataBus |
+    // mc_spec.addrMapping overrides these with any other order
+    const char* interleaveLayouts[] = {
+        "colH:bank:rank:chnl:colL", "colH:rank:bank:chnl:colL", "bank:colH:rank:chnl:colL",
+        "rank:colH:bank:chnl:colL", "bank:rank:colH:chnl:colL", "rank:bank:colH:chnl:colL",
+        "rank:bank:chnl:colH:colL", "rank:chnl:bank:colH:colL", "chnl:rank:bank:colH:colL",
+    };
+    if (interleaveType >= sizeof(interleaveLayouts)/sizeof(interleaveLayouts[0])) panic("Invalid interleaveType!");
+    const char* addrMapping = cfg.get<const char*>("mc_spec.addrMapping", interleaveLayouts[interleaveType]);
+    // Hash channel/rank/bank bits with row bits (None, Permutation or XORFold)
+    AddrMapper::HashType addrHash = AddrMapper::parseHash(cfg.get<const char*>("mc_spec.addrHash", "None"));
+
+    addrMapper = new AddrMapper("mem-addr-map", addrMapping, addrHash);
+    addrMapper->addField("colL", 1 << colLowWidth, false);
+    addrMapper->addField("colH", 1 << (colAddrWidth - colLowWidth), false);
+    addrMapper->addField("chnl", channelCount);  // non-power of 2 channels use modulo
+    addrMapper->addField("rank", 1 << rankWidth);
+    addrMapper->addField("bank", 1 << bankWidth);
+    addrMapper->init();
 }
 
 void MemParam::LoadTiming(Config &cfg)
@@ -27,6 +27,7 @@
 #define DETAILED_MEM_PARAMS_H_
 
 #include "g_std/g_string.h"
+#include "addr_map.h"
 #include "config.h"
 
 class MemParam : public GlobAlloc{
@@ -97,6 +98,11 @@ class MemParam : public GlobAlloc{
         uint32_t bankWidth;
         uint32_t channelDataWidth; // Data bus bits (= JEDEC_BUS_WIDTH)
         uint32_t channelDataWidthLog; // ilog2(Datawdith / 8)
+        uint32_t colLowWidth; // column bits below the channel bits (lines narrower than a burst)
+
+        // Address mapping, shared by the controller (to pick channels) and channels; fields are defined in this order
+        enum {ADDR_COLL, ADDR_COLH, ADDR_CHNL, ADDR_RANK, ADDR_BANK, ADDR_FIELDS};
+        AddrMapper* addrMapper;
 
         // Timing Parameters
         double tCK;
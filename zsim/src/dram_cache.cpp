@@ -0,0 +1,210 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dram_cache.h"
+#include "event_recorder.h"
+#include "log.h"
+#include "timing_event.h"
+#include "zsim.h"
+
+DRAMCache::DRAMCache(MemObject* _array, MemObject* _mem, Organization _org, uint32_t _numLines, uint32_t _ways,
+        uint32_t _tagLatency, const char* _name)
+    : array(_array), mem(_mem), org(_org), numSets(_numLines/_ways), ways(_ways),
+      tagLatency(_tagLatency), useCounter(0), name(_name)
+{
+    if (!ways || !numSets || _numLines % ways) panic("%s: %d lines can't be split in sets of %d ways", name.c_str(), _numLines, ways);
+    if (org == ALLOY && ways != 1) panic("%s: alloy caches are direct-mapped", name.c_str());
+
+    tags = gm_calloc<Address>(numSets*ways);
+    dirty = gm_calloc<bool>(numSets*ways);
+    approxTypes = gm_calloc<ApproxType>(numSets*ways);
+    lastUse = gm_calloc<uint64_t>(numSets*ways);
+    for (uint64_t i = 0; i < (uint64_t)numSets*ways; i++) tags[i] = -1L;  // invalid
+    futex_init(&lock);
+
+    info("%s: %s DRAM cache, %d sets x %d ways, tag latency %d", name.c_str(),
+            (org == ALLOY)? "alloy" : "set-associative", numSets, ways, tagLatency);
+}
+
+void DRAMCache::initStats(AggregateStat* parentStat) {
+    AggregateStat* dcStats = new AggregateStat();
+    dcStats->init(name.c_str(), "DRAM cache stats");
+    profRdHits.init("rdHits", "Read (GETS/GETX) hits"); dcStats->append(&profRdHits);
+    profRdMisses.init("rdMisses", "Read (GETS/GETX) misses"); dcStats->append(&profRdMisses);
+    profWrHits.init("wrHits", "Dirty writebacks (PUTX) that hit"); dcStats->append(&profWrHits);
+    profWrMisses.init("wrMisses", "Dirty writebacks (PUTX) that allocated a line"); dcStats->append(&profWrMisses);
+    profEvictions.init("evictions", "Valid lines evicted"); dcStats->append(&profEvictions);
+    profDirtyEvictions.init("dirtyEvictions", "Dirty lines evicted and written back to memory"); dcStats->append(&profDirtyEvictions);
+    profArrayAccs.init("arrayAccs", "Accesses to the DRAM cache array (reads, fills, and writes)"); dcStats->append(&profArrayAccs);
+    profMemAccs.init("memAccs", "Accesses to the backing memory (misses and writebacks)"); dcStats->append(&profMemAccs);
+    parentStat->append(dcStats);
+
+    array->initStats(parentStat);
+    mem->initStats(parentStat);
+}
+
+int32_t DRAMCache::lookup(uint32_t set, Address lineAddr) const {
+    for (uint32_t w = 0; w < ways; w++) {
+        if (tags[set*ways + w] == lineAddr) return w;
+    }
+    return -1;
+}
+
+uint32_t DRAMCache::pickVictim(uint32_t set) const {
+    uint32_t victim = 0;
+    for (uint32_t w = 0; w < ways; w++) {
+        uint32_t id = set*ways + w;
+        if (tags[id] == (Address)-1L) return w;
+        if (lastUse[id] < lastUse[set*ways + victim]) victim = w;
+    }
+    return victim;
+}
+
+uint64_t DRAMCache::issue(MemObject* obj, const MemReq& parentReq, Address lineAddr, AccessType type, uint64_t cycle,
+        RecordChain& chain, EventRecorder* evRec) {
+    MESIState dummyState = I;
+    MemReq req = {lineAddr, type, 0, &dummyState, cycle, nullptr, dummyState, parentReq.srcId, 0 /*no flags*/, parentReq.pc, parentReq.approxType};
+    uint64_t respCycle = obj->access(req);
+    if (obj == array) profArrayAccs.atomicInc();
+    else profMemAccs.atomicInc();
+
+    if (!evRec || !evRec->hasRecord()) return respCycle;
+    TimingRecord r = evRec->popRecord();
+    assert(r.reqCycle >= chain.endCycle);
+
+    if (!chain.startEv) {
+        // First recorded access; start the chain at the parent request's cycle
+        DelayEvent* startEv = new (evRec) DelayEvent(0);
+        startEv->setMinStartCycle(chain.endCycle);
+        chain.startEv = chain.endEv = startEv;
+    }
+
+    TimingEvent* ev = chain.endEv;
+    if (r.reqCycle > chain.endCycle) {
+        DelayEvent* dEv = new (evRec) DelayEvent(r.reqCycle - chain.endCycle);
+        dEv->setMinStartCycle(chain.endCycle);
+        ev = ev->addChild(dEv, evRec);
+    }
+    ev->addChild(r.startEvent, evRec);
+
+    chain.endEv = r.endEvent;
+    chain.endCycle = r.respCycle;
+    return respCycle;
+}
+
+uint64_t DRAMCache::access(MemReq& req) {
+    switch (req.type) {
+        case PUTS:
+            *req.state = I;
+            return req.cycle;  // clean writebacks are not real accesses
+        case PUTX:
+            *req.state = I;
+            break;
+        case GETS:
+            *req.state = req.is(MemReq::NOEXCL)? S : E;
+            break;
+        case GETX:
+            *req.state = M;
+            break;
+        default: panic("!?");
+    }
+
+    EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+    RecordChain chain = {nullptr, nullptr, req.cycle};
+    bool isWrite = (req.type == PUTX);
+
+    futex_lock(&lock);
+    uint32_t set = req.lineAddr % numSets;
+    int32_t way = lookup(set, req.lineAddr);
+    bool hit = (way != -1);
+
+    uint64_t cycle = req.cycle + tagLatency;
+    uint64_t respCycle;
+    if (org == ALLOY) {
+        // Every access reads the set's tag and data first
+        cycle = issue(array, req, set, GETS, cycle, chain, evRec);
+    }
+
+    if (hit) {
+        uint32_t id = set*ways + way;
+        if (isWrite) {
+            dirty[id] = true;
+            respCycle = issue(array, req, set*ways + way, PUTX, cycle, chain, evRec);
+            profWrHits.inc();
+        } else {
+            respCycle = (org == ALLOY)? cycle : issue(array, req, set*ways + way, GETS, cycle, chain, evRec);
+            profRdHits.inc();
+        }
+        lastUse[id] = ++useCounter;
+    } else {
+        // Misses read from memory (except writebacks, which carry the whole line) and respond right away
+        if (isWrite) {
+            respCycle = cycle;
+            profWrMisses.inc();
+        } else {
+            respCycle = issue(mem, req, req.lineAddr, req.type, cycle, chain, evRec);
+            profRdMisses.inc();
+        }
+
+        // Evict, then fill, off the critical path: a chain forked off the access's at respCycle reads the victim,
+        // writes it back, and only then overwrites it
+        RecordChain fillChain = chain;
+        uint64_t fillCycle = respCycle;
+        way = pickVictim(set);
+        uint32_t id = set*ways + way;
+        if (tags[id] != (Address)-1L) {
+            profEvictions.inc();
+            if (dirty[id]) {
+                MemReq victimReq = req;
+                victimReq.approxType = approxTypes[id];
+                // Alloy read the victim along with the tag; with SRAM tags, we need to read it now
+                if (org == SET_ASSOC) fillCycle = issue(array, victimReq, id, GETS, fillCycle, fillChain, evRec);
+                fillCycle = issue(mem, victimReq, tags[id], PUTX, fillCycle, fillChain, evRec);
+                profDirtyEvictions.inc();
+            }
+        }
+        tags[id] = req.lineAddr;
+        dirty[id] = isWrite;
+        approxTypes[id] = req.approxType;
+        lastUse[id] = ++useCounter;
+        issue(array, req, id, PUTX, fillCycle, fillChain, evRec);
+        // If the access itself recorded nothing, the fork's start event starts it too
+        if (!chain.startEv) chain.startEv = chain.endEv = fillChain.startEv;
+    }
+    futex_unlock(&lock);
+
+    // Close the chain so that its end matches our response
+    if (chain.startEv) {
+        assert(respCycle >= chain.endCycle);
+        if (respCycle > chain.endCycle) {
+            DelayEvent* dEv = new (evRec) DelayEvent(respCycle - chain.endCycle);
+            dEv->setMinStartCycle(chain.endCycle);
+            chain.endEv = chain.endEv->addChild(dEv, evRec);
+        }
+        TimingRecord tr = {req.lineAddr, req.cycle, respCycle, req.type, chain.startEv, chain.endEv};
+        evRec->pushRecord(tr);
+    }
+    return respCycle;
+}
@@ -0,0 +1,107 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DRAM_CACHE_H_
+#define DRAM_CACHE_H_
+
+/* Large stacked-DRAM cache (e.g., HBM used as a cache) in front of a memory
+ * controller. Its data array is a full memory controller (normally a
+ * DDRMemory), so array accesses see the same bank, row buffer, and bus timing
+ * as main memory. Two organizations:
+ *  - Alloy (Qureshi and Loh, MICRO 2012): direct-mapped, with the tag stored
+ *    next to the data, so one array read returns both. Misses are detected
+ *    only after that read, and then go to memory. Writes must read the set
+ *    first to find out whether the resident line is dirty.
+ *  - SetAssoc: set-associative with tags in SRAM (tagLatency cycles), so
+ *    misses go straight to memory and only hits read the array. Each set's
+ *    ways are consecutive in the array, sharing DRAM rows.
+ * Fills and dirty-victim writebacks are off the critical path, but they still
+ * take array and memory bandwidth in the weave phase. The cache is
+ * write-allocate, with LRU replacement in SetAssoc mode.
+ */
+
+#include "g_std/g_string.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+class EventRecorder;
+class TimingEvent;
+
+class DRAMCache : public MemObject {
+    public:
+        enum Organization {ALLOY, SET_ASSOC};
+
+    private:
+        MemObject* const array;  // models the cache's DRAM
+        MemObject* const mem;  // backing memory
+        const Organization org;
+        const uint32_t numSets;
+        const uint32_t ways;
+        const uint32_t tagLatency;  // SRAM tag lookup; 0 for alloy (tags come with the data)
+
+        Address* tags;  // numSets*ways
+        bool* dirty;
+        ApproxType* approxTypes;  // type of each line's data, recorded at fill; victim writebacks carry it
+        uint64_t* lastUse;  // LRU timestamps
+        uint64_t useCounter;
+
+        g_string name;
+        lock_t lock;
+
+        Counter profRdHits, profRdMisses;
+        Counter profWrHits, profWrMisses;
+        Counter profEvictions, profDirtyEvictions;
+        Counter profArrayAccs, profMemAccs;
+
+        // Event chain for the timing record of the access being served (see access())
+        struct RecordChain {
+            TimingEvent* startEv;
+            TimingEvent* endEv;
+            uint64_t endCycle;
+        };
+
+    public:
+        DRAMCache(MemObject* _array, MemObject* _mem, Organization _org, uint32_t _numLines, uint32_t _ways,
+                uint32_t _tagLatency, const char* _name);
+
+        uint64_t access(MemReq& req);
+        void initStats(AggregateStat* parentStat);
+
+        // Network nodes and memory stats use the backing controller's name
+        const char* getName() {return mem->getName();}
+
+    private:
+        // Returns the way holding lineAddr in set, or -1
+        int32_t lookup(uint32_t set, Address lineAddr) const;
+        uint32_t pickVictim(uint32_t set) const;
+
+        // Issues an access to the array or memory at cycle, and appends its timing record (if any) to the chain.
+        // Off-path sequences (evictions and fills) use a chain forked off the access's.
+        uint64_t issue(MemObject* obj, const MemReq& parentReq, Address lineAddr, AccessType type, uint64_t cycle,
+                RecordChain& chain, EventRecorder* evRec);
+};
+
+#endif  // DRAM_CACHE_H_
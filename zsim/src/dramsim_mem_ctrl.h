@@ -28,6 +28,7 @@
 
 #include <map>
 #include <string>
+#include "addr_map.h"
 #include "g_std/g_string.h"
 #include "memory_hierarchy.h"
 #include "pad.h"
@@ -82,17 +83,29 @@ class DRAMSimMemory : public MemObject { //one DRAMSim controller
 //DRAMSIM does not support non-pow2 channels, so:
 // - Encapsulate multiple DRAMSim controllers
 // - Fan out addresses interleaved across banks, and change the address to a "memory address"
+// Channels are interleaved every interleave lines, optionally hashing the channel with higher-order bits (see AddrMapper)
 class SplitAddrMemory : public MemObject {
     private:
         const g_vector<MemObject*> mems;
         const g_string name;
+        AddrMapper* addrMapper;
+        enum {CHNL_FIELD, BLK_FIELD, NUM_FIELDS};
+
     public:
-        SplitAddrMemory(const g_vector<MemObject*>& _mems, const char* _name) : mems(_mems), name(_name) {}
+        SplitAddrMemory(const g_vector<MemObject*>& _mems, const char* _name, uint32_t interleave = 1,
+                AddrMapper::HashType hash = AddrMapper::HASH_NONE) : mems(_mems), name(_name) {
+            addrMapper = new AddrMapper(_name, "chnl:blk", hash);
+            addrMapper->addField("chnl", mems.size());
+            addrMapper->addField("blk", interleave, false);
+            addrMapper->init();
+        }
 
         uint64_t access(MemReq& req) {
             Address addr = req.lineAddr;
-            uint32_t mem = addr % mems.size();
-            Address ctrlAddr = addr/mems.size();
+            uint32_t vals[NUM_FIELDS];
+            Address row = addrMapper->map(addr, vals);
+            uint32_t mem = vals[CHNL_FIELD];
+            Address ctrlAddr = addrMapper->compact(vals, row, CHNL_FIELD);
             req.lineAddr = ctrlAddr;
             uint64_t respCycle = mems[mem]->access(req);
             req.lineAddr = addr;
@@ -29,6 +29,7 @@
 #include "bithacks.h"
 #include "cache.h"
 #include "galloc.h"
+#include "lock_contention.h"
 #include "zsim.h"
 
 /* Extends Cache with an L0 direct-mapped cache, optimized to hell for hits
@@ -39,6 +40,20 @@
  * holds the most recently used line in each set. Accesses check the filter array,
  * and then go through the normal access path. Because there is one line per set,
  * it is fine to do this without grabbing a lock.
+ *
+ * Optionally, the filter can hold the 2 or 4 most recently used lines of each
+ * set (filterWays), so that lines that alias in the same set don't ping-pong
+ * through the normal access path. Entries only change under filterLock; the
+ * tiny per-set LRU state is updated on hits without it, since a stale LRU
+ * order only affects which filter entry is replaced next. Hits on non-MRU
+ * entries are replayed on the cache array's replacement policy before our
+ * next access, so that lines that keep hitting in the filter don't look cold.
+ *
+ * Atomic read-modify-writes (LOCK-prefixed instructions) acquire their line
+ * with rmwAcquire(), which issues a GETX with the RMW flag, and the core
+ * calls rmwRelease() when the RMW's store completes. While the line is held,
+ * invalidations and downgrades from other cores are not answered until the
+ * release cycle, so contended locks serialize as they do on real hardware.
  */
 
 class FilterCache : public Cache {
@@ -51,29 +66,50 @@ class FilterCache : public Cache {
             void clear() {wrAddr = 0; rdAddr = 0; availCycle = 0;}
         };
 
-        //Replicates the most accessed line of each set in the cache
-        FilterEntry* filterArray;
+        //Replicates the most accessed line(s) of each set in the cache
+        FilterEntry* filterArray;  // numSets x filterWays
+        uint8_t* filterLru;  // per set, ways in recency order, 2 bits each (bits 1:0 = MRU way)
         Address setMask;
         uint32_t numSets;
+        uint32_t filterWays;
         uint32_t srcId; //should match the core
         uint32_t reqFlags;
 
         lock_t filterLock;
         uint64_t fGETSHit, fGETXHit;
+        VectorCounter fGETSHitPos, fGETXHitPos;  // with filterWays > 1, hits by LRU position (0 = MRU)
+
+        //Non-MRU filter hits not yet seen by the array's replacement policy, as (filter entry << 1 | isStore).
+        //Only our core's thread uses these
+        static const uint32_t MAX_PENDING_TOUCHES = 16;
+        uint32_t pendingTouches[MAX_PENDING_TOUCHES];
+        uint32_t numPendingTouches;
+
+        //Line held by an in-flight RMW (physical), and the cycles it is held for
+        volatile Address heldLine;
+        volatile uint64_t heldFrom;
+        volatile uint64_t heldUntil;
 
     public:
         FilterCache(uint32_t _numSets, uint32_t _numLines, CC* _cc, CacheArray* _array,
-                ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, g_string& _name)
+                ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, g_string& _name, uint32_t _filterWays = 1)
             : Cache(_numLines, _cc, _array, _rp, _accLat, _invLat, _name)
         {
             numSets = _numSets;
             setMask = numSets - 1;
-            filterArray = gm_memalign<FilterEntry>(CACHE_LINE_BYTES, numSets);
-            for (uint32_t i = 0; i < numSets; i++) filterArray[i].clear();
+            filterWays = _filterWays;
+            assert(filterWays == 1 || filterWays == 2 || filterWays == 4);
+            filterArray = gm_memalign<FilterEntry>(CACHE_LINE_BYTES, numSets*filterWays);
+            for (uint32_t i = 0; i < numSets*filterWays; i++) filterArray[i].clear();
+            filterLru = gm_calloc<uint8_t>(numSets);
+            for (uint32_t i = 0; i < numSets; i++) filterLru[i] = 0xE4;  // 3:2:1:0, way 0 is MRU
             futex_init(&filterLock);
             fGETSHit = fGETXHit = 0;
             srcId = -1;
             reqFlags = 0;
+            numPendingTouches = 0;
+            heldLine = -1L;
+            heldFrom = heldUntil = 0;
         }
 
         void setSourceId(uint32_t id) {
@@ -94,6 +130,12 @@ class FilterCache : public Cache {
             fgetxStat->init("fhGETX", "Filtered GETX hits", &fGETXHit);
             cacheStat->append(fgetsStat);
             cacheStat->append(fgetxStat);
+            if (filterWays > 1) {
+                fGETSHitPos.init("fhGETSPos", "Filtered GETS hits by LRU position (0 = MRU)", filterWays);
+                fGETXHitPos.init("fhGETXPos", "Filtered GETX hits by LRU position (0 = MRU)", filterWays);
+                cacheStat->append(&fGETSHitPos);
+                cacheStat->append(&fGETXHitPos);
+            }
 
             initCacheStats(cacheStat);
             parentStat->append(cacheStat);
@@ -102,48 +144,97 @@ class FilterCache : public Cache {
         inline uint64_t load(Address vAddr, uint64_t curCycle, Address loadPc) {
             Address vLineAddr = vAddr >> lineBits;
             uint32_t idx = vLineAddr & setMask;
-            uint64_t availCycle = filterArray[idx].availCycle; //read before, careful with ordering to avoid timing races
-            if (vLineAddr == filterArray[idx].rdAddr) {
+            FilterEntry* set = &filterArray[idx*filterWays];
+            uint64_t availCycle = set[0].availCycle; //read before, careful with ordering to avoid timing races
+            if (vLineAddr == set[0].rdAddr) {
                 fGETSHit++;
+                if (filterWays > 1) fGETSHitPos.inc(touch(idx, 0));
                 return MAX(curCycle, availCycle);
-            } else {
-                return replace(vLineAddr, idx, true, curCycle, loadPc);
             }
+            for (uint32_t w = 1; w < filterWays; w++) {
+                availCycle = set[w].availCycle;
+                if (vLineAddr == set[w].rdAddr) {
+                    fGETSHit++;
+                    fGETSHitPos.inc(touch(idx, w));
+                    deferTouch(idx*filterWays + w, false, curCycle);
+                    return MAX(curCycle, availCycle);
+                }
+            }
+            return replace(vLineAddr, idx, true, curCycle, loadPc);
         }
 
-        inline uint64_t store(Address vAddr, uint64_t curCycle, Address storePc) {
+        inline uint64_t store(Address vAddr, uint64_t curCycle, Address storePc, uint32_t flags = 0) {
             Address vLineAddr = vAddr >> lineBits;
             uint32_t idx = vLineAddr & setMask;
-            uint64_t availCycle = filterArray[idx].availCycle; //read before, careful with ordering to avoid timing races
-            if (vLineAddr == filterArray[idx].wrAddr) {
+            FilterEntry* set = &filterArray[idx*filterWays];
+            uint64_t availCycle = set[0].availCycle; //read before, careful with ordering to avoid timing races
+            if (vLineAddr == set[0].wrAddr) {
                 fGETXHit++;
+                if (filterWays > 1) fGETXHitPos.inc(touch(idx, 0));
                 //NOTE: Stores don't modify availCycle; we'll catch matches in the core
                 //filterArray[idx].availCycle = curCycle; //do optimistic store-load forwarding
                 return MAX(curCycle, availCycle);
-            } else {
-                return replace(vLineAddr, idx, false, curCycle, storePc);
             }
+            for (uint32_t w = 1; w < filterWays; w++) {
+                availCycle = set[w].availCycle;
+                if (vLineAddr == set[w].wrAddr) {
+                    fGETXHit++;
+                    fGETXHitPos.inc(touch(idx, w));
+                    deferTouch(idx*filterWays + w, true, curCycle);
+                    return MAX(curCycle, availCycle);
+                }
+            }
+            return replace(vLineAddr, idx, false, curCycle, storePc, flags);
         }
 
-        uint64_t replace(Address vLineAddr, uint32_t idx, bool isLoad, uint64_t curCycle, Address pc) {
+        //Gets the line with exclusive permission and holds it until rmwRelease()
+        uint64_t rmwAcquire(Address vAddr, uint64_t curCycle, Address rmwPc) {
+            uint64_t respCycle = store(vAddr, curCycle, rmwPc, MemReq::RMW);
+            heldFrom = curCycle;
+            heldUntil = respCycle;
+            heldLine = procMask | (vAddr >> lineBits);
+            if (zinfo->lockContention) zinfo->lockContention->acquire(heldLine, srcId);
+            return respCycle;
+        }
+
+        //The RMW's store completed at this cycle
+        inline void rmwRelease(uint64_t cycle) {
+            if (cycle > heldUntil) heldUntil = cycle;
+        }
+
+        uint64_t replace(Address vLineAddr, uint32_t idx, bool isLoad, uint64_t curCycle, Address pc, uint32_t flags = 0) {
             Address pLineAddr = procMask | vLineAddr;
             MESIState dummyState = MESIState::I;
             futex_lock(&filterLock);
+            replayTouches(curCycle);
             ApproxType approxType = zinfo->approximate ? getApproxType(vLineAddr) : no_approx;
-            MemReq req = {pLineAddr, isLoad? GETS : GETX, 0, &dummyState, curCycle, &filterLock, dummyState, srcId, reqFlags, pc, approxType};
+            MemReq req = {pLineAddr, isLoad? GETS : GETX, 0, &dummyState, curCycle, &filterLock, dummyState, srcId, reqFlags | flags, pc, approxType};
             uint64_t respCycle  = access(req);
 
             //Due to the way we do the locking, at this point the old address might be invalidated, but we have the new address guaranteed until we release the lock
 
+            //Pick the entry: the one that has the line for reads (store upgrade), or the set's LRU one
+            FilterEntry* set = &filterArray[idx*filterWays];
+            uint32_t way = 0;
+            if (filterWays > 1) {
+                way = (filterLru[idx] >> 2*(filterWays - 1)) & 0x3;
+                for (uint32_t w = 0; w < filterWays; w++) {
+                    if (set[w].rdAddr == vLineAddr) way = w;
+                }
+                touch(idx, way);
+                evictStaleEntries(idx, way);
+            }
+            FilterEntry& e = set[way];
+
             //Careful with this order
-            Address oldAddr = filterArray[idx].rdAddr;
-            filterArray[idx].wrAddr = isLoad? -1L : vLineAddr;
-            filterArray[idx].rdAddr = vLineAddr;
+            Address oldAddr = e.rdAddr;
+            e.wrAddr = isLoad? -1L : vLineAddr;
+            e.rdAddr = vLineAddr;
 
             //For LSU simulation purposes, loads bypass stores even to the same line if there is no conflict,
             //(e.g., st to x, ld from x+8) and we implement store-load forwarding at the core.
             //So if this is a load, it always sets availCycle; if it is a store hit, it doesn't
-            if (oldAddr != vLineAddr) filterArray[idx].availCycle = respCycle;
+            if (oldAddr != vLineAddr) e.availCycle = respCycle;
 
             futex_unlock(&filterLock);
             return respCycle;
@@ -153,20 +244,85 @@ class FilterCache : public Cache {
             Cache::startInvalidate();  // grabs cache's downLock
             futex_lock(&filterLock);
             uint32_t idx = req.lineAddr & setMask; //works because of how virtual<->physical is done...
-            if ((filterArray[idx].rdAddr | procMask) == req.lineAddr) { //FIXME: If another process calls invalidate(), procMask will not match even though we may be doing a capacity-induced invalidation!
-                filterArray[idx].wrAddr = -1L;
-                filterArray[idx].rdAddr = -1L;
+            for (uint32_t w = 0; w < filterWays; w++) {
+                FilterEntry& e = filterArray[idx*filterWays + w];
+                if ((e.rdAddr | procMask) == req.lineAddr) { //FIXME: If another process calls invalidate(), procMask will not match even though we may be doing a capacity-induced invalidation!
+                    e.wrAddr = -1L;
+                    e.rdAddr = -1L;
+                }
             }
             uint64_t respCycle = Cache::finishInvalidate(req); // releases cache's downLock
+            if (unlikely(req.lineAddr == heldLine) && req.cycle >= heldFrom && respCycle < heldUntil) {
+                //An in-flight RMW holds the line; we answer when it completes
+                if (zinfo->lockContention) zinfo->lockContention->stall(req.lineAddr, heldUntil - respCycle);
+                respCycle = heldUntil;
+            }
             futex_unlock(&filterLock);
             return respCycle;
         }
 
         void contextSwitch() {
             futex_lock(&filterLock);
-            for (uint32_t i = 0; i < numSets; i++) filterArray[i].clear();
+            for (uint32_t i = 0; i < numSets*filterWays; i++) filterArray[i].clear();
+            heldLine = -1L;
             futex_unlock(&filterLock);
         }
+
+    private:
+        // Makes way the MRU of its set; returns its previous LRU position
+        inline uint32_t touch(uint32_t idx, uint32_t way) {
+            uint32_t order = filterLru[idx];
+            uint32_t pos = 0;
+            while (((order >> 2*pos) & 0x3) != way) pos++;
+            uint32_t below = order & ((1 << 2*pos) - 1);  // more recent than way
+            uint32_t above = order & ~((1 << 2*(pos + 1)) - 1);  // less recent than way
+            filterLru[idx] = above | (below << 2) | way;
+            return pos;
+        }
+
+        /* With a single way, the entry we replace is the only one that could
+         * hold a line of this set, so whatever the cache evicted cannot linger
+         * in the filter. With several ways, the other entries must be checked.
+         * Called with filterLock held; the cache array only changes in our
+         * own accesses, so it is stable.
+         */
+        inline void deferTouch(uint32_t entry, bool isStore, uint64_t curCycle) {
+            uint32_t t = (entry << 1) | (isStore? 1 : 0);
+            if (numPendingTouches && pendingTouches[numPendingTouches - 1] == t) return;
+            if (unlikely(numPendingTouches == MAX_PENDING_TOUCHES)) {
+                futex_lock(&filterLock);
+                replayTouches(curCycle);
+                futex_unlock(&filterLock);
+            }
+            pendingTouches[numPendingTouches++] = t;
+        }
+
+        /* Updates the array's replacement state for the deferred hits, in
+         * order. Called with filterLock held. If an entry changed since its
+         * hit, we touch whatever line it holds now, which is in the cache too.
+         */
+        void replayTouches(uint64_t cycle) {
+            for (uint32_t i = 0; i < numPendingTouches; i++) {
+                uint32_t t = pendingTouches[i];
+                Address vLineAddr = filterArray[t >> 1].rdAddr;
+                if (vLineAddr == (Address)-1L || !vLineAddr) continue;  // invalidated
+                MESIState dummyState = MESIState::I;
+                MemReq req = {procMask | vLineAddr, (t & 1)? GETX : GETS, 0, &dummyState, cycle, &filterLock, dummyState, srcId, reqFlags, 0, no_approx};
+                array->lookup(req.lineAddr, &req, true);
+            }
+            numPendingTouches = 0;
+        }
+
+        void evictStaleEntries(uint32_t idx, uint32_t replacedWay) {
+            for (uint32_t w = 0; w < filterWays; w++) {
+                FilterEntry& e = filterArray[idx*filterWays + w];
+                if (w == replacedWay || e.rdAddr == (Address)-1L || !e.rdAddr) continue;
+                if (array->lookup(procMask | e.rdAddr, nullptr, false) == -1) {
+                    e.wrAddr = -1L;
+                    e.rdAddr = -1L;
+                }
+            }
+        }
 };
 
 #endif  // FILTER_CACHE_H_
@@ -33,13 +33,16 @@
 #include <vector>
 #include "cache.h"
 #include "cache_arrays.h"
+#include "compressed_mem.h"
 #include "config.h"
 #include "constants.h"
 #include "contention_sim.h"
 #include "core.h"
 #include "detailed_mem.h"
 #include "detailed_mem_params.h"
+#include "dram_cache.h"
 #include "ddr_mem.h"
+#include "ddr_sched.h"
 #include "debug_zsim.h"
 #include "dramsim_mem_ctrl.h"
 #include "event_queue.h"
@@ -47,9 +50,11 @@
 #include "galloc.h"
 #include "hash.h"
 #include "ideal_arrays.h"
+#include "lock_contention.h"
 #include "locks.h"
 #include "log.h"
 #include "mem_ctrls.h"
+#include "mesh_network.h"
 #include "network.h"
 #include "null_core.h"
 #include "ooo_core.h"
@@ -63,6 +68,7 @@
 #include "profile_stats.h"
 #include "repl_policies.h"
 #include "scheduler.h"
+#include "sectored_array.h"
 #include "simple_core.h"
 #include "stats.h"
 #include "stats_filter.h"
@@ -85,10 +91,25 @@ extern void EndOfPhaseActions(); //in zsim.cpp
 
 BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name, uint32_t bankSize, bool isTerminal, uint32_t domain) {
     string type = config.get<const char*>(prefix + "type", "Simple");
+
+    // Coherence protocol, must be the same across the hierarchy
+    string protocolType = config.get<const char*>("sys.caches.protocol", "MESI");
+    CoherenceProtocol protocol;
+    if (protocolType == "MESI") {
+        protocol = PROTO_MESI;
+    } else if (protocolType == "MOESI") {
+        protocol = PROTO_MOESI;
+    } else if (protocolType == "MESIF") {
+        protocol = PROTO_MESIF;
+    } else {
+        panic("Invalid coherence protocol %s", protocolType.c_str());
+    }
+
     // Shortcut for TraceDriven type
     if (type == "TraceDriven") {
         assert(zinfo->traceDriven);
         assert(isTerminal);
+        if (protocol != PROTO_MESI) panic("%s: Trace-driven caches only support the MESI protocol", name.c_str());
         return new TraceDriverProxyCache(name);
     }
 
@@ -103,9 +124,10 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
     uint32_t ways = config.get<uint32_t>(prefix + "array.ways", 4);
     string arrayType = config.get<const char*>(prefix + "array.type", "SetAssoc");
     uint32_t candidates = (arrayType == "Z")? config.get<uint32_t>(prefix + "array.candidates", 16) : ways;
+    uint32_t sectorLines = (arrayType == "Sectored")? config.get<uint32_t>(prefix + "array.sectorLines", 4) : 1;
 
     //Need to know number of hash functions before instantiating array
-    if (arrayType == "SetAssoc") {
+    if (arrayType == "SetAssoc" || arrayType == "Sectored") {
         numHashes = 1;
     } else if (arrayType == "Z") {
         numHashes = ways;
@@ -118,7 +140,8 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
     }
 
     // Power of two sets check; also compute setBits, will be useful later
-    uint32_t numSets = numLines/ways;
+    if (!isPow2(sectorLines) || sectorLines > 64) panic("%s: array.sectorLines must be a power of 2 <= 64 (you specified %d)", name.c_str(), sectorLines);
+    uint32_t numSets = numLines/(ways*sectorLines);
     uint32_t setBits = 31 - __builtin_clz(numSets);
     if ((1u << setBits) != numSets) panic("%s: Number of sets must be a power of two (you specified %d sets)", name.c_str(), numSets);
 
@@ -165,12 +188,17 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         rp = new NRUReplPolicy(numLines, candidates);
     } else if (replType == "Rand") {
         rp = new RandReplPolicy(candidates);
-    } else if (replType == "SRRIP") {
-        // max value of RRPV, you need to pass it to your SRRIP constructor
+    } else if (replType == "SRRIP" || replType == "BRRIP" || replType == "DRRIP") {
+        // max value of RRPV (2^M - 1 for M-bit RRPVs)
         uint32_t rpvMax = config.get<uint32_t>(prefix + "repl.rpvMax", 3);
-        assert(isPow2(rpvMax + 1));
-        // add your SRRIP construction code here
-
+        if (!rpvMax || !isPow2(rpvMax + 1) || rpvMax > 255) panic("%s: repl.rpvMax must be 2^M - 1 and <= 255, %d given", name.c_str(), rpvMax);
+        if (replType == "SRRIP") {
+            rp = new SRRIPReplPolicy(numLines, rpvMax);
+        } else if (replType == "BRRIP") {
+            rp = new BRRIPReplPolicy(numLines, rpvMax);
+        } else {
+            rp = new DRRIPReplPolicy(numLines, ways, rpvMax);
+        }
     } else if (replType == "WayPart" || replType == "Vantage" || replType == "IdealLRUPart") {
         if (replType == "WayPart" && arrayType != "SetAssoc") panic("WayPart replacement requires SetAssoc array");
 
@@ -242,6 +270,10 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         array = new SetAssocArray(numLines, ways, rp, hf);
     } else if (arrayType == "Z") {
         array = new ZArray(numLines, ways, candidates, rp, hf);
+    } else if (arrayType == "Sectored") {
+        SectoredArray* sa = new SectoredArray(numLines, ways, sectorLines, rp, hf);
+        rp = sa->getRP();
+        array = sa;
     } else if (arrayType == "IdealLRU") {
         assert(replType == "LRU");
         assert(!hf);
@@ -265,14 +297,61 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
     // Inclusion?
     bool nonInclusiveHack = config.get<bool>(prefix + "nonInclusiveHack", false);
     if (nonInclusiveHack) assert(type == "Simple" && !isTerminal);
+    if (nonInclusiveHack && protocol != PROTO_MESI) panic("%s: nonInclusiveHack only works with the MESI protocol", name.c_str());
+    // Inclusion policy for last-level caches; see InclusionPolicy in coherence_ctrls.h
+    string inclusionType = config.get<const char*>(prefix + "inclusion", "Inclusive");
+    InclusionPolicy inclusion;
+    if (inclusionType == "Inclusive") {
+        inclusion = INCLUSIVE;
+    } else if (inclusionType == "NonInclusive") {
+        inclusion = NON_INCLUSIVE;
+    } else if (inclusionType == "Exclusive") {
+        inclusion = EXCLUSIVE;
+    } else {
+        panic("%s: Invalid inclusion policy %s", name.c_str(), inclusionType.c_str());
+    }
+    if (inclusion != INCLUSIVE) {
+        if (nonInclusiveHack) panic("%s: inclusion and nonInclusiveHack are mutually exclusive", name.c_str());
+        if (isTerminal) panic("%s: Terminal caches have no children, inclusion does not apply", name.c_str());
+        if (type != "Simple") panic("%s: Non-inclusive and exclusive caches only support type == Simple", name.c_str());
+    }
 
     // Finally, build the cache
     Cache* cache;
     CC* cc;
     if (isTerminal) {
-        cc = new MESITerminalCC(numLines, name);
+        switch (protocol) {
+            case PROTO_MESI: cc = new MESITerminalCC<PROTO_MESI>(numLines, name); break;
+            case PROTO_MOESI: cc = new MESITerminalCC<PROTO_MOESI>(numLines, name); break;
+            case PROTO_MESIF: cc = new MESITerminalCC<PROTO_MESIF>(numLines, name); break;
+            default: panic("!?");
+        }
     } else {
-        cc = new MESICC(numLines, nonInclusiveHack, name);
+        // Sharer tracking
+        DirConfig dirConfig;
+        string sharersType = config.get<const char*>(prefix + "directory.sharers", "FullMap");
+        if (sharersType == "FullMap") {
+            dirConfig.format = FULL_MAP;
+        } else if (sharersType == "LimitedPtr") {
+            dirConfig.format = LIMITED_PTR;
+        } else if (sharersType == "CoarseVector") {
+            dirConfig.format = COARSE_VECTOR;
+        } else {
+            panic("%s: Invalid directory.sharers type %s", name.c_str(), sharersType.c_str());
+        }
+        dirConfig.pointers = config.get<uint32_t>(prefix + "directory.pointers", 4);
+        dirConfig.groupSize = config.get<uint32_t>(prefix + "directory.groupSize", 4);
+        // 0 -> one entry per line (in-cache directory); otherwise, a sparse directory of this many entries per bank
+        dirConfig.sparseEntries = config.get<uint32_t>(prefix + "directory.sparseEntries", 0);
+        dirConfig.sparseWays = config.get<uint32_t>(prefix + "directory.sparseWays", 8);
+        // Non-inclusive/exclusive caches need a sparse directory; by default, with 2x coverage of the bank
+        if (inclusion != INCLUSIVE && dirConfig.sparseEntries == 0) dirConfig.sparseEntries = 2*numLines;
+        switch (protocol) {
+            case PROTO_MESI: cc = new MESICC<PROTO_MESI>(numLines, nonInclusiveHack, inclusion, dirConfig, name); break;
+            case PROTO_MOESI: cc = new MESICC<PROTO_MOESI>(numLines, nonInclusiveHack, inclusion, dirConfig, name); break;
+            case PROTO_MESIF: cc = new MESICC<PROTO_MESIF>(numLines, nonInclusiveHack, inclusion, dirConfig, name); break;
+            default: panic("!?");
+        }
     }
     rp->setCC(cc);
     if (!isTerminal) {
@@ -280,9 +359,11 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
             cache = new Cache(numLines, cc, array, rp, accLat, invLat, name);
         } else if (type == "Timing") {
             uint32_t mshrs = config.get<uint32_t>(prefix + "mshrs", 16);
+            uint32_t mshrTargets = config.get<uint32_t>(prefix + "mshrTargets", 0); //secondary misses per MSHR; 0 (default) disables coalescing
+            uint32_t wbEntries = config.get<uint32_t>(prefix + "writeBuffer", 0); //PUTX write buffer entries; 0 disables it
             uint32_t tagLat = config.get<uint32_t>(prefix + "tagLat", 5);
             uint32_t timingCandidates = config.get<uint32_t>(prefix + "timingCandidates", candidates);
-            cache = new TimingCache(numLines, cc, array, rp, accLat, invLat, mshrs, tagLat, ways, timingCandidates, domain, name);
+            cache = new TimingCache(numLines, cc, array, rp, accLat, invLat, mshrs, mshrTargets, wbEntries, tagLat, ways, timingCandidates, domain, name);
         } else if (type == "Tracing") {
             g_string traceFile = config.get<const char*>(prefix + "traceFile","");
             if (traceFile.empty()) traceFile = g_string(zinfo->outputDir) + "/" + name + ".trace";
@@ -294,7 +375,12 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
         //Filter cache optimization
         if (type != "Simple") panic("Terminal cache %s can only have type == Simple", name.c_str());
         if (arrayType != "SetAssoc" || hashType != "None" || replType != "LRU") panic("Invalid FilterCache config %s", name.c_str());
-        cache = new FilterCache(numSets, numLines, cc, array, rp, accLat, invLat, name);
+        // Lines per set replicated in the filter; more ways avoid ping-ponging between aliasing lines
+        uint32_t filterWays = config.get<uint32_t>(prefix + "filterWays", 1);
+        if ((filterWays != 1 && filterWays != 2 && filterWays != 4) || filterWays > ways) {
+            panic("%s: filterWays must be 1, 2 or 4, and at most the cache's ways (%d given)", name.c_str(), filterWays);
+        }
+        cache = new FilterCache(numSets, numLines, cc, array, rp, accLat, invLat, name, filterWays);
     }
 
 #if 0
@@ -307,15 +393,21 @@ BaseCache* BuildCacheBank(Config& config, const string& prefix, g_string& name,
 
 // NOTE: frequency is SYSTEM frequency; mem freq specified in tech
 DDRMemory* BuildDDRMemory(Config& config, uint32_t lineSize, uint32_t frequency, uint32_t domain, g_string name, const string& prefix) {
-    uint32_t ranksPerChannel = config.get<uint32_t>(prefix + "ranksPerChannel", 4);
-    uint32_t banksPerRank = config.get<uint32_t>(prefix + "banksPerRank", 8);  // DDR3 std is 8
-    uint32_t pageSize = config.get<uint32_t>(prefix + "pageSize", 8*1024);  // 1Kb cols, x4 devices
     const char* tech = config.get<const char*>(prefix + "tech", "DDR3-1333-CL10");  // see cpp file for other techs
+    uint32_t techRanks, techBanks;  // e.g., DDR3 has 8 banks/rank, DDR4 16 (in 4 bank groups)
+    DDRMemory::getTechGeometry(tech, techRanks, techBanks);
+    uint32_t ranksPerChannel = config.get<uint32_t>(prefix + "ranksPerChannel", techRanks);
+    uint32_t banksPerRank = config.get<uint32_t>(prefix + "banksPerRank", techBanks);
+    uint32_t pageSize = config.get<uint32_t>(prefix + "pageSize", 8*1024);  // 1Kb cols, x4 devices
     const char* addrMapping = config.get<const char*>(prefix + "addrMapping", "rank:col:bank");  // address splitter interleaves channels; row always on top
+    // Hash rank/bank bits with row bits to avoid bank conflicts on strided accesses: None, Permutation or XORFold
+    AddrMapper::HashType addrHash = AddrMapper::parseHash(config.get<const char*>(prefix + "addrHash", "None"));
 
     // If set, writes are deferred and bursted out to reduce WTR overheads
     bool deferWrites = config.get<bool>(prefix + "deferWrites", true);
     bool closedPage = config.get<bool>(prefix + "closedPage", true);
+    // Idle memCycles before a rank enters power-down (and then pays tXP to wake up); 0 disables power-down
+    uint32_t powerDownIdle = config.get<uint32_t>(prefix + "powerDownIdle", 0);
 
     // Max row hits before we stop prioritizing further row hits to this bank.
     // Balances throughput and fairness; 0 -> FCFS / high (e.g., -1) -> pure FR-FCFS
@@ -325,8 +417,29 @@ DDRMemory* BuildDDRMemory(Config& config, uint32_t lineSize, uint32_t frequency,
     uint32_t queueDepth = config.get<uint32_t>(prefix + "queueDepth", 16);
     uint32_t controllerLatency = config.get<uint32_t>(prefix + "controllerLatency", 10);  // in system cycles
 
+    // Scheduling policy: FRFCFS (capped by maxRowHits), BLISS, ATLAS or PARBS
+    string scheduler = config.get<const char*>(prefix + "scheduler", "FRFCFS");
+    uint32_t schedCores = std::max(1u, zinfo->numCores);
+    DDRSchedPolicy* sched = nullptr;
+    if (scheduler == "BLISS") {
+        uint32_t threshold = config.get<uint32_t>(prefix + "bliss.threshold", 4);
+        uint32_t clearInterval = config.get<uint32_t>(prefix + "bliss.clearInterval", 10000);  // in memCycles
+        sched = new BLISSSchedPolicy(schedCores, threshold, clearInterval);
+    } else if (scheduler == "ATLAS") {
+        uint32_t quantum = config.get<uint32_t>(prefix + "atlas.quantum", 1000000);  // in memCycles
+        uint32_t starvationThreshold = config.get<uint32_t>(prefix + "atlas.starvationThreshold", 100000);  // in memCycles
+        if (!quantum) panic("%s: ATLAS quantum must be > 0", name.c_str());
+        sched = new ATLASSchedPolicy(schedCores, quantum, starvationThreshold);
+    } else if (scheduler == "PARBS") {
+        uint32_t markingCap = config.get<uint32_t>(prefix + "parbs.markingCap", 5);
+        if (!markingCap) panic("%s: PAR-BS markingCap must be > 0", name.c_str());
+        sched = new PARBSSchedPolicy(schedCores, ranksPerChannel, banksPerRank, markingCap);
+    } else if (scheduler != "FRFCFS") {
+        panic("%s: Invalid scheduler %s (FRFCFS, BLISS, ATLAS or PARBS)", name.c_str(), scheduler.c_str());
+    }
+
     auto mem = new DDRMemory(zinfo->lineSize, pageSize, ranksPerChannel, banksPerRank, frequency, tech,
-            addrMapping, controllerLatency, queueDepth, maxRowHits, deferWrites, closedPage, domain, name);
+            addrMapping, addrHash, controllerLatency, queueDepth, maxRowHits, deferWrites, closedPage, powerDownIdle, domain, name, sched);
     return mem;
 }
 
@@ -353,6 +466,11 @@ MemObject* BuildMemoryController(Config& config, uint32_t lineSize, uint32_t fre
         uint32_t bandwidth = config.get<uint32_t>("sys.mem.bandwidth", 6400);
         uint32_t boundLatency = config.get<uint32_t>("sys.mem.boundLatency", latency);
         mem = new WeaveMD1Memory(lineSize, frequency, bandwidth, latency, boundLatency, domain, name);
+    } else if (type == "WeaveBW") {
+        // Like WeaveMD1, but queues requests on per-channel data buses in the weave phase, so it sees bursts within a phase
+        uint32_t bandwidth = config.get<uint32_t>("sys.mem.bandwidth", 6400);  // total, in MB/s
+        uint32_t channels = config.get<uint32_t>("sys.mem.channels", 1);
+        mem = new WeaveBWMemory(lineSize, frequency, bandwidth, channels, latency, domain, name);
     } else if (type == "WeaveSimple") {
         uint32_t boundLatency = config.get<uint32_t>("sys.mem.boundLatency", 100);
         mem = new WeaveSimpleMemory(latency, boundLatency, domain, name);
@@ -440,9 +558,34 @@ static void InitSystem(Config& config) {
         return cVec;
     };
 
-    // If a network file is specified, build a Network
+    // Build the network, if any. Fixed networks read their delays from a file (the default if a network file is
+    // specified); meshes and tori model a 2D network-on-chip with link contention
     string networkFile = config.get<const char*>("sys.networkFile", "");
-    Network* network = (networkFile != "")? new Network(networkFile.c_str()) : nullptr;
+    string networkType = config.get<const char*>("sys.network.type", (networkFile != "")? "Fixed" : "None");
+    Network* network = nullptr;
+    MeshNetwork* mesh = nullptr;
+    if (networkType == "Fixed") {
+        if (networkFile == "") panic("Fixed network needs a network description file (sys.networkFile)");
+        network = new FixedNetwork(networkFile.c_str());
+    } else if (networkType == "Mesh" || networkType == "Torus") {
+        uint32_t dimX = config.get<uint32_t>("sys.network.dimX");
+        uint32_t dimY = config.get<uint32_t>("sys.network.dimY");
+        uint32_t routerDelay = config.get<uint32_t>("sys.network.routerDelay", 2);
+        uint32_t linkDelay = config.get<uint32_t>("sys.network.linkDelay", 1);
+        uint32_t linkBytes = config.get<uint32_t>("sys.network.linkBytes", 16);  // per cycle, i.e., the flit size
+        string routing = config.get<const char*>("sys.network.routing", "XY");
+        uint32_t domain = config.get<uint32_t>("sys.network.domain", 0);
+        if (!dimX || !dimY) panic("Invalid %s dimensions %dx%d", networkType.c_str(), dimX, dimY);
+        if (routerDelay + linkDelay == 0) panic("Network router and link delays can't both be 0");
+        if (!linkBytes) panic("Network links must transfer at least 1 byte/cycle");
+        if (routing != "XY" && routing != "Adaptive") panic("Invalid network routing %s, must be XY or Adaptive", routing.c_str());
+        if (domain >= zinfo->numDomains) panic("Invalid network domain %d, there are %d domains", domain, zinfo->numDomains);
+        mesh = new MeshNetwork(dimX, dimY, networkType == "Torus", routing == "Adaptive", routerDelay, linkDelay,
+                linkBytes, zinfo->lineSize, domain);
+        network = mesh;
+    } else if (networkType != "None") {
+        panic("Invalid network type %s", networkType.c_str());
+    }
 
     // Build the caches
     vector<const char*> cacheGroupNames;
@@ -516,15 +659,75 @@ static void InitSystem(Config& config) {
         mems[i] = BuildMemoryController(config, zinfo->lineSize, zinfo->freqMHz, domain, name);
     }
 
+    // Memory compression: lines shrink by a per-data-type ratio (exact data, or approx uint/fp regions),
+    // and controllers that model their data bus transfer fewer bytes
+    if (config.get<bool>("sys.mem.compressed", false)) {
+        double ratios[type_max + 1];
+        ratios[no_approx] = config.get<double>("sys.mem.compression.exactRatio", 1.0);
+        ratios[approx_uint] = config.get<double>("sys.mem.compression.uintRatio", 2.0);
+        ratios[approx_fp] = config.get<double>("sys.mem.compression.fpRatio", 1.0);
+        for (uint32_t i = 0; i < memControllers; i++) {
+            string compName = string(mems[i]->getName()) + "-comp";
+            mems[i] = new CompressedMemory(mems[i], zinfo->lineSize, ratios, compName.c_str());
+        }
+    }
+
+    // Stacked DRAM cache in front of each controller. Its capacity is split across controllers, and its
+    // data array is a DDRMemory configured under sys.mem.dramCache.array (e.g., array.tech = "HBM2-2000")
+    uint32_t dcSizeMB = config.get<uint32_t>("sys.mem.dramCache.sizeMB", 0);
+    if (dcSizeMB) {
+        string dcOrg = config.get<const char*>("sys.mem.dramCache.organization", "Alloy");
+        DRAMCache::Organization org;
+        uint32_t ways, tagLatency;
+        if (dcOrg == "Alloy") {
+            org = DRAMCache::ALLOY;
+            ways = 1;
+            tagLatency = 0;
+        } else if (dcOrg == "SetAssoc") {
+            org = DRAMCache::SET_ASSOC;
+            ways = config.get<uint32_t>("sys.mem.dramCache.ways", 16);
+            tagLatency = config.get<uint32_t>("sys.mem.dramCache.tagLatency", 10);
+        } else {
+            panic("Invalid DRAM cache organization %s (Alloy or SetAssoc)", dcOrg.c_str());
+        }
+        uint32_t numLines = ((uint64_t)dcSizeMB << 20)/zinfo->lineSize/memControllers;
+
+        for (uint32_t i = 0; i < memControllers; i++) {
+            string dcName = string(mems[i]->getName()) + "-dramcache";
+            g_string arrayName((dcName + "-array").c_str());
+            uint32_t domain = i*zinfo->numDomains/memControllers;
+            MemObject* dcArray = BuildDDRMemory(config, zinfo->lineSize, zinfo->freqMHz, domain, arrayName, "sys.mem.dramCache.array.");
+            mems[i] = new DRAMCache(dcArray, mems[i], org, numLines, ways, tagLatency, dcName.c_str());
+        }
+    }
+
+    // Spread each cache group and the memory controllers over the network's tiles
+    if (mesh) {
+        for (const char* grp : cacheGroupNames) {
+            vector<string> names;
+            for (vector<BaseCache*>& banks : *cMap[grp]) for (BaseCache* bank : banks) names.push_back(bank->getName());
+            mesh->addNodes(names);
+        }
+        vector<string> memNames;
+        for (MemObject* mem : mems) memNames.push_back(mem->getName());
+        mesh->addNodes(memNames);
+    }
+
     if (memControllers > 1) {
         bool splitAddrs = config.get<bool>("sys.mem.splitAddrs", true);
         if (splitAddrs) {
-            MemObject* splitter = new SplitAddrMemory(mems, "mem-splitter");
+            // Lines per channel before moving to the next one, and channel hash (None, Permutation or XORFold)
+            uint32_t interleave = config.get<uint32_t>("sys.mem.splitInterleave", 1);
+            AddrMapper::HashType hash = AddrMapper::parseHash(config.get<const char*>("sys.mem.splitHash", "None"));
+            MemObject* splitter = new SplitAddrMemory(mems, "mem-splitter", interleave, hash);
             mems.resize(1);
             mems[0] = splitter;
         }
     }
 
+    // All network nodes are known, so resolve RTTs between them once
+    if (network) network->finalize();
+
     //Connect everything
     bool printHierarchy = config.get<bool>("sim.printHierarchy", false);
 
@@ -632,13 +835,44 @@ static void InitSystem(Config& config) {
             string prefix = string("sys.cores.") + group + ".";
             uint32_t cores = config.get<uint32_t>(prefix + "cores", 1);
             string type = config.get<const char*>(prefix + "type", "Simple");
-            string automaton = config.get<const char*>(prefix + "automaton", "A2");
+
+            OOOCoreParams oooParams;
+            if (type == "OOO") {
+                //Defaults model Nehalem
+                oooParams.robSize = config.get<uint32_t>(prefix + "rob", 128);
+                oooParams.retireWidth = config.get<uint32_t>(prefix + "retireWidth", 4);
+                oooParams.iwSize = config.get<uint32_t>(prefix + "iw", 36);
+                oooParams.lqSize = config.get<uint32_t>(prefix + "lq", 32);
+                oooParams.sqSize = config.get<uint32_t>(prefix + "sq", 32);
+                oooParams.uopQueueSize = config.get<uint32_t>(prefix + "uopQueue", 28);
+                oooParams.issueWidth = config.get<uint32_t>(prefix + "issueWidth", 4);
+                oooParams.rfReadsPerCycle = config.get<uint32_t>(prefix + "rfReads", 3);
+
+                string bp = config.get<const char*>(prefix + "branchPredictor", "PAg");
+                if (bp == "PAg") {
+                    string automaton = config.get<const char*>(prefix + "automaton", "A2");
+                    if (automaton == "A2") oooParams.branchPredictor = BP_PAG_A2;
+                    else if (automaton == "A3") oooParams.branchPredictor = BP_PAG_A3;
+                    else panic("%s: Invalid branch predictor automaton %s", group, automaton.c_str());
+                } else if (bp == "GShare") {
+                    oooParams.branchPredictor = BP_GSHARE;
+                } else if (bp == "TAGE") {
+                    oooParams.branchPredictor = BP_TAGE;
+                } else if (bp == "Perceptron") {
+                    oooParams.branchPredictor = BP_PERCEPTRON;
+                } else {
+                    panic("%s: Invalid branch predictor %s", group, bp.c_str());
+                }
+                if (!oooParams.robSize || !oooParams.retireWidth || !oooParams.iwSize || !oooParams.lqSize ||
+                        !oooParams.sqSize || !oooParams.uopQueueSize || !oooParams.issueWidth || !oooParams.rfReadsPerCycle) {
+                    panic("%s: OOO core structure sizes and widths must be non-zero", group);
+                }
+            }
 
             //Build the core group
             union {
                 SimpleCore* simpleCores;
                 TimingCore* timingCores;
-                OOOCore* oooCores;
                 NullCore* nullCores;
             };
             if (type == "Simple") {
@@ -646,7 +880,7 @@ static void InitSystem(Config& config) {
             } else if (type == "Timing") {
                 timingCores = gm_memalign<TimingCore>(CACHE_LINE_BYTES, cores);
             } else if (type == "OOO") {
-                oooCores = gm_memalign<OOOCore>(CACHE_LINE_BYTES, cores);
+                //OOO cores are allocated individually, since their size depends on their parameters
                 zinfo->oooDecode = true; //enable uop decoding, this is false by default, must be true if even one OOO cpu is in the system
             } else if (type == "Null") {
                 nullCores = gm_memalign<NullCore>(CACHE_LINE_BYTES, cores);
@@ -699,11 +933,10 @@ static void InitSystem(Config& config) {
                         core = tcore;
                     } else {
                         assert(type == "OOO");
-                        OOOCore* ocore = new (&oooCores[j]) OOOCore(ic, dc, name);
+                        OOOCore* ocore = BuildOOOCore(ic, dc, name, oooParams);
                         zinfo->eventRecorders[coreIdx] = ocore->getEventRecorder();
                         zinfo->eventRecorders[coreIdx]->setSourceId(coreIdx);
                         core = ocore;
-                        if (automaton == "A3") ocore->useA3forBranchPred();
                     }
                     coreMap[group].push_back(core);
                     coreIdx++;
@@ -780,6 +1013,8 @@ static void InitSystem(Config& config) {
     for (auto mem : mems) mem->initStats(memStat);
     zinfo->rootStat->append(memStat);
 
+    if (network) network->initStats(zinfo->rootStat);
+
     //Odds and ends: BuildCacheGroup new'd the cache groups, we need to delete them
     for (pair<string, CacheGroup*> kv : cMap) delete kv.second;
     cMap.clear();
@@ -911,7 +1146,13 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
 
     zinfo->numDomains = config.get<uint32_t>("sim.domains", 1);
     uint32_t numSimThreads = config.get<uint32_t>("sim.contentionThreads", MAX((uint32_t)1, zinfo->numDomains/2)); //gives a bit of parallelism, TODO tune
-    zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads);
+    bool contentionStealing = config.get<bool>("sim.contentionStealing", true); //idle weave threads steal domains from busy ones
+    string weaveQueue = config.get<const char*>("sim.weaveQueue", "Map"); //far-event engine of weave-phase queues
+    PQFarEngine farEngine = PQ_FAR_MAP;
+    if (weaveQueue == "Map") farEngine = PQ_FAR_MAP;
+    else if (weaveQueue == "Wheel") farEngine = PQ_FAR_WHEEL;
+    else panic("Invalid sim.weaveQueue %s, must be Map or Wheel", weaveQueue.c_str());
+    zinfo->contentionSim = new ContentionSim(zinfo->numDomains, numSimThreads, contentionStealing, farEngine);
     zinfo->contentionSim->initStats(zinfo->rootStat);
     zinfo->eventRecorders = gm_calloc<EventRecorder*>(zinfo->numCores);
 
@@ -995,6 +1236,10 @@ void SimInit(const char* configFile, const char* outputDir, uint32_t shmid) {
 
     zinfo->processStats = new ProcessStats(zinfo->rootStat);
 
+    //Atomic RMW contention profiling (top-N hot lines); off by default
+    uint32_t rmwHotLines = config.get<uint32_t>("sim.rmwHotLines", 0);
+    zinfo->lockContention = (rmwHotLines && !zinfo->traceDriven)? new LockContention(rmwHotLines, zinfo->rootStat) : nullptr;
+
     const char* procStatsFilter = config.get<const char*>("sim.procStatsFilter", "");
     if (strlen(procStatsFilter)) {
         zinfo->procStats = new ProcStats(zinfo->rootStat, FilterStats(zinfo->rootStat, procStatsFilter));
@@ -0,0 +1,158 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lock_contention.h"
+#include "zsim.h"
+
+LockContention::LockContention(uint32_t _numHotLines, AggregateStat* parentStat) : numHotLines(_numHotLines), lastUpdatePhase(-1L) {
+    assert(numHotLines > 0);
+    shards = gm_calloc<Shard>(NUM_SHARDS);
+    for (uint32_t s = 0; s < NUM_SHARDS; s++) {
+        new (&shards[s].lines) g_unordered_map<Address, LineInfo>();
+        futex_init(&shards[s].lock);
+    }
+    owners = gm_calloc<uint64_t>(1 << OWNER_BITS);
+
+    AggregateStat* rmwStat = new AggregateStat();
+    rmwStat->init("rmw", "Atomic read-modify-write contention stats");
+    profAcquisitions.init("acq", "RMW line acquisitions");
+    profPingPongs.init("pingPongs", "RMW acquisitions of a line last acquired by another core");
+    profStalls.init("stalls", "Invalidations/downgrades that waited on a line held by an RMW");
+    profStallCycles.init("stallCycles", "Cycles invalidations/downgrades waited on lines held by RMWs");
+    profUntracked.init("untracked", "Ping-pongs/stalls on lines left out of the per-line table because it was full");
+    rmwStat->append(&profAcquisitions);
+    rmwStat->append(&profPingPongs);
+    rmwStat->append(&profStalls);
+    rmwStat->append(&profStallCycles);
+    rmwStat->append(&profUntracked);
+
+    auto lineStat = makeLambdaVectorStat([this](uint32_t i) { return hotLineStat(i, 0); }, numHotLines);
+    lineStat->init("hotLine", "Top lines by RMW ping-pongs: line address");
+    auto acqStat = makeLambdaVectorStat([this](uint32_t i) { return hotLineStat(i, 1); }, numHotLines);
+    acqStat->init("hotAcq", "Top lines by RMW ping-pongs: acquisitions");
+    auto ppStat = makeLambdaVectorStat([this](uint32_t i) { return hotLineStat(i, 2); }, numHotLines);
+    ppStat->init("hotPingPongs", "Top lines by RMW ping-pongs: ping-pongs");
+    auto stallStat = makeLambdaVectorStat([this](uint32_t i) { return hotLineStat(i, 3); }, numHotLines);
+    stallStat->init("hotStallCycles", "Top lines by RMW ping-pongs: stall cycles");
+    rmwStat->append(lineStat);
+    rmwStat->append(acqStat);
+    rmwStat->append(ppStat);
+    rmwStat->append(stallStat);
+    parentStat->append(rmwStat);
+}
+
+LockContention::LineInfo* LockContention::getLine(Shard& s, Address lineAddr) {
+    auto it = s.lines.find(lineAddr);
+    if (it != s.lines.end()) return &it->second;
+    if (s.lines.size() >= MAX_LINES/NUM_SHARDS) {
+        profUntracked.atomicInc();
+        return nullptr;
+    }
+    LineInfo li = {0, 0, 0};
+    return &(s.lines[lineAddr] = li);
+}
+
+void LockContention::acquire(Address lineAddr, uint32_t coreId) {
+    profAcquisitions.atomicInc();
+
+    // Multiplicative hash: the high bits depend on all bits of lineAddr (including the process mask)
+    uint64_t hash = lineAddr * 0x9E3779B97F4A7C15uL;
+    volatile uint64_t* slot = &owners[hash >> (64 - OWNER_BITS)];
+    uint64_t owner = (hash & LINE_MASK) | (coreId & CORE_MASK);
+    uint64_t prev;
+    bool sameLine;
+    do {
+        prev = *slot;
+        sameLine = ((prev ^ owner) & LINE_MASK) == 0;
+    } while (!__sync_bool_compare_and_swap(slot, prev, owner | (sameLine? (prev & TRACKED) : 0)));
+
+    bool pingPong = sameLine && (prev & CORE_MASK) != (owner & CORE_MASK);
+    bool tracked = sameLine && (prev & TRACKED);
+    if (pingPong) profPingPongs.atomicInc();
+    if (!pingPong && !tracked) return;  // the common, uncontended case
+
+    Shard& s = getShard(lineAddr);
+    futex_lock(&s.lock);
+    LineInfo* li;
+    if (pingPong) {
+        li = getLine(s, lineAddr);
+    } else {
+        auto it = s.lines.find(lineAddr);
+        li = (it != s.lines.end())? &it->second : nullptr;
+    }
+    if (li) {
+        li->acquisitions++;
+        if (pingPong) li->pingPongs++;
+        if (!tracked) __sync_bool_compare_and_swap(slot, owner, owner | TRACKED);  // unless someone took the slot since
+    }
+    futex_unlock(&s.lock);
+}
+
+void LockContention::stall(Address lineAddr, uint64_t cycles) {
+    Shard& s = getShard(lineAddr);
+    futex_lock(&s.lock);
+    LineInfo* li = getLine(s, lineAddr);
+    if (li) li->stallCycles += cycles;
+    futex_unlock(&s.lock);
+    profStalls.atomicInc();
+    profStallCycles.atomicInc(cycles);
+}
+
+void LockContention::update() {
+    if (lastUpdatePhase == zinfo->numPhases) return;
+    lastUpdatePhase = zinfo->numPhases;
+
+    //Insertion into a small sorted array; N is small and most lines don't make it
+    hotLines.clear();
+    for (uint32_t i = 0; i < NUM_SHARDS; i++) {
+        Shard& s = shards[i];
+        futex_lock(&s.lock);
+        for (auto& kv : s.lines) {
+            const LineInfo& li = kv.second;
+            auto better = [&li](const std::pair<Address, LineInfo>& h) {
+                return (li.pingPongs > h.second.pingPongs) ||
+                    (li.pingPongs == h.second.pingPongs && li.acquisitions > h.second.acquisitions);
+            };
+            if (hotLines.size() == numHotLines && !better(hotLines.back())) continue;
+            uint32_t pos = hotLines.size();
+            while (pos > 0 && better(hotLines[pos-1])) pos--;
+            hotLines.insert(hotLines.begin() + pos, std::make_pair(kv.first, li));
+            if (hotLines.size() > numHotLines) hotLines.pop_back();
+        }
+        futex_unlock(&s.lock);
+    }
+}
+
+uint64_t LockContention::hotLineStat(uint32_t idx, uint32_t field) {
+    update();
+    if (idx >= hotLines.size()) return 0;
+    const std::pair<Address, LineInfo>& h = hotLines[idx];
+    switch (field) {
+        case 0: return h.first;
+        case 1: return h.second.acquisitions;
+        case 2: return h.second.pingPongs;
+        default: return h.second.stallCycles;
+    }
+}
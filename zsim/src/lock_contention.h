@@ -0,0 +1,100 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOCK_CONTENTION_H_
+#define LOCK_CONTENTION_H_
+
+#include "g_std/g_unordered_map.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+#include "locks.h"
+#include "memory_hierarchy.h"
+#include "stats.h"
+
+/* Profiles contention on lines accessed by atomic read-modify-writes
+ * (LOCK-prefixed instructions). Counts acquisitions, ping-pongs
+ * (acquisitions by a different core than the previous one), and the cycles
+ * that other cores' requests waited while a line was held by an RMW.
+ * Reports totals, plus the top-N lines by ping-pongs.
+ *
+ * Every RMW goes through a lock-free, direct-mapped table of last owners,
+ * which detects ping-pongs without locking or allocating. Only lines that
+ * ping-pong or stall other cores get per-line entries, and the per-line table
+ * is capped at MAX_LINES; once it fills up, new lines only count towards the
+ * totals. Per-line acquisitions are counted from the line's first contention
+ * (approximately, as aliasing lines share owner slots).
+ */
+class LockContention : public GlobAlloc {
+    private:
+        struct LineInfo {
+            uint64_t acquisitions;
+            uint64_t pingPongs;
+            uint64_t stallCycles;
+        };
+
+        struct Shard {
+            lock_t lock;
+            g_unordered_map<Address, LineInfo> lines;
+        };
+
+        static const uint32_t NUM_SHARDS = 64;
+        static const uint32_t MAX_LINES = 64*1024;  // per-line entries, across all shards
+        static const uint32_t OWNER_BITS = 16;  // 64K last-owner slots
+        // Owner slots hold a line hash in the high bits, plus whether the line has an entry and the last core
+        static const uint64_t LINE_MASK = ~((1uL << 16) - 1);
+        static const uint64_t TRACKED = 1uL << 15;
+        static const uint64_t CORE_MASK = TRACKED - 1;
+        Shard* shards;
+        volatile uint64_t* owners;
+
+        // Top-N lines, recomputed at most once per phase when stats are read (always while quiesced)
+        uint32_t numHotLines;
+        g_vector<std::pair<Address, LineInfo> > hotLines;
+        uint64_t lastUpdatePhase;
+
+        Counter profAcquisitions, profPingPongs, profStalls, profStallCycles, profUntracked;
+
+    public:
+        LockContention(uint32_t _numHotLines, AggregateStat* parentStat);
+
+        // An RMW from coreId acquired the line
+        void acquire(Address lineAddr, uint32_t coreId);
+
+        // A request from another core waited this many cycles for an RMW to release the line
+        void stall(Address lineAddr, uint64_t cycles);
+
+    private:
+        inline Shard& getShard(Address lineAddr) {
+            return shards[lineAddr % NUM_SHARDS];
+        }
+
+        // Returns the entry for lineAddr, creating it if there's room (nullptr otherwise). Caller holds the shard lock
+        LineInfo* getLine(Shard& s, Address lineAddr);
+
+        void update();
+        uint64_t hotLineStat(uint32_t idx, uint32_t field);
+};
+
+#endif  // LOCK_CONTENTION_H_
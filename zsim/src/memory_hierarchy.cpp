@@ -26,8 +26,8 @@
 #include "memory_hierarchy.h"
 
 static const char* accessTypeNames[] = {"GETS", "GETX", "PUTS", "PUTX"};
-static const char* invTypeNames[] = {"INV", "INVX"};
-static const char* mesiStateNames[] = {"I", "S", "E", "M"};
+static const char* invTypeNames[] = {"INV", "INVX", "FWD"};
+static const char* mesiStateNames[] = {"I", "S", "E", "M", "O", "F"};
 
 const char* AccessTypeName(AccessType t) {
     assert_msg(t >= 0 && (size_t)t < sizeof(accessTypeNames)/sizeof(const char*), "AccessTypeName got an out-of-range input, %d", t);
@@ -44,7 +44,7 @@ typedef uint64_t Address;
  */
 typedef enum {
     GETS, // get line, exclusive permission not needed (triggered by a processor load)
-    GETX, // get line, exclusive permission needed (triggered by a processor store o atomic access)
+    GETX, // get line, exclusive permission needed (triggered by a processor store o atomic access; atomics set the RMW flag)
     PUTS, // clean writeback (lower cache is evicting this line, line was not modified)
     PUTX  // dirty writeback (lower cache is evicting this line, line was modified)
 } AccessType;
@@ -55,15 +55,17 @@ typedef enum {
 typedef enum {
     INV,  // fully invalidate this line
     INVX, // invalidate exclusive access to this line (lower level can still keep a non-exclusive copy)
-    FWD,  // don't invalidate, just send up the data (used by directories). Only valid on S lines.
+    FWD,  // don't invalidate, just send up the data (used by directories, and to reach O/F holders)
 } InvType;
 
-/* Coherence states for the MESI protocol */
+/* Coherence states for the MESI protocol and its MOESI/MESIF variants */
 typedef enum {
     I, // invalid
     S, // shared (and clean)
     E, // exclusive and clean
-    M  // exclusive and dirty
+    M, // exclusive and dirty
+    O, // shared and dirty, this copy must be written back (MOESI only)
+    F  // shared and clean, this copy supplies data to requesters (MESIF only)
 } MESIState;
 
 //Convenience methods for clearer debug traces
@@ -98,6 +100,7 @@ struct MemReq {
         NONINCLWB     = (1<<3), //This is a non-inclusive writeback. Do not assume that the line was in the lower level. Used on NUCA (BankDir).
         PUTX_KEEPEXCL = (1<<4), //Non-relinquishing PUTX. On a PUTX, maintain the requestor's E state instead of removing the sharer (i.e., this is a pure writeback)
         PREFETCH      = (1<<5), //Prefetch GETS access. Only set at level where prefetch is issued; handled early in MESICC
+        RMW           = (1<<6), //Atomic read-modify-write GETX (LOCK-prefixed instruction). The requester's L1 holds the line until the RMW completes
     };
     uint32_t flags;
 
@@ -107,6 +110,9 @@ struct MemReq {
     // approximate flag
     ApproxType approxType;
 
+    // Bytes actually transferred to/from memory for this line; 0 -> uncompressed (whole line). Set by CompressedMemory
+    uint32_t compBytes;
+
     inline void set(Flag f) {flags |= f;}
     inline bool is (Flag f) const {return flags & f;}
 };
@@ -119,6 +125,8 @@ struct InvReq {
     bool* writeback;
     uint64_t cycle;
     uint32_t srcId;
+    // Sent by an imprecise sharer set (limited pointers, coarse vectors), so the child may not have the line
+    bool imprecise;
 };
 
 /** INTERFACES **/
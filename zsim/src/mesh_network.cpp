@@ -0,0 +1,198 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mesh_network.h"
+#include "event_recorder.h"
+#include "log.h"
+#include "timing_event.h"
+#include "zsim.h"
+
+/* Weave-phase traversal of a single message. Requeues itself once per hop, so
+ * that routing decisions see the link state at the cycle the head flit reaches
+ * each router.
+ */
+class MeshTraversalEvent : public TimingEvent {
+    private:
+        MeshNetwork* net;
+        uint32_t cur;
+        const uint32_t dst;
+        const uint32_t flits;
+
+    public:
+        MeshTraversalEvent(MeshNetwork* _net, uint32_t src, uint32_t _dst, uint32_t _flits, int32_t domain)
+            : TimingEvent(0, 0, domain), net(_net), cur(src), dst(_dst), flits(_flits) {}
+
+        void simulate(uint64_t startCycle) {
+            if (cur == dst) {
+                net->deliver(flits);
+                done(startCycle + flits - 1);  // tail flit is ejected
+            } else {
+                uint64_t departCycle;
+                cur = net->reserveHop(cur, dst, flits, startCycle, departCycle);
+                requeue(departCycle + net->getHopDelay());
+            }
+        }
+};
+
+MeshNetwork::MeshNetwork(uint32_t _dimX, uint32_t _dimY, bool _torus, bool _adaptive, uint32_t _routerDelay, uint32_t _linkDelay,
+        uint32_t linkBytes, uint32_t lineSize, uint32_t _domain)
+    : dimX(_dimX), dimY(_dimY), torus(_torus), adaptive(_adaptive), routerDelay(_routerDelay), linkDelay(_linkDelay),
+      ctrlFlits(1), dataFlits(1 + (lineSize + linkBytes - 1)/linkBytes), domain(_domain)
+{
+    assert(dimX && dimY && linkBytes);
+    assert(routerDelay + linkDelay > 0);
+    linkFreeCycle = gm_calloc<uint64_t>(getNumTiles()*NUM_DIRS);
+}
+
+void MeshNetwork::addNodes(const std::vector<std::string>& names) {
+    for (uint32_t i = 0; i < names.size(); i++) {
+        uint16_t id = addNode(names[i]);
+        if (id < nodeTiles.size()) panic("Network node %s placed twice", names[i].c_str());
+        nodeTiles.push_back(i*getNumTiles()/names.size());
+    }
+}
+
+uint32_t MeshNetwork::computeRTT(uint16_t src, uint16_t dst) {
+    uint32_t s = nodeTiles[src];
+    uint32_t d = nodeTiles[dst];
+    return getZeroLoadLatency(s, d, ctrlFlits) + getZeroLoadLatency(d, s, dataFlits);
+}
+
+int32_t MeshNetwork::getDirection(uint32_t cur, uint32_t dst, uint32_t dim, Direction up, Direction down) const {
+    if (cur == dst) return -1;
+    if (torus) {
+        uint32_t upDist = (dst + dim - cur) % dim;
+        return (upDist <= dim - upDist)? up : down;
+    }
+    return (dst > cur)? up : down;
+}
+
+uint32_t MeshNetwork::getHops(uint32_t src, uint32_t dst) const {
+    uint32_t dx = (src % dimX > dst % dimX)? src % dimX - dst % dimX : dst % dimX - src % dimX;
+    uint32_t dy = (src / dimX > dst / dimX)? src / dimX - dst / dimX : dst / dimX - src / dimX;
+    if (torus) {
+        dx = MIN(dx, dimX - dx);
+        dy = MIN(dy, dimY - dy);
+    }
+    return dx + dy;
+}
+
+uint32_t MeshNetwork::getZeroLoadLatency(uint32_t src, uint32_t dst, uint32_t flits) const {
+    uint32_t hops = getHops(src, dst);
+    return hops? hops*getHopDelay() + flits - 1 : 0;
+}
+
+uint32_t MeshNetwork::getNeighbor(uint32_t tile, Direction dir) const {
+    uint32_t x = tile % dimX;
+    uint32_t y = tile / dimX;
+    switch (dir) {
+        case EAST: x = (x + 1) % dimX; break;
+        case WEST: x = (x + dimX - 1) % dimX; break;
+        case NORTH: y = (y + 1) % dimY; break;
+        case SOUTH: y = (y + dimY - 1) % dimY; break;
+        default: panic("Invalid direction %d", dir);
+    }
+    return y*dimX + x;
+}
+
+uint32_t MeshNetwork::reserveHop(uint32_t cur, uint32_t dst, uint32_t flits, uint64_t cycle, uint64_t& departCycle) {
+    int32_t dirX = getDirection(cur % dimX, dst % dimX, dimX, EAST, WEST);
+    int32_t dirY = getDirection(cur / dimX, dst / dimX, dimY, NORTH, SOUTH);
+    assert(dirX >= 0 || dirY >= 0);
+
+    Direction dir;
+    if (dirX < 0) dir = (Direction)dirY;
+    else if (dirY < 0 || !adaptive) dir = (Direction)dirX;
+    else dir = (linkFreeCycle[cur*NUM_DIRS + dirY] < linkFreeCycle[cur*NUM_DIRS + dirX])? (Direction)dirY : (Direction)dirX;
+
+    uint32_t link = cur*NUM_DIRS + dir;
+    departCycle = MAX(cycle, linkFreeCycle[link]);
+    linkFreeCycle[link] = departCycle + flits;
+
+    profHops.inc();
+    profContentionCycles.inc(departCycle - cycle);
+    profLinkFlits.inc(link, flits);
+    return getNeighbor(cur, dir);
+}
+
+void MeshNetwork::traverse(uint16_t srcNode, uint16_t dstNode, const MemReq& req, uint64_t respCycle) {
+    EventRecorder* evRec = zinfo->eventRecorders[req.srcId];
+    uint32_t src = nodeTiles[srcNode];
+    uint32_t dst = nodeTiles[dstNode];
+    if (!evRec || src == dst) return;
+
+    bool isGet = (req.type == GETS) || (req.type == GETX);
+    // Writebacks are off the critical path; only model them if the next level recorded them
+    if (!isGet && !evRec->hasRecord()) return;
+
+    uint32_t reqFlits = (req.type == PUTX)? dataFlits : ctrlFlits;
+    uint32_t reqLat = getZeroLoadLatency(src, dst, reqFlits);
+    MeshTraversalEvent* reqEv = new (evRec) MeshTraversalEvent(this, src, dst, reqFlits, domain);
+
+    if (evRec->hasRecord()) {
+        // Wrap the next level's record with our traversals
+        TimingRecord tr = evRec->popRecord();
+        reqEv->setMinStartCycle(tr.reqCycle);
+        reqEv->addChild(tr.startEvent, evRec);
+        tr.startEvent = reqEv;
+        if (isGet) {
+            assert(tr.endEvent);
+            MeshTraversalEvent* respEv = new (evRec) MeshTraversalEvent(this, dst, src, dataFlits, domain);
+            respEv->setMinStartCycle(tr.respCycle + reqLat);
+            tr.endEvent->addChild(respEv, evRec);
+            tr.endEvent = respEv;
+            tr.respCycle += reqLat + getZeroLoadLatency(dst, src, dataFlits);
+        }
+        evRec->pushRecord(tr);
+    } else {
+        // The next level does not record events (e.g., a hit in a non-timing cache), so it takes a fixed delay
+        assert(respCycle >= req.cycle);
+        MeshTraversalEvent* respEv = new (evRec) MeshTraversalEvent(this, dst, src, dataFlits, domain);
+        DelayEvent* dEv = new (evRec) DelayEvent(respCycle - req.cycle);
+        reqEv->setMinStartCycle(req.cycle);
+        dEv->setMinStartCycle(req.cycle + reqLat);
+        respEv->setMinStartCycle(respCycle + reqLat);
+        reqEv->addChild(dEv, evRec)->addChild(respEv, evRec);
+        uint64_t netRespCycle = respCycle + reqLat + getZeroLoadLatency(dst, src, dataFlits);
+        TimingRecord tr = {req.lineAddr, req.cycle, netRespCycle, req.type, reqEv, respEv};
+        evRec->pushRecord(tr);
+    }
+}
+
+void MeshNetwork::initStats(AggregateStat* parentStat) {
+    AggregateStat* netStat = new AggregateStat();
+    netStat->init("net", "Network stats");
+    profMsgs.init("msgs", "Messages delivered (weave phase)");
+    profFlits.init("flits", "Flits delivered (weave phase)");
+    profHops.init("hops", "Link traversals (weave phase)");
+    profContentionCycles.init("contCycles", "Cycles messages waited for busy links (weave phase)");
+    profLinkFlits.init("linkFlits", "Flits sent per link, indexed by tile*4 + direction (E, W, N, S)", getNumTiles()*NUM_DIRS);
+    netStat->append(&profMsgs);
+    netStat->append(&profFlits);
+    netStat->append(&profHops);
+    netStat->append(&profContentionCycles);
+    netStat->append(&profLinkFlits);
+    parentStat->append(netStat);
+}
@@ -0,0 +1,102 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MESH_NETWORK_H_
+#define MESH_NETWORK_H_
+
+/* 2D mesh or torus network-on-chip. Entities are placed on tiles, and each
+ * router has one outgoing link per direction. The bound phase charges the
+ * zero-load latency (router and link delays per hop, plus serialization of the
+ * message's flits). In the weave phase, each traversal is an event that
+ * reserves every link along its route for as many cycles as it has flits, so
+ * messages that share links delay each other. Routing is dimension-ordered
+ * (XY), or minimal adaptive, which picks the productive direction whose link
+ * frees up first.
+ *
+ * All traversal events run in a single contention domain, as they share link
+ * state. This limits weave-phase parallelism, but the events are cheap.
+ */
+
+#include <string>
+#include <vector>
+#include "g_std/g_vector.h"
+#include "network.h"
+#include "stats.h"
+
+class MeshNetwork : public Network {
+    private:
+        enum Direction {EAST = 0, WEST, NORTH, SOUTH, NUM_DIRS};
+
+        const uint32_t dimX, dimY;
+        const bool torus;
+        const bool adaptive;
+        const uint32_t routerDelay, linkDelay;
+        const uint32_t ctrlFlits, dataFlits;
+        const uint32_t domain;
+
+        g_vector<uint32_t> nodeTiles;  // node id -> tile
+
+        uint64_t* linkFreeCycle;  // per link, indexed by tile*NUM_DIRS + dir; only touched by the weave phase
+
+        Counter profMsgs, profFlits, profHops, profContentionCycles;
+        VectorCounter profLinkFlits;
+
+    public:
+        MeshNetwork(uint32_t _dimX, uint32_t _dimY, bool _torus, bool _adaptive, uint32_t _routerDelay, uint32_t _linkDelay,
+                uint32_t linkBytes, uint32_t lineSize, uint32_t _domain);
+
+        uint32_t getNumTiles() const {return dimX*dimY;}
+
+        // Spreads a group of entities (e.g., all the banks of a cache level) evenly over the tiles
+        void addNodes(const std::vector<std::string>& names);
+
+        bool modelsContention() const {return true;}
+        void traverse(uint16_t src, uint16_t dst, const MemReq& req, uint64_t respCycle);
+        void initStats(AggregateStat* parentStat);
+
+        // Weave phase, called by traversal events. Reserves the next link towards dst and returns the tile it leads to
+        uint32_t reserveHop(uint32_t cur, uint32_t dst, uint32_t flits, uint64_t cycle, uint64_t& departCycle);
+
+        // Weave phase, called by traversal events when the message's tail flit reaches its destination
+        void deliver(uint32_t flits) {
+            profMsgs.inc();
+            profFlits.inc(flits);
+        }
+
+        uint32_t getHopDelay() const {return routerDelay + linkDelay;}
+
+    protected:
+        uint32_t computeRTT(uint16_t src, uint16_t dst);
+
+    private:
+        uint32_t getHops(uint32_t src, uint32_t dst) const;
+        uint32_t getZeroLoadLatency(uint32_t src, uint32_t dst, uint32_t flits) const;
+        uint32_t getNeighbor(uint32_t tile, Direction dir) const;
+
+        // Productive direction along one dimension (-1 if already aligned); on a torus, takes the shortest way around
+        int32_t getDirection(uint32_t cur, uint32_t dst, uint32_t dim, Direction up, Direction down) const;
+};
+
+#endif  // MESH_NETWORK_H_
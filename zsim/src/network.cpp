@@ -31,7 +31,37 @@
 using std::ifstream;
 using std::string;
 
-Network::Network(const char* filename) {
+int32_t Network::getNodeId(const char* name) const {
+    auto it = nodeIds.find(name);
+    if (it == nodeIds.end()) {
+        warn("%s is not attached to the network, its messages will have 0 latency", name);
+        return -1;
+    }
+    return it->second;
+}
+
+uint16_t Network::addNode(const string& name) {
+    auto it = nodeIds.find(name);
+    if (it != nodeIds.end()) return it->second;
+    assert(!rttMatrix);  // can't add nodes after finalize()
+    if (numNodes >= (1 << 16)) panic("Too many network nodes (max %d)", 1 << 16);
+    nodeIds[name] = numNodes;
+    return numNodes++;
+}
+
+void Network::finalize() {
+    assert(!rttMatrix);
+    rttMatrix = gm_calloc<uint16_t>(((size_t)numNodes)*numNodes);
+    for (uint32_t s = 0; s < numNodes; s++) {
+        for (uint32_t d = 0; d < numNodes; d++) {
+            uint32_t rtt = computeRTT(s, d);
+            if (rtt >= (1 << 16)) panic("Network RTT between nodes %d and %d is too large (%d cycles)", s, d, rtt);
+            rttMatrix[s*numNodes + d] = rtt;
+        }
+    }
+}
+
+FixedNetwork::FixedNetwork(const char* filename) {
     ifstream inFile(filename);
 
     if (!inFile) {
@@ -47,14 +77,16 @@ Network::Network(const char* filename) {
 
         if (inFile.eof()) break;
 
-        string s1 = src + " " + dst;
-        string s2 = dst + " " + src;
+        uint32_t s = addNode(src);
+        uint32_t d = addNode(dst);
+        uint32_t k1 = (s << 16) | d;
+        uint32_t k2 = (d << 16) | s;
 
-        assert((delayMap.find(s1) == delayMap.end()));
-        assert((delayMap.find(s2) == delayMap.end()));
+        assert((delayMap.find(k1) == delayMap.end()));
+        assert((delayMap.find(k2) == delayMap.end()));
 
-        delayMap[s1] = delay;
-        delayMap[s2] = delay;
+        delayMap[k1] = delay;
+        delayMap[k2] = delay;
 
         //info("Parsed %s %s %d", src.c_str(), dst.c_str(), delay);
     }
@@ -62,20 +94,8 @@ Network::Network(const char* filename) {
     inFile.close();
 }
 
-uint32_t Network::getRTT(const char* src, const char* dst) {
-    string key(src);
-    key += " ";
-    key += dst;
-/* dsm: Be sloppy, deadline deadline deadline
-    assert_msg(delayMap.find(key) != delayMap.end(), "%s and %s cannot communicate, according to the network description file", src, dst);
-    return 2*delayMap[key];
-    */
-
-    if (delayMap.find(key) != delayMap.end()) {
-        return 2*delayMap[key];
-    } else {
-        warn("%s and %s have no entry in network description file, returning 0 latency", src, dst);
-        return 0;
-    }
+uint32_t FixedNetwork::computeRTT(uint16_t src, uint16_t dst) {
+    // dsm: Be sloppy, pairs without an entry get 0 latency
+    auto it = delayMap.find((((uint32_t)src) << 16) | dst);
+    return (it != delayMap.end())? 2*it->second : 0;
 }
-
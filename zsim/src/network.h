@@ -26,23 +26,75 @@
 #ifndef NETWORK_H_
 #define NETWORK_H_
 
-/* Very simple fixed-delay network model. Parses a list of delays between
- * entities, then accepts queries for roundtrip times between these entities.
- * There is no contention modeling or even support for serialization latency.
- * This is a basic model that should be extended as appropriate.
+/* Network models. Entities (cache banks, memory controllers) are resolved to
+ * dense node ids once, while the configuration is parsed; after that, all
+ * roundtrip time queries are array reads on a node x node matrix. Caches
+ * charge RTTs in the bound phase. Networks that model contention also get
+ * reports of each traversal, so that the weave phase can simulate them.
  */
 
 #include <string>
 #include <unordered_map>
+#include "galloc.h"
+#include "memory_hierarchy.h"
+
+class AggregateStat;
+
+class Network : public GlobAlloc {
+    private:
+        std::unordered_map<std::string, uint16_t> nodeIds;  // only used during initialization
+        uint32_t numNodes;
+        uint16_t* rttMatrix;  // numNodes x numNodes, built by finalize()
+
+    public:
+        Network() : numNodes(0), rttMatrix(nullptr) {}
+        virtual ~Network() {}
+
+        // Node id of an entity, or -1 (with a warning) if it is not attached to the network
+        int32_t getNodeId(const char* name) const;
+
+        uint32_t getNumNodes() const {return numNodes;}
+
+        // Builds the RTT matrix; call once all nodes have been added, before any getRTT()
+        void finalize();
+
+        inline uint32_t getRTT(uint16_t src, uint16_t dst) const {
+            assert(rttMatrix && src < numNodes && dst < numNodes);
+            return rttMatrix[src*numNodes + dst];
+        }
 
-class Network {
+        // If false, traverse() is a no-op and callers need not report traversals
+        virtual bool modelsContention() const {return false;}
+
+        /* Called by src after it accesses dst with req, with the bound-phase cycle of dst's response (not including
+         * the RTT). Networks that model contention capture the access' timing record, if any, so the weave phase
+         * simulates both traversals.
+         */
+        virtual void traverse(uint16_t src, uint16_t dst, const MemReq& req, uint64_t respCycle) {}
+
+        virtual void initStats(AggregateStat* parentStat) {}
+
+    protected:
+        // Returns the id of the node, adding it if needed
+        uint16_t addNode(const std::string& name);
+
+        // Called once per pair by finalize()
+        virtual uint32_t computeRTT(uint16_t src, uint16_t dst) = 0;
+};
+
+/* Very simple fixed-delay network model. Parses a list of delays between
+ * entities, then accepts queries for roundtrip times between these entities.
+ * There is no contention modeling or even support for serialization latency.
+ */
+class FixedNetwork : public Network {
     private:
-        std::unordered_map<std::string, uint32_t> delayMap;
+        std::unordered_map<uint32_t, uint32_t> delayMap;  // (src << 16 | dst) -> one-way delay, only used during initialization
 
     public:
-        explicit Network(const char* filename);
-        uint32_t getRTT(const char* src, const char* dst);
+        explicit FixedNetwork(const char* filename);
+
+    protected:
+        uint32_t computeRTT(uint16_t src, uint16_t dst);
 };
 
 #endif  // NETWORK_H_
-
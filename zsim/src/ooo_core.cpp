@@ -42,7 +42,7 @@
 //#define DEBUG_MSG(args...) info(args)
 
 // Core parameters
-// TODO(dsm): Make OOOCore templated, subsuming these
+// NOTE: Structure sizes and widths are configurable (see OOOCoreParams); pipeline depths are still fixed
 
 // Stages --- more or less matched to Westmere, but have not seen detailed pipe diagrams anywhare
 #define FETCH_STAGE 1
@@ -52,10 +52,17 @@
 
 #define L1D_LAT 4  // fixed, and FilterCache does not include L1 delay
 #define FETCH_BYTES_PER_CYCLE 16
-#define ISSUES_PER_CYCLE 4
-#define RF_READS_PER_CYCLE 3
 
-OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name) : Core(_name), l1i(_l1i), l1d(_l1d), cRec(0, _name) {
+template <typename P, typename BP>
+OOOCoreImpl<P, BP>::OOOCoreImpl(FilterCache* _l1i, FilterCache* _l1d, g_string& _name, const OOOCoreParams& _params)
+    : OOOCore(_name), l1i(_l1i), l1d(_l1d), params(_params), cRec(0, _name)
+{
+    loadQueue.init(params.lqSize, params.retireWidth);
+    storeQueue.init(params.sqSize, params.retireWidth);
+    insWindow.init(params.iwSize);
+    rob.init(params.robSize, params.retireWidth);
+    uopQueue.init(params.uopQueueSize);
+
     decodeCycle = DECODE_STAGE;  // allow subtracting from it
     curCycle = 0;
     phaseEndCycle = zinfo->phaseLength;
@@ -67,6 +74,7 @@ OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name) : Core(_
 
     lastStoreCommitCycle = 0;
     lastStoreAddrCommitCycle = 0;
+    rmws = 0;
     curCycleRFReads = 0;
     curCycleIssuedUops = 0;
     branchPc = 0;
@@ -76,7 +84,8 @@ OOOCore::OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name) : Core(_
     for (uint32_t i = 0; i < FWD_ENTRIES; i++) fwdArray[i].set((Address)(-1L), 0);
 }
 
-void OOOCore::initStats(AggregateStat* parentStat) {
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::initStats(AggregateStat* parentStat) {
     AggregateStat* coreStat = new AggregateStat();
     coreStat->init(name.c_str(), "Core stats");
 
@@ -110,6 +119,19 @@ void OOOCore::initStats(AggregateStat* parentStat) {
     coreStat->append(mispredBranchesStat);
     coreStat->append(condBranchesStat);
 
+    AggregateStat* bpStat = new AggregateStat();
+    bpStat->init("bp", "Branch predictor stats");
+    auto bpBits = [this]() { return branchPred.getStorageBits(); };
+    LambdaStat<decltype(bpBits)>* bpBitsStat = new LambdaStat<decltype(bpBits)>(bpBits);
+    bpBitsStat->init("storageBits", "Predictor storage (bits)");
+    bpStat->append(bpBitsStat);
+    auto bpMpki = [this]() { return instrs? mispredBranches*1000000/instrs : 0; };
+    LambdaStat<decltype(bpMpki)>* bpMpkiStat = new LambdaStat<decltype(bpMpki)>(bpMpki);
+    bpMpkiStat->init("mpki", "Mispredictions per thousand instructions (x1000)");
+    bpStat->append(bpMpkiStat);
+    branchPred.initStats(bpStat);
+    coreStat->append(bpStat);
+
 #ifdef OOO_STALL_STATS
     profFetchStalls.init("fetchStalls",  "Fetch stalls");  coreStat->append(&profFetchStalls);
     profDecodeStalls.init("decodeStalls", "Decode stalls"); coreStat->append(&profDecodeStalls);
@@ -119,10 +141,13 @@ void OOOCore::initStats(AggregateStat* parentStat) {
     parentStat->append(coreStat);
 }
 
-uint64_t OOOCore::getInstrs() const {return instrs;}
-uint64_t OOOCore::getPhaseCycles() const {return curCycle % zinfo->phaseLength;}
+template <typename P, typename BP>
+uint64_t OOOCoreImpl<P, BP>::getInstrs() const {return instrs;}
+template <typename P, typename BP>
+uint64_t OOOCoreImpl<P, BP>::getPhaseCycles() const {return curCycle % zinfo->phaseLength;}
 
-void OOOCore::contextSwitch(int32_t gid) {
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::contextSwitch(int32_t gid) {
     if (gid == -1) {
         // Do not execute previous BBL, as we were context-switched
         prevBbl = nullptr;
@@ -134,39 +159,52 @@ void OOOCore::contextSwitch(int32_t gid) {
 }
 
 
-InstrFuncPtrs OOOCore::GetFuncPtrs() {return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, FPTR_ANALYSIS, {0}};}
+template <typename P, typename BP>
+InstrFuncPtrs OOOCoreImpl<P, BP>::GetFuncPtrs() {return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, RMWFunc, FPTR_ANALYSIS};}
 
-inline void OOOCore::load(Address addr, Address pc) {
+template <typename P, typename BP>
+inline void OOOCoreImpl<P, BP>::load(Address addr, Address pc) {
     loadPcs[loads] = pc;
     loadAddrs[loads++] = addr;
 }
 
-void OOOCore::store(Address addr, Address pc) {
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::store(Address addr, Address pc) {
     storePcs[stores] = pc;
     storeAddrs[stores++] = addr;
 }
 
+// The read of an atomic RMW: a load that acquires the line; the RMW's store releases it
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::rmw(Address addr, Address pc) {
+    rmwLoadIdxs[rmws++] = loads;
+    load(addr, pc);
+}
+
 // Predicated loads and stores call this function, gets recorded as a 0-cycle op.
 // Predication is rare enough that we don't need to model it perfectly to be accurate (i.e. the uops still execute, retire, etc), but this is needed for correctness.
-void OOOCore::predFalseMemOp() {
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::predFalseMemOp() {
     // I'm going to go out on a limb and assume just loads are predicated (this will not fail silently if it's a store)
     loadPcs[loads] = -1L;
     loadAddrs[loads++] = -1L;
 }
 
-void OOOCore::branch(Address pc, bool taken, Address takenNpc, Address notTakenNpc) {
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::branch(Address pc, bool taken, Address takenNpc, Address notTakenNpc) {
     branchPc = pc;
     branchTaken = taken;
     branchTakenNpc = takenNpc;
     branchNotTakenNpc = notTakenNpc;
 }
 
-inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
+template <typename P, typename BP>
+inline void OOOCoreImpl<P, BP>::bbl(Address bblAddr, BblInfo* bblInfo) {
     if (!prevBbl) {
         // This is the 1st BBL since scheduled, nothing to simulate
         prevBbl = bblInfo;
         // Kill lingering ops from previous BBL
-        loads = stores = 0;
+        loads = stores = rmws = 0;
         return;
     }
 
@@ -178,6 +216,8 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
 
     uint32_t loadIdx = 0;
     uint32_t storeIdx = 0;
+    uint32_t rmwIdx = 0;
+    bool rmwHeld = false;  // an RMW's line is held until its store completes
 
     uint32_t prevDecCycle = 0;
     uint64_t lastCommitCycle = 0;  // used to find misprediction penalty
@@ -202,8 +242,8 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
         prevDecCycle = uop->decCycle;
         uopQueue.markLeave(curCycle);
 
-        // Implement issue width limit --- we can only issue 4 uops/cycle
-        if (curCycleIssuedUops >= ISSUES_PER_CYCLE) {
+        // Implement issue width limit --- we can only issue issueWidth() uops/cycle
+        if (curCycleIssuedUops >= issueWidth()) {
 #ifdef OOO_STALL_STATS
             profIssueStalls.inc();
 #endif
@@ -224,8 +264,8 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
         // RF read stalls
         // if srcs are not available at issue time, we have to go thru the RF
         curCycleRFReads += ((c0 < curCycle)? 1 : 0) + ((c1 < curCycle)? 1 : 0);
-        if (curCycleRFReads > RF_READS_PER_CYCLE) {
-            curCycleRFReads -= RF_READS_PER_CYCLE;
+        if (curCycleRFReads > rfReadsPerCycle()) {
+            curCycleRFReads -= rfReadsPerCycle();
             curCycleIssuedUops = 0;  // or 1? that's probably a 2nd-order detail
             insWindow.advancePos(curCycle);
         }
@@ -271,10 +311,16 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
                     // Wait for all previous store addresses to be resolved
                     dispatchCycle = MAX(lastStoreAddrCommitCycle+1, dispatchCycle);
 
+                    bool isRMW = unlikely(rmwIdx < rmws) && rmwLoadIdxs[rmwIdx] == loadIdx;
                     Address pc = loadPcs[loadIdx];
                     Address addr = loadAddrs[loadIdx++];
                     uint64_t reqSatisfiedCycle = dispatchCycle;
-                    if (addr != ((Address)-1L)) {
+                    if (isRMW) {
+                        rmwIdx++;
+                        rmwHeld = true;
+                        reqSatisfiedCycle = l1d->rmwAcquire(addr, dispatchCycle, pc) + L1D_LAT;
+                        cRec.record(curCycle, dispatchCycle, reqSatisfiedCycle);
+                    } else if (addr != ((Address)-1L)) {
                         reqSatisfiedCycle = l1d->load(addr, dispatchCycle, pc) + L1D_LAT;
                         cRec.record(curCycle, dispatchCycle, reqSatisfiedCycle);
                     }
@@ -315,6 +361,10 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
                     Address addr = storeAddrs[storeIdx++];
                     uint64_t reqSatisfiedCycle = l1d->store(addr, dispatchCycle, pc) + L1D_LAT;
                     cRec.record(curCycle, dispatchCycle, reqSatisfiedCycle);
+                    if (unlikely(rmwHeld)) {
+                        l1d->rmwRelease(reqSatisfiedCycle);
+                        rmwHeld = false;
+                    }
 
                     // Fill the forwarding table
                     fwdArray[(addr>>2) & (FWD_ENTRIES-1)].set(addr, reqSatisfiedCycle);
@@ -365,7 +415,7 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
     // If these assertions fail, most likely, something's off in the decoder
     assert_msg(loadIdx == loads, "%s: loadIdx(%d) != loads (%d)", name.c_str(), loadIdx, loads);
     assert_msg(storeIdx == stores, "%s: storeIdx(%d) != stores (%d)", name.c_str(), storeIdx, stores);
-    loads = stores = 0;
+    loads = stores = rmws = 0;
 
 
     /* Simulate frontend for branch pred + fetch of this BBL
@@ -452,7 +502,8 @@ inline void OOOCore::bbl(Address bblAddr, BblInfo* bblInfo) {
 }
 
 // Timing simulation code
-void OOOCore::join() {
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::join() {
     DEBUG_MSG("[%s] Joining, curCycle %ld phaseEnd %ld", name.c_str(), curCycle, phaseEndCycle);
     uint64_t targetCycle = cRec.notifyJoin(curCycle);
     if (targetCycle > curCycle) advance(targetCycle);
@@ -461,24 +512,28 @@ void OOOCore::join() {
     DEBUG_MSG("[%s] Joined, curCycle %ld phaseEnd %ld", name.c_str(), curCycle, phaseEndCycle);
 }
 
-void OOOCore::leave() {
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::leave() {
     DEBUG_MSG("[%s] Leaving, curCycle %ld phaseEnd %ld", name.c_str(), curCycle, phaseEndCycle);
     cRec.notifyLeave(curCycle);
 }
 
-void OOOCore::cSimStart() {
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::cSimStart() {
     uint64_t targetCycle = cRec.cSimStart(curCycle);
     assert(targetCycle >= curCycle);
     if (targetCycle > curCycle) advance(targetCycle);
 }
 
-void OOOCore::cSimEnd() {
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::cSimEnd() {
     uint64_t targetCycle = cRec.cSimEnd(curCycle);
     assert(targetCycle >= curCycle);
     if (targetCycle > curCycle) advance(targetCycle);
 }
 
-void OOOCore::advance(uint64_t targetCycle) {
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::advance(uint64_t targetCycle) {
     assert(targetCycle > curCycle);
     decodeCycle += targetCycle - curCycle;
     insWindow.longAdvance(curCycle, targetCycle);
@@ -493,23 +548,31 @@ void OOOCore::advance(uint64_t targetCycle) {
 
 // Pin interface code
 
-void OOOCore::LoadFunc(THREADID tid, ADDRINT loadPc, ADDRINT addr) {static_cast<OOOCore*>(cores[tid])->load(addr, loadPc);}
-void OOOCore::StoreFunc(THREADID tid, ADDRINT storePc, ADDRINT addr) {static_cast<OOOCore*>(cores[tid])->store(addr, storePc);}
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::LoadFunc(THREADID tid, ADDRINT loadPc, ADDRINT addr) {static_cast<OOOCoreImpl<P, BP>*>(cores[tid])->load(addr, loadPc);}
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::StoreFunc(THREADID tid, ADDRINT storePc, ADDRINT addr) {static_cast<OOOCoreImpl<P, BP>*>(cores[tid])->store(addr, storePc);}
+
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::RMWFunc(THREADID tid, ADDRINT rmwPc, ADDRINT addr) {static_cast<OOOCoreImpl<P, BP>*>(cores[tid])->rmw(addr, rmwPc);}
 
-void OOOCore::PredLoadFunc(THREADID tid, ADDRINT predLoadPc, ADDRINT addr, BOOL pred) {
-    OOOCore* core = static_cast<OOOCore*>(cores[tid]);
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::PredLoadFunc(THREADID tid, ADDRINT predLoadPc, ADDRINT addr, BOOL pred) {
+    OOOCoreImpl<P, BP>* core = static_cast<OOOCoreImpl<P, BP>*>(cores[tid]);
     if (pred) core->load(addr, predLoadPc);
     else core->predFalseMemOp();
 }
 
-void OOOCore::PredStoreFunc(THREADID tid, ADDRINT predStorePc, ADDRINT addr, BOOL pred) {
-    OOOCore* core = static_cast<OOOCore*>(cores[tid]);
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::PredStoreFunc(THREADID tid, ADDRINT predStorePc, ADDRINT addr, BOOL pred) {
+    OOOCoreImpl<P, BP>* core = static_cast<OOOCoreImpl<P, BP>*>(cores[tid]);
     if (pred) core->store(addr, predStorePc);
     else core->predFalseMemOp();
 }
 
-void OOOCore::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
-    OOOCore* core = static_cast<OOOCore*>(cores[tid]);
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
+    OOOCoreImpl<P, BP>* core = static_cast<OOOCoreImpl<P, BP>*>(cores[tid]);
     core->bbl(bblAddr, bblInfo);
 
     while (core->curCycle > core->phaseEndCycle) {
@@ -528,7 +591,46 @@ void OOOCore::BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
     }
 }
 
-void OOOCore::BranchFunc(THREADID tid, ADDRINT pc, BOOL taken, ADDRINT takenNpc, ADDRINT notTakenNpc) {
-    static_cast<OOOCore*>(cores[tid])->branch(pc, taken, takenNpc, notTakenNpc);
+template <typename P, typename BP>
+void OOOCoreImpl<P, BP>::BranchFunc(THREADID tid, ADDRINT pc, BOOL taken, ADDRINT takenNpc, ADDRINT notTakenNpc) {
+    static_cast<OOOCoreImpl<P, BP>*>(cores[tid])->branch(pc, taken, takenNpc, notTakenNpc);
 }
 
+
+// Pre-specialized variants: ROB, retire width, IW, LQ, SQ, uop queue, issue width, RF reads/cycle
+typedef OOOStaticParams<128, 4, 36, 32, 32, 28, 4, 3> NehalemParams;  // default
+typedef OOOStaticParams<192, 4, 60, 72, 42, 56, 4, 3> HaswellParams;
+typedef OOOStaticParams<224, 4, 97, 72, 56, 64, 4, 3> SkylakeParams;
+typedef OOOStaticParams<0, 0, 0, 0, 0, 0, 0, 0> GenericParams;  // runtime-sized
+
+template <typename P>
+static bool Matches(const OOOCoreParams& p) {
+    return p.robSize == P::robSize && p.retireWidth == P::retireWidth && p.iwSize == P::iwSize &&
+        p.lqSize == P::lqSize && p.sqSize == P::sqSize && p.uopQueueSize == P::uopQueueSize &&
+        p.issueWidth == P::issueWidth && p.rfReadsPerCycle == P::rfReadsPerCycle;
+}
+
+template <typename P, typename BP>
+static OOOCore* BuildOOOCoreImpl(FilterCache* l1i, FilterCache* l1d, g_string& name, const OOOCoreParams& params) {
+    void* mem = gm_memalign<OOOCoreImpl<P, BP> >(CACHE_LINE_BYTES);
+    return new (mem) OOOCoreImpl<P, BP>(l1i, l1d, name, params);
+}
+
+template <typename P>
+static OOOCore* BuildOOOCoreWithPredictor(FilterCache* l1i, FilterCache* l1d, g_string& name, const OOOCoreParams& params) {
+    switch (params.branchPredictor) {
+        case BP_PAG_A2: return BuildOOOCoreImpl<P, BranchPredictorPAgA2>(l1i, l1d, name, params);
+        case BP_PAG_A3: return BuildOOOCoreImpl<P, BranchPredictorPAgA3>(l1i, l1d, name, params);
+        case BP_GSHARE: return BuildOOOCoreImpl<P, BranchPredictorDefaultGShare>(l1i, l1d, name, params);
+        case BP_TAGE: return BuildOOOCoreImpl<P, BranchPredictorDefaultTAGE>(l1i, l1d, name, params);
+        case BP_PERCEPTRON: return BuildOOOCoreImpl<P, BranchPredictorDefaultPerceptron>(l1i, l1d, name, params);
+        default: panic("Invalid branch predictor type %d", params.branchPredictor);
+    }
+}
+
+OOOCore* BuildOOOCore(FilterCache* l1i, FilterCache* l1d, g_string& name, const OOOCoreParams& params) {
+    if (Matches<NehalemParams>(params)) return BuildOOOCoreWithPredictor<NehalemParams>(l1i, l1d, name, params);
+    if (Matches<HaswellParams>(params)) return BuildOOOCoreWithPredictor<HaswellParams>(l1i, l1d, name, params);
+    if (Matches<SkylakeParams>(params)) return BuildOOOCoreWithPredictor<SkylakeParams>(l1i, l1d, name, params);
+    return BuildOOOCoreWithPredictor<GenericParams>(l1i, l1d, name, params);
+}
@@ -29,6 +29,7 @@
 #include <algorithm>
 #include <queue>
 #include <string>
+#include "branch_predictors.h"
 #include "core.h"
 #include "g_std/g_multimap.h"
 #include "memory_hierarchy.h"
@@ -40,76 +41,7 @@
 
 class FilterCache;
 
-/* 2-level branch predictor:
- *  - L1: Branch history shift registers (bshr): 2^NB entries, HB bits of history/entry, indexed by XOR'd PC
- *  - L2: Pattern history table (pht): 2^LB entries, 2-bit sat counters, indexed by XOR'd bshr contents
- *  NOTE: Assumes LB is in [NB, HB] range for XORing (e.g., HB = 18 and NB = 10, LB = 13 is OK)
- */
-template<uint32_t NB, uint32_t HB, uint32_t LB>
-class BranchPredictorPAg {
-    private:
-        uint32_t bhsr[1 << NB];
-        uint8_t pht[1 << LB];
-        bool useA2; // Ture: use A2, else use A3
-
-    public:
-        BranchPredictorPAg() {
-            useA2 = true;
-            uint32_t numBhsrs = 1 << NB;
-            uint32_t phtSize = 1 << LB;
-
-            for (uint32_t i = 0; i < numBhsrs; i++) {
-                bhsr[i] = 0;
-            }
-            for (uint32_t i = 0; i < phtSize; i++) {
-                pht[i] = 1;  // weak non-taken
-            }
-
-            static_assert(LB <= HB, "Too many PHT entries");
-            static_assert(LB >= NB, "Too few PHT entries (you'll need more XOR'ing)");
-        }
-
-        // Predicts and updates; returns false if mispredicted
-        inline bool predict(Address branchPc, bool taken) {
-            uint32_t bhsrMask = (1 << NB) - 1;
-            uint32_t histMask = (1 << HB) - 1;
-            uint32_t phtMask  = (1 << LB) - 1;
-
-            // Predict
-            // uint32_t bhsrIdx = ((uint32_t)( branchPc ^ (branchPc >> NB) ^ (branchPc >> 2*NB) )) & bhsrMask;
-            uint32_t bhsrIdx = ((uint32_t)( branchPc >> 1)) & bhsrMask;
-            uint32_t phtIdx = bhsr[bhsrIdx];
-
-            // Shift-XOR-mask to fit in PHT
-            phtIdx ^= (phtIdx & ~phtMask) >> (HB - LB); // take the [HB-1, LB] bits of bshr, XOR with [LB-1, ...] bits
-            phtIdx &= phtMask;
-
-            // If uncommented, behaves like a global history predictor
-            // bhsrIdx = 0;
-            // phtIdx = (bhsr[bhsrIdx] ^ ((uint32_t)branchPc)) & phtMask;
-
-            bool pred = pht[phtIdx] > 1;
-
-            // info("BP Pred: 0x%lx bshr[%d]=%x taken=%d pht=%d pred=%d", branchPc, bhsrIdx, phtIdx, taken, pht[phtIdx], pred);
-
-            // Update
-            if (useA2) {
-                pht[phtIdx] = taken? (pred? 3 : (pht[phtIdx]+1)) : (pred? (pht[phtIdx]-1) : 0); //2-bit saturating counter
-            } else {
-                // Please implement Automaton 3 for update
-
-            }
-            bhsr[bhsrIdx] = ((bhsr[bhsrIdx] << 1) & histMask ) | (taken? 1: 0); //we apply phtMask here, dependence is further away
-
-            // info("BP Update: newPht=%d newBshr=%x", pht[phtIdx], bhsr[bhsrIdx]);
-            return (taken == pred);
-        }
-
-        // Set to use Automaton 3
-        inline void useA3() {useA2 = false;}
-};
-
-
+// WSZ == 0 means the window size is set at runtime (see init())
 template<uint32_t H, uint32_t WSZ>
 class WindowStructure {
     private:
@@ -131,12 +63,22 @@ class WindowStructure {
 
         uint8_t lastPort;
 
+        uint32_t dynSize;  // only used if WSZ == 0
+        inline uint32_t winSize() const {return WSZ? WSZ : dynSize;}
+
     public:
         WindowStructure() {
             curWin = gm_calloc<WinCycle>(H);
             nextWin = gm_calloc<WinCycle>(H);
             curPos = 0;
             occupancy = 0;
+            dynSize = WSZ;
+        }
+
+        void init(uint32_t size) {
+            assert(WSZ == 0 || size == WSZ);
+            assert(size > 0);
+            dynSize = size;
         }
 
 
@@ -155,7 +97,7 @@ class WindowStructure {
                     extraSlotCycle++;
                 }
             }
-            assert(occupancy <= WSZ);
+            assert(occupancy <= winSize());
         }
 
         inline void advancePos(uint64_t& curCycle) {
@@ -217,7 +159,7 @@ class WindowStructure {
         template <bool touchOccupancy, bool recordPort>
         void scheduleInternal(uint64_t& curCycle, uint64_t& schedCycle, uint8_t portMask) {
             // If the window is full, advance curPos until it's not
-            while (touchOccupancy && occupancy == WSZ) {
+            while (touchOccupancy && occupancy == winSize()) {
                 advancePos(curCycle);
             }
 
@@ -314,6 +256,8 @@ class ReorderBuffer {
             curCycleRetires = 1;
         }
 
+        void init(uint32_t size, uint32_t width) {assert(size == SZ && width == W);}
+
         inline uint64_t minAllocCycle() {
             return buf[idx];
         }
@@ -342,6 +286,52 @@ class ReorderBuffer {
         }
 };
 
+// Runtime-sized ReorderBuffer, used by non-specialized OOO cores. Same code as above.
+template<>
+class ReorderBuffer<0, 0> {
+    private:
+        uint64_t* buf;
+        uint64_t curRetireCycle;
+        uint32_t curCycleRetires;
+        uint32_t idx;
+        uint32_t size;
+        uint32_t width;
+
+    public:
+        ReorderBuffer() : buf(nullptr), size(0), width(0) {}
+
+        void init(uint32_t _size, uint32_t _width) {
+            assert(_size > 0 && _width > 0);
+            size = _size;
+            width = _width;
+            buf = gm_calloc<uint64_t>(size);
+            idx = 0;
+            curRetireCycle = 0;
+            curCycleRetires = 1;
+        }
+
+        inline uint64_t minAllocCycle() {
+            return buf[idx];
+        }
+
+        inline void markRetire(uint64_t minRetireCycle) {
+            if (minRetireCycle <= curRetireCycle) {  // retire with bundle
+                if (curCycleRetires == width) {
+                    curRetireCycle++;
+                    curCycleRetires = 0;
+                } else {
+                    curCycleRetires++;
+                }
+            } else {  // advance
+                curRetireCycle = minRetireCycle;
+                curCycleRetires = 1;
+            }
+
+            buf[idx++] = curRetireCycle;
+            if (idx == size) idx = 0;
+        }
+};
+
 // Similar to ReorderBuffer, but must have in-order allocations and retires (--> faster)
 template<uint32_t SZ>
 class CycleQueue {
@@ -355,6 +345,8 @@ class CycleQueue {
             idx = 0;
         }
 
+        void init(uint32_t size) {assert(size == SZ);}
+
         inline uint64_t minAllocCycle() {
             return buf[idx];
         }
@@ -366,9 +358,85 @@ class CycleQueue {
         }
 };
 
+// Runtime-sized CycleQueue
+template<>
+class CycleQueue<0> {
+    private:
+        uint64_t* buf;
+        uint32_t idx;
+        uint32_t size;
+
+    public:
+        CycleQueue() : buf(nullptr), idx(0), size(0) {}
+
+        void init(uint32_t _size) {
+            assert(_size > 0);
+            size = _size;
+            buf = gm_calloc<uint64_t>(size);
+            idx = 0;
+        }
+
+        inline uint64_t minAllocCycle() {
+            return buf[idx];
+        }
+
+        inline void markLeave(uint64_t leaveCycle) {
+            buf[idx++] = leaveCycle;
+            if (idx == size) idx = 0;
+        }
+};
+
+/* OOO core microarchitectural parameters, read from sys.cores.<group>.*
+ * (defaults model Nehalem). Cores whose parameters match one of the
+ * compile-time variants in ooo_core.cpp use a fully specialized model;
+ * other configurations use the generic, runtime-sized one.
+ */
+struct OOOCoreParams {
+    uint32_t robSize;
+    uint32_t retireWidth;  // also used for the load/store queues
+    uint32_t iwSize;
+    uint32_t lqSize;
+    uint32_t sqSize;
+    uint32_t uopQueueSize;
+    uint32_t issueWidth;
+    uint32_t rfReadsPerCycle;
+    BranchPredictorType branchPredictor;  // not a structure size, selects the predictor variant
+};
+
+// Compile-time parameters; all zeros means runtime
+template <uint32_t ROB, uint32_t RW, uint32_t IW, uint32_t LQ, uint32_t SQ, uint32_t UQ, uint32_t ISSUE, uint32_t RF>
+struct OOOStaticParams {
+    static const uint32_t robSize = ROB;
+    static const uint32_t retireWidth = RW;
+    static const uint32_t iwSize = IW;
+    static const uint32_t lqSize = LQ;
+    static const uint32_t sqSize = SQ;
+    static const uint32_t uopQueueSize = UQ;
+    static const uint32_t issueWidth = ISSUE;
+    static const uint32_t rfReadsPerCycle = RF;
+};
+
 struct BblInfo;
 
+/* Non-templated OOO core interface. Everything in the bound phase's hot
+ * path lives in OOOCoreImpl and is reached through its Pin analysis
+ * functions, so the virtuals here are only used per phase or at init.
+ */
 class OOOCore : public Core {
+    public:
+        explicit OOOCore(g_string& _name) : Core(_name) {}
+
+        // Contention simulation interface
+        virtual EventRecorder* getEventRecorder() = 0;
+        virtual void cSimStart() = 0;
+        virtual void cSimEnd() = 0;
+};
+
+// Builds a core specialized for the given parameters if there is a matching variant, or a generic one otherwise
+OOOCore* BuildOOOCore(FilterCache* l1i, FilterCache* l1d, g_string& name, const OOOCoreParams& params);
+
+template <typename P, typename BP>
+class OOOCoreImpl : public OOOCore {
     private:
         FilterCache* l1i;
         FilterCache* l1d;
@@ -387,6 +455,8 @@ class OOOCore : public Core {
         Address storePcs[256];
         uint32_t loads;
         uint32_t stores;
+        uint32_t rmwLoadIdxs[256]; //indices of loads that are the reads of atomic RMWs
+        uint32_t rmws;
 
         uint64_t lastStoreCommitCycle;
         uint64_t lastStoreAddrCommitCycle; //tracks last store addr uop, all loads queue behind it
@@ -396,8 +466,8 @@ class OOOCore : public Core {
         //buffers, but we split the associative component from the limited-size modeling.
         //NOTE: We do not model the 10-entry fill buffer here; the weave model should take care
         //to not overlap more than 10 misses.
-        ReorderBuffer<32, 4> loadQueue;
-        ReorderBuffer<32, 4> storeQueue;
+        ReorderBuffer<P::lqSize, P::retireWidth> loadQueue;
+        ReorderBuffer<P::sqSize, P::retireWidth> storeQueue;
 
         uint32_t curCycleRFReads; //for RF read stalls
         uint32_t curCycleIssuedUops; //for uop issue limits
@@ -406,8 +476,8 @@ class OOOCore : public Core {
         //WindowStructure<1024, 1 /*size*/, 2 /*width*/> insWindow; //this would be something like an Atom, except all the instruction pairing business...
 
         //Nehalem
-        WindowStructure<1024, 36 /*size*/> insWindow; //NOTE: IW width is implicitly determined by the decoder, which sets the port masks according to uop type
-        ReorderBuffer<128, 4> rob;
+        WindowStructure<1024, P::iwSize> insWindow; //NOTE: IW width is implicitly determined by the decoder, which sets the port masks according to uop type
+        ReorderBuffer<P::robSize, P::retireWidth> rob;
 
         // Agner's guide says it's a 2-level pred and BHSR is 18 bits, so this is the config that makes sense;
         // in practice, this is probably closer to the Pentium M's branch predictor, (see Uzelac and Milenkovic,
@@ -415,7 +485,8 @@ class OOOCore : public Core {
         // where a few of the 2-level history bits are in the tag.
         // Since this is close enough, we'll leave it as is for now. Feel free to reverse-engineer the real thing...
         // UPDATE: Now pht index is XOR-folded BSHR. This has 6656 bytes total -- not negligible, but not ridiculous.
-        BranchPredictorPAg<11, 18, 14> branchPred;
+        // This PAg is the default; sys.cores.<group>.branchPredictor selects others (see branch_predictors.h).
+        BP branchPred;
 
         Address branchPc;  //0 if last bbl was not a conditional branch
         bool branchTaken;
@@ -423,7 +494,12 @@ class OOOCore : public Core {
         Address branchNotTakenNpc;
 
         uint64_t decodeCycle;
-        CycleQueue<28> uopQueue;  // models issue queue
+        CycleQueue<P::uopQueueSize> uopQueue;  // models issue queue
+
+        // Runtime parameters; the accessors fold to constants in specialized variants
+        const OOOCoreParams params;
+        inline uint32_t issueWidth() const {return P::issueWidth? P::issueWidth : params.issueWidth;}
+        inline uint32_t rfReadsPerCycle() const {return P::rfReadsPerCycle? P::rfReadsPerCycle : params.rfReadsPerCycle;}
 
         uint64_t instrs, uops, bbls, approxInstrs, mispredBranches, condBranches;
 
@@ -446,7 +522,7 @@ class OOOCore : public Core {
         OOOCoreRecorder cRec;
 
     public:
-        OOOCore(FilterCache* _l1i, FilterCache* _l1d, g_string& _name);
+        OOOCoreImpl(FilterCache* _l1i, FilterCache* _l1d, g_string& _name, const OOOCoreParams& _params);
 
         void initStats(AggregateStat* parentStat);
 
@@ -462,16 +538,14 @@ class OOOCore : public Core {
         InstrFuncPtrs GetFuncPtrs();
 
         // Contention simulation interface
-        inline EventRecorder* getEventRecorder() {return cRec.getEventRecorder();}
+        EventRecorder* getEventRecorder() {return cRec.getEventRecorder();}
         void cSimStart();
         void cSimEnd();
 
-        // Set Automaton 3 for branch predictor update
-        inline void useA3forBranchPred() {branchPred.useA3();}
-
     private:
         inline void load(Address addr, Address pc);
         inline void store(Address addr, Address pc);
+        inline void rmw(Address addr, Address pc);
 
         /* NOTE: Analysis routines cannot touch curCycle directly, must use
          * advance() for long jumps or insWindow.advancePos() for 1-cycle
@@ -495,6 +569,7 @@ class OOOCore : public Core {
         static void StoreFunc(THREADID tid, ADDRINT storePc, ADDRINT addr);
         static void PredLoadFunc(THREADID tid, ADDRINT predLoadPc, ADDRINT addr, BOOL pred);
         static void PredStoreFunc(THREADID tid, ADDRINT predStorePc, ADDRINT addr, BOOL pred);
+        static void RMWFunc(THREADID tid, ADDRINT rmwPc, ADDRINT addr);
         static void BblFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo);
         static void BranchFunc(THREADID tid, ADDRINT pc, BOOL taken, ADDRINT takenNpc, ADDRINT notTakenNpc);
 } ATTR_LINE_ALIGNED;  // Take up an int number of cache lines
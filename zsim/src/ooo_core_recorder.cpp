@@ -133,7 +133,7 @@ uint64_t OOOCoreRecorder::notifyJoin(uint64_t curCycle) {
         lastEvProduced = new (eventRecorder) OOOIssueEvent(0, curCycle - gapCycles, this, domain);
         lastEvProduced->id = curId++;
         lastEvProduced->setMinStartCycle(curCycle);
-        lastEvProduced->queue(curCycle);
+        lastEvProduced->queue(curCycle, eventRecorder.getSourceId());
         eventRecorder.setStartSlack(0);
         DEBUG_MSG("[%s] Joined, was HALTED, curCycle %ld halted %ld", name.c_str(), curCycle, totalHaltedCycles);
     } else if (state == DRAINING) {
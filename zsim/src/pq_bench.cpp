@@ -0,0 +1,164 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Microbenchmark for the weave-phase PrioQueue far-event engines. Replays an
+ * operation stream recorded with PQ_RECORD_STREAMS (lines of "e <cycle>" and
+ * "d"), or, without arguments, a synthetic stream where every dequeued event
+ * schedules a child, mostly nearby but sometimes far away (memory stalls,
+ * DRAM refreshes). Reports ns/op for each engine and checks that both dequeue
+ * the same cycles.
+ */
+
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "bithacks.h"
+#include "galloc.h"
+#include "log.h"
+#include "mtrand.h"
+#include "prio_queue.h"
+#include "profile_stats.h"
+
+#define BENCH_PQ_BLOCKS 1024  // same as PQ_BLOCKS in contention_sim.h
+
+struct BenchEvent {
+    BenchEvent* next;
+};
+
+struct StreamOp {
+    bool isEnqueue;
+    uint64_t cycle;  // only for enqueues
+};
+
+static void readStream(const char* file, std::vector<StreamOp>& ops) {
+    FILE* f = fopen(file, "r");
+    if (!f) panic("Could not open stream %s", file);
+    char type;
+    while (fscanf(f, " %c", &type) == 1) {
+        StreamOp op;
+        op.isEnqueue = (type == 'e');
+        op.cycle = 0;
+        if (op.isEnqueue && fscanf(f, "%ld", &op.cycle) != 1) panic("Malformed stream %s", file);
+        ops.push_back(op);
+    }
+    fclose(f);
+}
+
+static void synthStream(uint64_t numEvents, std::vector<StreamOp>& ops) {
+    MTRand rng(42);
+    uint64_t queued = 0;
+    uint64_t produced = 0;
+    // Model dequeue order with a simple sorted multiset, so that enqueued cycles are always >= the last dequeued one
+    std::multimap<uint64_t, uint32_t> pending;
+    uint64_t curCycle = 0;
+    for (uint32_t i = 0; i < 64; i++) {  // initial events, e.g., one per core
+        uint64_t c = rng.randInt(1000);
+        ops.push_back({true, c});
+        pending.insert(std::make_pair(c, 0));
+        queued++;
+        produced++;
+    }
+    while (queued) {
+        curCycle = pending.begin()->first;
+        pending.erase(pending.begin());
+        ops.push_back({false, 0});
+        queued--;
+        if (produced >= numEvents) continue;
+        uint32_t children = (rng.randInt(3) == 0)? 2 : 1;
+        for (uint32_t c = 0; c < children; c++) {
+            uint64_t p = rng.randInt(999);
+            uint64_t delay;
+            if (p < 900) delay = 1 + rng.randInt(200);  // cache/core events
+            else if (p < 990) delay = 200 + rng.randInt(5000);  // memory
+            else delay = 70000 + rng.randInt(1000000);  // refreshes and long stalls, beyond the near window
+            ops.push_back({true, curCycle + delay});
+            pending.insert(std::make_pair(curCycle + delay, 0));
+            queued++;
+            produced++;
+        }
+    }
+}
+
+static void runStream(const char* name, PQFarEngine engine, const std::vector<StreamOp>& ops,
+        std::vector<uint64_t>& deqCycles, uint32_t reps) {
+    uint64_t numEnqueues = 0;
+    for (const StreamOp& op : ops) if (op.isEnqueue) numEnqueues++;
+    BenchEvent* evs = gm_calloc<BenchEvent>(numEnqueues);
+
+    uint64_t bestNs = -1L;
+    for (uint32_t r = 0; r < reps; r++) {
+        PrioQueue<BenchEvent, BENCH_PQ_BLOCKS>* pq = new (gm_malloc<PrioQueue<BenchEvent, BENCH_PQ_BLOCKS> >()) PrioQueue<BenchEvent, BENCH_PQ_BLOCKS>(engine);
+        for (uint64_t i = 0; i < numEnqueues; i++) evs[i].next = nullptr;
+        deqCycles.clear();
+        deqCycles.reserve(ops.size() - numEnqueues);
+
+        uint64_t nextEv = 0;
+        uint64_t startNs = getNs();
+        for (const StreamOp& op : ops) {
+            if (op.isEnqueue) {
+                pq->enqueue(&evs[nextEv++], op.cycle);
+            } else {
+                uint64_t cycle;
+                pq->dequeue(cycle);
+                deqCycles.push_back(cycle);
+            }
+        }
+        uint64_t ns = getNs() - startNs;
+        bestNs = MIN(bestNs, ns);
+        gm_free(pq);  // leaks the far map/wheel storage, fine for a benchmark
+    }
+    gm_free(evs);
+
+    info("%-6s: %ld ops, best of %d runs %.3f ms, %.2f ns/op", name, ops.size(), reps, bestNs/1e6, ((double)bestNs)/ops.size());
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog("");  // no log header
+    if (argc > 3) {
+        info("Benchmarks the weave-phase PrioQueue engines");
+        info("Usage: %s [<recorded stream> | -s <synthetic events>]", argv[0]);
+        exit(1);
+    }
+
+    gm_init(1024 << 20 /*1 GB*/);
+
+    std::vector<StreamOp> ops;
+    if (argc == 2) {
+        readStream(argv[1], ops);
+        info("Replaying %ld operations from %s", ops.size(), argv[1]);
+    } else {
+        uint64_t numEvents = (argc == 3 && strcmp(argv[1], "-s") == 0)? strtoul(argv[2], nullptr, 10) : 4000000;
+        synthStream(numEvents, ops);
+        info("Running synthetic stream, %ld operations", ops.size());
+    }
+
+    std::vector<uint64_t> mapCycles, wheelCycles;
+    runStream("Map", PQ_FAR_MAP, ops, mapCycles, 5);
+    runStream("Wheel", PQ_FAR_WHEEL, ops, wheelCycles, 5);
+    if (mapCycles != wheelCycles) panic("Engines dequeued different cycles!");
+    return 0;
+}
@@ -26,7 +26,23 @@
 #ifndef PRIO_QUEUE_H_
 #define PRIO_QUEUE_H_
 
+#include <stdio.h>
 #include "g_std/g_multimap.h"
+#include "g_std/g_vector.h"
+#include "galloc.h"
+
+//Set to 1 to have PrioQueues log their operations when given a record file (see pq_bench.cpp to replay them)
+#define PQ_RECORD_STREAMS 0
+//#define PQ_RECORD_STREAMS 1
+
+/* Far-event engines. Events beyond the B*64-cycle window of near blocks are
+ * kept either in a multimap (O(log n) inserts, one allocation per event), or
+ * in a timing wheel whose slots each cover B/2 blocks, the granularity at
+ * which far events are pulled into the near blocks. Wheel slots are vectors
+ * that keep their capacity, so in steady state far inserts are O(1) and do
+ * not allocate. Events beyond the wheel's reach still go to the multimap.
+ */
+enum PQFarEngine {PQ_FAR_MAP, PQ_FAR_WHEEL};
 
 template <typename T, uint32_t B>
 class PrioQueue {
@@ -67,16 +83,37 @@ class PrioQueue {
 
     FEMap feMap;
 
+    static const uint32_t WHEEL_SLOTS = 64;
+    typedef g_vector< std::pair<uint64_t, T*> > WheelSlot;
+    WheelSlot* wheel; //nullptr if using PQ_FAR_MAP; slot i holds far elements of superblock sb, sb % WHEEL_SLOTS == i
+
     uint64_t curBlock;
     uint64_t elems;
+    uint64_t farElems; //in feMap or wheel
+
+#if PQ_RECORD_STREAMS
+    FILE* recordFile;
+#endif
 
     public:
-        PrioQueue() {
+        explicit PrioQueue(PQFarEngine farEngine = PQ_FAR_MAP) {
             curBlock = 0;
             elems = 0;
+            farElems = 0;
+            wheel = nullptr;
+            if (farEngine == PQ_FAR_WHEEL) {
+                wheel = gm_calloc<WheelSlot>(WHEEL_SLOTS);
+                for (uint32_t i = 0; i < WHEEL_SLOTS; i++) new (&wheel[i]) WheelSlot();
+            }
+#if PQ_RECORD_STREAMS
+            recordFile = nullptr;
+#endif
         }
 
         void enqueue(T* obj, uint64_t cycle) {
+#if PQ_RECORD_STREAMS
+            if (recordFile) fprintf(recordFile, "e %ld\n", cycle);
+#endif
             uint64_t absBlock = cycle/64;
             assert(absBlock >= curBlock);
 
@@ -86,7 +123,7 @@ class PrioQueue {
                 blocks[i].enqueue(obj, offset);
             } else {
                 //info("XXX far enq() %ld", cycle);
-                feMap.insert(std::pair<uint64_t, T*>(cycle, obj));
+                enqueueFar(obj, cycle);
             }
             elems++;
         }
@@ -95,24 +132,7 @@ class PrioQueue {
             assert(elems);
             while (!blocks[curBlock % B].occ) {
                 curBlock++;
-                if ((curBlock % (B/2)) == 0 && !feMap.empty()) {
-                    uint64_t topCycle = (curBlock + B)*64;
-                    //Move every element with cycle < topCycle to blocks[]
-                    FEMapIterator it = feMap.begin();
-                    while (it != feMap.end() && it->first < topCycle) {
-                        uint64_t cycle = it->first;
-                        T* obj = it->second;
-
-                        uint64_t absBlock = cycle/64;
-                        assert(absBlock >= curBlock);
-                        assert(absBlock < curBlock + B);
-                        uint32_t i = absBlock % B;
-                        uint32_t offset = cycle % 64;
-                        blocks[i].enqueue(obj, offset);
-                        it++;
-                    }
-                    feMap.erase(feMap.begin(), it);
-                }
+                if ((curBlock % (B/2)) == 0 && farElems) refill();
             }
 
             //We're now at the first populated block
@@ -121,6 +141,9 @@ class PrioQueue {
             elems--;
 
             deqCycle = curBlock*64 + offset;
+#if PQ_RECORD_STREAMS
+            if (recordFile) fprintf(recordFile, "d\n");
+#endif
             return obj;
         }
 
@@ -142,13 +165,92 @@ class PrioQueue {
                 if (occ) {
                     uint64_t pos = __builtin_ctzl(occ);
                     uint64_t cycle = (curBlock + i)*64 + pos;
-                    return feMap.empty()? cycle : MIN(cycle, feMap.begin()->first);
+                    return farElems? MIN(cycle, farFirstCycle()) : cycle;
+                }
+            }
+
+            return farFirstCycle();
+        }
+
+#if PQ_RECORD_STREAMS
+        void setRecordFile(FILE* f) {recordFile = f;}
+#endif
+
+    private:
+        //Superblocks are B/2 blocks; the near blocks always span the current superblock and the next one
+        static inline uint64_t superblock(uint64_t cycle) {return cycle/(64*(B/2));}
+
+        inline void enqueueFar(T* obj, uint64_t cycle) {
+            farElems++;
+            if (wheel) {
+                uint64_t sb = superblock(cycle);
+                if (sb <= curBlock/(B/2) + WHEEL_SLOTS) {
+                    wheel[sb % WHEEL_SLOTS].push_back(std::make_pair(cycle, obj));
+                    return;
+                }
+            }
+            feMap.insert(std::pair<uint64_t, T*>(cycle, obj));
+        }
+
+        inline void enqueueNear(T* obj, uint64_t cycle) {
+            uint64_t absBlock = cycle/64;
+            assert(absBlock >= curBlock);
+            assert(absBlock < curBlock + B);
+            uint32_t i = absBlock % B;
+            uint32_t offset = cycle % 64;
+            blocks[i].enqueue(obj, offset);
+        }
+
+        //Called when curBlock enters a new superblock; moves every far element with cycle < topCycle to blocks[]
+        void refill() {
+            assert((curBlock % (B/2)) == 0);
+            uint64_t topCycle = (curBlock + B)*64;
+            uint64_t curSb = curBlock/(B/2);
+
+            if (wheel) {
+                //Only the superblock that just entered the near window can have elements below topCycle
+                WheelSlot& slot = wheel[(curSb + 1) % WHEEL_SLOTS];
+                for (std::pair<uint64_t, T*>& p : slot) {
+                    assert(superblock(p.first) == curSb + 1);
+                    enqueueNear(p.second, p.first);
+                }
+                farElems -= slot.size();
+                slot.clear();  // keeps capacity
+            }
+
+            FEMapIterator it = feMap.begin();
+            while (it != feMap.end() && it->first < topCycle) {
+                enqueueNear(it->second, it->first);
+                farElems--;
+                it++;
+            }
+
+            //With the wheel, pull in map elements that are now within its reach
+            if (wheel) {
+                while (it != feMap.end() && superblock(it->first) <= curSb + WHEEL_SLOTS) {
+                    wheel[superblock(it->first) % WHEEL_SLOTS].push_back(std::make_pair(it->first, it->second));
+                    it++;
                 }
             }
+            feMap.erase(feMap.begin(), it);
+        }
 
+        uint64_t farFirstCycle() const {
+            assert(farElems);
+            if (wheel) {
+                //Wheel elements always come before map elements, and earlier superblocks come first
+                uint64_t curSb = curBlock/(B/2);
+                for (uint64_t sb = curSb + 1; sb <= curSb + WHEEL_SLOTS; sb++) {
+                    const WheelSlot& slot = wheel[sb % WHEEL_SLOTS];
+                    if (slot.empty()) continue;
+                    uint64_t minCycle = slot[0].first;
+                    for (const std::pair<uint64_t, T*>& p : slot) minCycle = MIN(minCycle, p.first);
+                    return minCycle;
+                }
+            }
+            assert(!feMap.empty());
             return feMap.begin()->first;
         }
 };
 
 #endif  // PRIO_QUEUE_H_
-
@@ -1,16 +1,180 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
 #ifndef RRIP_REPL_H_
 #define RRIP_REPL_H_
 
 #include "repl_policies.h"
 
-// Static RRIP
+/* Re-reference interval prediction (Jaleel et al., ISCA 2010).
+ *
+ * Each line has an M-bit re-reference prediction value (RRPV), kept in a
+ * packed byte array so that ranking a set or a zcache walk touches few
+ * cache lines. Hits predict near-immediate re-reference (RRPV = 0); the
+ * victim is a candidate with the maximum RRPV, aging all candidates until
+ * one reaches it. Policies differ only on the RRPV given to incoming lines.
+ *
+ * The array calls replaced() and then update() on the inserted line, so
+ * update() distinguishes fills from hits by remembering the replaced id.
+ */
+
+// Static RRIP: insert with a long re-reference interval (rpvMax - 1)
 class SRRIPReplPolicy : public ReplPolicy {
     protected:
-        // add class member variables here
+        uint8_t* rrpv;
+        uint32_t numLines;
+        uint8_t rpvMax;
+        uint32_t insertId;  // line being filled, numLines if none
+
+        virtual uint8_t insertRrpv(uint32_t id) {return rpvMax - 1;}
+
+    public:
+        SRRIPReplPolicy(uint32_t _numLines, uint32_t _rpvMax) : numLines(_numLines), insertId(_numLines) {
+            assert_msg(_rpvMax > 0 && _rpvMax < 256, "RRPV max must fit in a byte, %d given", _rpvMax);
+            rpvMax = _rpvMax;
+            rrpv = gm_calloc<uint8_t>(numLines);
+            for (uint32_t i = 0; i < numLines; i++) rrpv[i] = rpvMax;
+        }
+
+        ~SRRIPReplPolicy() {
+            gm_free(rrpv);
+        }
+
+        void update(uint32_t id, const MemReq* req) {
+            if (id == insertId) {
+                rrpv[id] = insertRrpv(id);
+                insertId = numLines;
+            } else {
+                rrpv[id] = 0;
+            }
+        }
+
+        void replaced(uint32_t id) {
+            insertId = id;
+        }
+
+        template <typename C> inline uint32_t rank(const MemReq* req, C cands) {
+            uint32_t bestCand = -1;
+            uint32_t bestRrpv = 0;
+            for (auto ci = cands.begin(); ci != cands.end(); ci.inc()) {
+                uint32_t id = *ci;
+                if (!cc->isValid(id)) return id;
+                uint32_t r = rrpv[id];
+                if (r > bestRrpv || bestCand == (uint32_t)-1) {
+                    bestCand = id;
+                    bestRrpv = r;
+                }
+            }
+
+            // Age all candidates as if we had incremented them until the victim reached rpvMax
+            uint32_t aging = rpvMax - bestRrpv;
+            if (aging) {
+                for (auto ci = cands.begin(); ci != cands.end(); ci.inc()) rrpv[*ci] += aging;
+            }
+            return bestCand;
+        }
+
+        DECL_RANK_BINDINGS;
+};
+
+// Bimodal RRIP: insert with a distant re-reference interval (rpvMax), except for 1 in BRRIP_LONG_INTERVAL fills
+#define BRRIP_LONG_INTERVAL 32
+
+class BRRIPReplPolicy : public SRRIPReplPolicy {
+    protected:
+        uint32_t fills;
+
+        uint8_t bimodalRrpv() {
+            return ((++fills % BRRIP_LONG_INTERVAL) == 0)? rpvMax - 1 : rpvMax;
+        }
+
+        virtual uint8_t insertRrpv(uint32_t id) {return bimodalRrpv();}
 
     public:
-        // add member methods here, refer to repl_policies.h
+        BRRIPReplPolicy(uint32_t _numLines, uint32_t _rpvMax) : SRRIPReplPolicy(_numLines, _rpvMax), fills(0) {}
+};
+
+/* Dynamic RRIP: set-dueling between SRRIP and BRRIP. One in every
+ * DRRIP_CONSTITUENCY sets always uses SRRIP and another always uses BRRIP;
+ * fills in those leader sets (i.e., their misses) move a saturating PSEL
+ * counter, and follower sets use the policy with fewer leader misses. In
+ * zcaches, which have no sets, groups of `ways` consecutive line ids are
+ * used as sets.
+ */
+#define DRRIP_CONSTITUENCY 32
+#define DRRIP_PSEL_BITS 10
+
+class DRRIPReplPolicy : public BRRIPReplPolicy {
+    private:
+        uint32_t ways;
+        uint32_t psel;
+        Counter profSRRIPFills, profBRRIPFills;
 
-        //DECL_RANK_BINDINGS; // TODO: uncomment this line
+    protected:
+        virtual uint8_t insertRrpv(uint32_t id) {
+            const uint32_t pselMax = (1 << DRRIP_PSEL_BITS) - 1;
+            uint32_t leader = (id / ways) % DRRIP_CONSTITUENCY;
+            bool useBRRIP;
+            if (leader == 0) {  // SRRIP leader
+                psel = MIN(psel + 1, pselMax);
+                useBRRIP = false;
+            } else if (leader == 1) {  // BRRIP leader
+                psel = psel? psel - 1 : 0;
+                useBRRIP = true;
+            } else {
+                useBRRIP = psel > pselMax/2;
+            }
+
+            if (useBRRIP) {
+                profBRRIPFills.inc();
+                return bimodalRrpv();
+            } else {
+                profSRRIPFills.inc();
+                return rpvMax - 1;
+            }
+        }
+
+    public:
+        DRRIPReplPolicy(uint32_t _numLines, uint32_t _ways, uint32_t _rpvMax) : BRRIPReplPolicy(_numLines, _rpvMax), ways(_ways) {
+            assert(ways > 0);
+            psel = (1 << (DRRIP_PSEL_BITS - 1)) - 1;  // start slightly biased towards SRRIP
+        }
+
+        void initStats(AggregateStat* parent) {
+            AggregateStat* rpStat = new AggregateStat();
+            rpStat->init("repl", "DRRIP replacement policy stats");
+            profSRRIPFills.init("srripFills", "Fills with SRRIP insertion");
+            rpStat->append(&profSRRIPFills);
+            profBRRIPFills.init("brripFills", "Fills with BRRIP insertion");
+            rpStat->append(&profBRRIPFills);
+            auto pselFn = [this]() { return psel; };
+            LambdaStat<decltype(pselFn)>* pselStat = new LambdaStat<decltype(pselFn)>(pselFn);
+            pselStat->init("psel", "Policy selection counter (high favors BRRIP)");
+            rpStat->append(pselStat);
+            parent->append(rpStat);
+        }
 };
+
 #endif // RRIP_REPL_H_
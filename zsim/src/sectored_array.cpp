@@ -0,0 +1,132 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sectored_array.h"
+#include "coherence_ctrls.h"
+#include "hash.h"
+
+SectoredArray::SectoredArray(uint32_t _numLines, uint32_t _assoc, uint32_t _sectorLines, ReplPolicy* _rp, HashFamily* _hf)
+    : accessCounter(0), rp(_rp), cc(nullptr), hf(_hf), numLines(_numLines), assoc(_assoc), sectorLines(_sectorLines), numVictims(0)
+{
+    assert_msg(isPow2(sectorLines) && sectorLines <= 64, "sector lines must be a power of 2 <= 64, but you specified %d", sectorLines);
+    assert_msg(numLines % (sectorLines*assoc) == 0, "number of lines is not a multiple of sector lines x ways");
+    sectorBits = ilog2(sectorLines);
+    numSectors = numLines/sectorLines;
+    numSets = numSectors/assoc;
+    setMask = numSets - 1;
+    assert_msg(isPow2(numSets), "must have a power of 2 # sets, but you specified %d", numSets);
+
+    tags = gm_calloc<Address>(numSectors);
+    lastAccess = gm_calloc<uint64_t>(numLines);
+    tagMatch = GetArrayTagMatchFn(assoc);
+    proxyRp = new ProxyReplPolicy(this);
+}
+
+void SectoredArray::initStats(AggregateStat* parentStat) {
+    AggregateStat* objStats = new AggregateStat();
+    objStats->init("array", "SectoredArray stats");
+    profSectorFills.init("sectorFills", "Sector misses (whole sector replaced)");
+    profSubFills.init("subFills", "Sub-block misses in resident sectors");
+    profSubHits.init("subHits", "Sub-block hits");
+    objStats->append(&profSectorFills);
+    objStats->append(&profSubFills);
+    objStats->append(&profSubHits);
+    parentStat->append(objStats);
+}
+
+int32_t SectoredArray::lookup(const Address lineAddr, const MemReq* req, bool updateReplacement) {
+    Address sectorAddr = lineAddr >> sectorBits;
+    uint32_t set = hf->hash(0, sectorAddr) & setMask;
+    uint32_t first = set*assoc;
+    int32_t way = tagMatch(&tags[first], assoc, sectorAddr);
+    if (way < 0) return -1;
+
+    uint32_t sector = first + way;
+    uint32_t offset = lineAddr & (sectorLines - 1);
+    uint32_t lineId = (sector << sectorBits) | offset;
+    if (updateReplacement) {
+        // Only demand accesses are counted; the CC state tells sub-block hits from misses
+        if (cc->isValid(lineId)) profSubHits.inc();
+        else profSubFills.inc();
+        lastAccess[lineId] = ++accessCounter;
+        rp->update(lineId, req);
+    }
+    return lineId;
+}
+
+uint32_t SectoredArray::preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr) {
+    Address sectorAddr = lineAddr >> sectorBits;
+    uint32_t set = hf->hash(0, sectorAddr) & setMask;
+    uint32_t first = set*assoc;
+
+    // Each sector competes with its most recently accessed valid line. Lines invalidated by coherence don't
+    // count; if none is valid, any (invalid) line makes the sector the preferred victim
+    ZWalkInfo cands[assoc];
+    for (uint32_t w = 0; w < assoc; w++) {
+        uint32_t sector = first + w;
+        uint32_t repLine = sector << sectorBits;
+        uint64_t repAccess = 0;
+        for (uint32_t i = 0; i < sectorLines; i++) {
+            uint32_t lineId = (sector << sectorBits) | i;
+            if (cc->isValid(lineId) && lastAccess[lineId] >= repAccess) {
+                repLine = lineId;
+                repAccess = lastAccess[lineId];
+            }
+        }
+        cands[w].set(sector, repLine, -1);
+    }
+    uint32_t bestCand = rp->rankCands(req, ZCands(&cands[0], &cands[assoc]));
+    uint32_t sector = bestCand >> sectorBits;
+    uint32_t offset = lineAddr & (sectorLines - 1);
+    uint32_t candidate = (sector << sectorBits) | offset;
+
+    Address victimBase = tags[sector] << sectorBits;
+    *wbLineAddr = victimBase | offset;
+
+    // The rest of the sector's valid lines go too
+    numVictims = 0;
+    for (uint32_t i = 0; i < sectorLines; i++) {
+        uint32_t lineId = (sector << sectorBits) | i;
+        if (i != offset && cc->isValid(lineId)) victims[numVictims++] = lineId;
+    }
+    profSectorFills.inc();
+    return candidate;
+}
+
+uint32_t SectoredArray::getExtraVictim(uint32_t idx, Address* wbLineAddr) const {
+    assert(idx < numVictims);
+    uint32_t lineId = victims[idx];
+    *wbLineAddr = (tags[lineId >> sectorBits] << sectorBits) | (lineId & (sectorLines - 1));
+    return lineId;
+}
+
+void SectoredArray::postinsert(const Address lineAddr, const MemReq* req, uint32_t candidate) {
+    uint32_t sector = candidate >> sectorBits;
+    rp->replaced(candidate);
+    tags[sector] = lineAddr >> sectorBits;
+    lastAccess[candidate] = ++accessCounter;
+    numVictims = 0;
+    rp->update(candidate, req);
+}
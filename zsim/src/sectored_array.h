@@ -0,0 +1,97 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SECTORED_ARRAY_H_
+#define SECTORED_ARRAY_H_
+
+#include "cache_arrays.h"
+#include "repl_policies.h"
+
+/* Sectored set-associative array: each tag covers a sector of sectorLines
+ * consecutive lines, cutting tag storage by sectorLines x. Every line still
+ * has its own lineId (sector*sectorLines + offset), so coherence and
+ * replacement state is kept per sub-block by the CC and repl policy as
+ * usual; a line in a resident sector with invalid CC state is simply a
+ * sub-block miss. Replacements evict whole sectors: the repl policy ranks
+ * each sector by its most recently accessed valid line (any line if none is
+ * valid), and the other valid lines of the victim sector are returned as
+ * extra victims.
+ */
+class SectoredArray : public CacheArray {
+    private:
+        // Forwards the CC to the real repl policy, and keeps it to tell valid sub-blocks apart
+        class ProxyReplPolicy : public ReplPolicy {
+            private:
+                SectoredArray* a;
+            public:
+                explicit ProxyReplPolicy(SectoredArray* _a) : a(_a) {}
+                void setCC(CC* _cc) {a->cc = _cc; a->rp->setCC(_cc);}
+
+                void update(uint32_t id, const MemReq* req) {panic("!")}
+                void replaced(uint32_t id) {panic("!!");}
+                template <typename C> uint32_t rank(const MemReq* req, C cands) {panic("!!!");}
+                void initStats(AggregateStat* parent) {a->rp->initStats(parent);}
+                DECL_RANK_BINDINGS
+        };
+
+        Address* tags;  // per sector, lineAddr >> sectorBits
+        uint64_t* lastAccess;  // per line, to find each sector's most recently accessed valid line
+        uint64_t accessCounter;
+        ReplPolicy* rp;
+        ProxyReplPolicy* proxyRp;
+        CC* cc;
+        HashFamily* hf;
+        uint32_t numLines;
+        uint32_t numSectors;
+        uint32_t numSets;
+        uint32_t assoc;
+        uint32_t setMask;
+        uint32_t sectorLines;
+        uint32_t sectorBits;
+        TagMatchFn tagMatch;
+
+        // Set by preinsert()
+        uint32_t victims[64];
+        uint32_t numVictims;
+
+        Counter profSectorFills, profSubFills, profSubHits;
+
+    public:
+        SectoredArray(uint32_t _numLines, uint32_t _assoc, uint32_t _sectorLines, ReplPolicy* _rp, HashFamily* _hf);
+
+        int32_t lookup(const Address lineAddr, const MemReq* req, bool updateReplacement);
+        uint32_t preinsert(const Address lineAddr, const MemReq* req, Address* wbLineAddr);
+        void postinsert(const Address lineAddr, const MemReq* req, uint32_t candidate);
+
+        uint32_t getNumExtraVictims() const {return numVictims;}
+        uint32_t getExtraVictim(uint32_t idx, Address* wbLineAddr) const;
+
+        // Use this repl policy in the cache; the one given to the array must not see the CC directly
+        ReplPolicy* getRP() const {return proxyRp;}
+
+        void initStats(AggregateStat* parentStat);
+};
+
+#endif  // SECTORED_ARRAY_H_
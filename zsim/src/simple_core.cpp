@@ -89,7 +89,8 @@ void SimpleCore::join() {
 //Static class functions: Function pointers and trampolines
 
 InstrFuncPtrs SimpleCore::GetFuncPtrs() {
-    return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, FPTR_ANALYSIS, {0}};
+    //Atomics are plain loads; this core does not model RMW contention
+    return {LoadFunc, StoreFunc, BblFunc, BranchFunc, PredLoadFunc, PredStoreFunc, LoadFunc, FPTR_ANALYSIS};
 }
 
 void SimpleCore::LoadFunc(THREADID tid, ADDRINT loadPc, ADDRINT addr) {
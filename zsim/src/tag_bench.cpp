@@ -0,0 +1,104 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Microbenchmark for the set-associative tag match kernels. For each
+ * associativity, builds a tag array like SetAssocArray's and looks up a
+ * stream of line addresses (hitRate% of them present, at random ways) with
+ * every kernel the host supports. Reports lookups/sec and checks that all
+ * kernels return the same ways.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "bithacks.h"
+#include "galloc.h"
+#include "log.h"
+#include "mtrand.h"
+#include "profile_stats.h"
+#include "tag_match.h"
+
+#define BENCH_SETS 4096  // 4096 sets x 16 ways x 64B = 4MB LLC bank
+#define BENCH_LOOKUPS (8 << 20)
+
+static void runAssoc(uint32_t assoc, uint32_t hitRate, TagMatchIsa maxIsa) {
+    MTRand rng(assoc);
+    uint32_t numLines = BENCH_SETS*assoc;
+    Address* array = gm_calloc<Address>(numLines);
+    for (uint32_t i = 0; i < numLines; i++) array[i] = (i % BENCH_SETS) | ((Address)(1 + i/BENCH_SETS) << 32);  // distinct tags
+
+    // Pre-generate the lookups so that we only time the array scan
+    std::vector<Address> addrs(BENCH_LOOKUPS);
+    std::vector<uint32_t> sets(BENCH_LOOKUPS);
+    for (uint32_t i = 0; i < BENCH_LOOKUPS; i++) {
+        uint32_t set = rng.randInt(BENCH_SETS - 1);
+        sets[i] = set;
+        if (rng.randInt(99) < hitRate) {
+            addrs[i] = array[set*assoc + rng.randInt(assoc - 1)];
+        } else {
+            addrs[i] = set | ((Address)(assoc + 1 + rng.randInt(1000)) << 32);  // same set, absent tag
+        }
+    }
+
+    uint64_t refCheck = 0;
+    for (uint32_t isa = TM_SCALAR; isa <= (uint32_t)maxIsa; isa++) {
+        TagMatchFn fn = GetTagMatchFn((TagMatchIsa)isa);
+        uint64_t bestNs = -1L;
+        uint64_t check = 0;
+        for (uint32_t r = 0; r < 3; r++) {
+            check = 0;
+            uint64_t startNs = getNs();
+            for (uint32_t i = 0; i < BENCH_LOOKUPS; i++) {
+                int32_t way = fn(&array[sets[i]*assoc], assoc, addrs[i]);
+                check = check*31 + way;
+            }
+            bestNs = MIN(bestNs, getNs() - startNs);
+        }
+        if (isa == TM_SCALAR) refCheck = check;
+        else if (check != refCheck) panic("%s tag match returned different ways than scalar at %d ways", GetTagMatchIsaName((TagMatchIsa)isa), assoc);
+        info("%2d ways, %-6s: %7.1f Mlookups/s, %.2f ns/lookup", assoc, GetTagMatchIsaName((TagMatchIsa)isa),
+                BENCH_LOOKUPS*1e3/bestNs, ((double)bestNs)/BENCH_LOOKUPS);
+    }
+    gm_free(array);
+}
+
+int main(int argc, const char* argv[]) {
+    InitLog("");  // no log header
+    if (argc > 2) {
+        info("Benchmarks the SetAssocArray tag match kernels");
+        info("Usage: %s [<hit rate %%, default 50>]", argv[0]);
+        exit(1);
+    }
+    uint32_t hitRate = (argc == 2)? strtoul(argv[1], nullptr, 10) : 50;
+    if (hitRate > 100) panic("Hit rate must be a percentage, %d given", hitRate);
+
+    gm_init(1024 << 20 /*1 GB*/);
+
+    TagMatchIsa hostIsa = GetHostTagMatchIsa();
+    info("Host supports %s tag match, %d%% hit rate", GetTagMatchIsaName(hostIsa), hitRate);
+    uint32_t assocs[] = {4, 8, 16, 32, 64};
+    for (uint32_t assoc : assocs) runAssoc(assoc, hitRate, hostIsa);
+    return 0;
+}
@@ -0,0 +1,80 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tag_match.h"
+#include "log.h"
+
+int32_t TagMatchScalar(const Address* tags, uint32_t n, Address lineAddr) {
+    for (uint32_t i = 0; i < n; i++) {
+        if (tags[i] == lineAddr) return i;
+    }
+    return -1;
+}
+
+// NOTE: Not <cpuid.h>, which is shadowed by our own cpuid.h (the CPUID leaves we give simulated apps)
+static inline void hostCpuid(uint32_t leaf, uint32_t subleaf, uint32_t& eax, uint32_t& ebx, uint32_t& ecx, uint32_t& edx) {
+    __asm__ __volatile__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(leaf), "c"(subleaf));
+}
+
+TagMatchIsa GetHostTagMatchIsa() {
+    uint32_t eax, ebx, ecx, edx;
+    hostCpuid(0, 0, eax, ebx, ecx, edx);
+    uint32_t maxLeaf = eax;
+    if (maxLeaf < 1) return TM_SCALAR;
+
+    hostCpuid(1, 0, eax, ebx, ecx, edx);
+    bool sse4 = ecx & (1 << 19);
+    bool osAvx = (ecx & (1 << 27) /*OSXSAVE*/) && (ecx & (1 << 28) /*AVX*/);
+    if (osAvx) {
+        // The OS must also save YMM state on context switches
+        uint32_t xcr0, xcr0Hi;
+        __asm__ __volatile__("xgetbv" : "=a"(xcr0), "=d"(xcr0Hi) : "c"(0));
+        osAvx = (xcr0 & 0x6) == 0x6;
+    }
+
+    bool avx2 = false;
+    if (osAvx && maxLeaf >= 7) {
+        hostCpuid(7, 0, eax, ebx, ecx, edx);
+        avx2 = ebx & (1 << 5);
+    }
+
+    if (avx2) return TM_AVX2;
+    else if (sse4) return TM_SSE4;
+    else return TM_SCALAR;
+}
+
+TagMatchFn GetTagMatchFn(TagMatchIsa isa) {
+    switch (isa) {
+        case TM_SCALAR: return TagMatchScalar;
+        case TM_SSE4: return TagMatchSSE4;
+        case TM_AVX2: return TagMatchAVX2;
+        default: panic("Invalid tag match ISA %d", isa);
+    }
+}
+
+const char* GetTagMatchIsaName(TagMatchIsa isa) {
+    const char* names[] = {"scalar", "SSE4", "AVX2"};
+    return names[isa];
+}
@@ -0,0 +1,64 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TAG_MATCH_H_
+#define TAG_MATCH_H_
+
+#include <stdint.h>
+#include "memory_hierarchy.h"
+
+/* Tag comparison kernels for set-associative arrays. Each returns the index
+ * of the first of the n tags that equals lineAddr, or -1 if none does.
+ *
+ * The SIMD versions live in their own files, which are the only ones
+ * compiled with -msse4.1/-mavx2, so that the rest of the simulator keeps
+ * running on older hosts. GetTagMatchFn() picks the widest version the
+ * host supports, once, at startup.
+ */
+typedef int32_t (*TagMatchFn)(const Address* tags, uint32_t n, Address lineAddr);
+
+int32_t TagMatchScalar(const Address* tags, uint32_t n, Address lineAddr);
+int32_t TagMatchSSE4(const Address* tags, uint32_t n, Address lineAddr);
+int32_t TagMatchAVX2(const Address* tags, uint32_t n, Address lineAddr);
+
+enum TagMatchIsa {TM_SCALAR, TM_SSE4, TM_AVX2};
+
+TagMatchIsa GetHostTagMatchIsa();
+TagMatchFn GetTagMatchFn(TagMatchIsa isa);
+const char* GetTagMatchIsaName(TagMatchIsa isa);
+
+/* The SIMD kernels only beat the scalar loop on very wide sets. tag_bench on
+ * an AVX2 host (50% hits, 4096 sets) gives, in ns/lookup (scalar/SSE4/AVX2):
+ * 4 ways 14.9/16.6/20.5, 8 ways 17.6/18.4/19.2, 16 ways 21.4/21.4/25.2,
+ * 32 ways about equal, and 64 ways 51-66/43-58/37-39. Arrays use the host's
+ * widest kernel from this many ways on, and the scalar loop below it.
+ */
+#define TAG_MATCH_SIMD_MIN_WAYS 64
+
+inline TagMatchFn GetArrayTagMatchFn(uint32_t ways) {
+    return (ways >= TAG_MATCH_SIMD_MIN_WAYS)? GetTagMatchFn(GetHostTagMatchIsa()) : TagMatchScalar;
+}
+
+#endif  // TAG_MATCH_H_
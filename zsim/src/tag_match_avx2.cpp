@@ -0,0 +1,52 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compiled with -mavx2; only called if the host supports it (see tag_match.cpp) */
+
+#include <immintrin.h>
+#include "tag_match.h"
+
+int32_t TagMatchAVX2(const Address* tags, uint32_t n, Address lineAddr) {
+    __m256i key = _mm256_set1_epi64x(lineAddr);
+    uint32_t i = 0;
+    // 8 tags per iteration covers the common 8/16/32-way cases with half the branches
+    for (; i + 8 <= n; i += 8) {
+        __m256i t0 = _mm256_loadu_si256((const __m256i*)&tags[i]);
+        __m256i t1 = _mm256_loadu_si256((const __m256i*)&tags[i + 4]);
+        int m0 = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(t0, key)));
+        int m1 = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(t1, key)));
+        int mask = m0 | (m1 << 4);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    for (; i + 4 <= n; i += 4) {
+        __m256i t = _mm256_loadu_si256((const __m256i*)&tags[i]);
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(t, key)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    for (; i < n; i++) {
+        if (tags[i] == lineAddr) return i;
+    }
+    return -1;
+}
@@ -0,0 +1,40 @@
+/** $lic$
+ * Copyright (C) 2012-2015 by Massachusetts Institute of Technology
+ * Copyright (C) 2010-2013 by The Board of Trustees of Stanford University
+ *
+ * This file is part of zsim.
+ *
+ * zsim is free software; you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2.
+ *
+ * If you use this software in your research, we request that you reference
+ * the zsim paper ("ZSim: Fast and Accurate Microarchitectural Simulation of
+ * Thousand-Core Systems", Sanchez and Kozyrakis, ISCA-40, June 2013) as the
+ * source of the simulator in any publications that use this software, and that
+ * you send us a citation of your work.
+ *
+ * zsim is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compiled with -msse4.1; only called if the host supports it (see tag_match.cpp) */
+
+#include <smmintrin.h>
+#include "tag_match.h"
+
+int32_t TagMatchSSE4(const Address* tags, uint32_t n, Address lineAddr) {
+    __m128i key = _mm_set1_epi64x(lineAddr);
+    uint32_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128i t = _mm_loadu_si128((const __m128i*)&tags[i]);
+        int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(t, key)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    return (i < n && tags[i] == lineAddr)? (int32_t)i : -1;
+}
@@ -34,7 +34,8 @@ class HitEvent : public TimingEvent {
         TimingCache* cache;
 
     public:
-        HitEvent(TimingCache* _cache,  uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache) {}
+        Address lineAddr; //to find in-flight fills of the line
+        HitEvent(TimingCache* _cache, Address _lineAddr, uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache), lineAddr(_lineAddr) {}
 
         void simulate(uint64_t startCycle) {
             cache->simulateHit(this, startCycle);
@@ -47,7 +48,9 @@ class MissStartEvent : public TimingEvent {
         TimingCache* cache;
     public:
         uint64_t startCycle; //for profiling purposes
-        MissStartEvent(TimingCache* _cache,  uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache) {}
+        Address lineAddr;
+        uint32_t mshr; //set on simulation
+        MissStartEvent(TimingCache* _cache, Address _lineAddr, uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache), lineAddr(_lineAddr), mshr(-1) {}
         void simulate(uint64_t startCycle) {cache->simulateMissStart(this, startCycle);}
 };
 
@@ -78,16 +81,40 @@ class ReplAccessEvent : public TimingEvent {
         void simulate(uint64_t startCycle) {cache->simulateReplAccess(this, startCycle);}
 };
 
+class WbAbsorbEvent : public TimingEvent {
+    private:
+        TimingCache* cache;
+    public:
+        WbAbsorbEvent(TimingCache* _cache, uint32_t postDelay, int32_t domain) : TimingEvent(0, postDelay, domain), cache(_cache) {}
+        void simulate(uint64_t startCycle) {cache->simulateWbAbsorb(this, startCycle);}
+};
+
+class WbDrainEvent : public TimingEvent {
+    private:
+        TimingCache* cache;
+    public:
+        WbDrainEvent(TimingCache* _cache, int32_t domain) : TimingEvent(0, 0, domain), cache(_cache) {}
+        void simulate(uint64_t startCycle) {cache->simulateWbDrain(this, startCycle);}
+};
+
 TimingCache::TimingCache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp,
-        uint32_t _accLat, uint32_t _invLat, uint32_t mshrs, uint32_t _tagLat, uint32_t _ways, uint32_t _cands, uint32_t _domain, const g_string& _name)
-    : Cache(_numLines, _cc, _array, _rp, _accLat, _invLat, _name), numMSHRs(mshrs), tagLat(_tagLat), ways(_ways), cands(_cands)
+        uint32_t _accLat, uint32_t _invLat, uint32_t _mshrs, uint32_t _mshrTargets, uint32_t _wbEntries, uint32_t _tagLat, uint32_t _ways,
+        uint32_t _cands, uint32_t _domain, const g_string& _name)
+    : Cache(_numLines, _cc, _array, _rp, _accLat, _invLat, _name), numMSHRs(_mshrs), mshrTargets(_mshrTargets), wbEntries(_wbEntries),
+      tagLat(_tagLat), ways(_ways), cands(_cands)
 {
     lastFreeCycle = 0;
     lastAccCycle = 0;
     assert(numMSHRs > 0);
     activeMisses = 0;
+    mshrs.resize(numMSHRs);
+    for (MSHR& m : mshrs) {
+        m.lineAddr = -1L;
+        m.responded = false;
+    }
+    wbOccupancy = 0;
     domain = _domain;
-    info("%s: mshrs %d domain %d", name.c_str(), numMSHRs, domain);
+    info("%s: mshrs %d (%d targets) wbEntries %d domain %d", name.c_str(), numMSHRs, mshrTargets, wbEntries, domain);
 }
 
 void TimingCache::initStats(AggregateStat* parentStat) {
@@ -107,6 +134,17 @@ void TimingCache::initStats(AggregateStat* parentStat) {
     cacheStat->append(&profMissRespLat);
     cacheStat->append(&profMissLat);
 
+    profCoalesced.init("mshrCoalesced", "Secondary misses coalesced into an in-flight MSHR");
+    profMSHRFullCycles.init("mshrFullCycles", "Cumulative cycles accesses stalled on full MSHRs");
+    cacheStat->append(&profCoalesced);
+    cacheStat->append(&profMSHRFullCycles);
+    if (wbEntries) {
+        profWbAbsorbed.init("wbAbsorbed", "PUTXs absorbed by the write buffer");
+        profWbFullCycles.init("wbFullCycles", "Cumulative cycles PUTXs stalled on a full write buffer");
+        cacheStat->append(&profWbAbsorbed);
+        cacheStat->append(&profWbFullCycles);
+    }
+
     parentStat->append(cacheStat);
 }
 
@@ -138,6 +176,7 @@ uint64_t TimingCache::access(MemReq& req) {
             //Evictions are not in the critical path in any sane implementation -- we do not include their delays
             //NOTE: We might be "evicting" an invalid line for all we know. Coherence controllers will know what to do
             evDoneCycle = cc->processEviction(req, wbLineAddr, lineId, respCycle); //if needed, send invalidates/downgrades to lower level, and wb to upper level
+            if (unlikely(array->getNumExtraVictims())) evDoneCycle = MAX(evDoneCycle, processExtraEvictions(req, respCycle));
 
             array->postinsert(req.lineAddr, &req, lineId); //do the actual insertion. NOTE: Now we must split insert into a 2-phase thing because cc unlocks us.
 
@@ -157,16 +196,26 @@ uint64_t TimingCache::access(MemReq& req) {
             assert(!writebackRecord.isValid());
             assert(!accessRecord.isValid());
             uint64_t hitLat = respCycle - req.cycle; // accLat + invLat
-            HitEvent* ev = new (evRec) HitEvent(this, hitLat, domain);
-            ev->setMinStartCycle(req.cycle);
-            tr.startEvent = tr.endEvent = ev;
+            if (wbEntries && req.type == PUTX) {
+                // Absorbed by the write buffer, then drained off the critical path
+                WbAbsorbEvent* ev = new (evRec) WbAbsorbEvent(this, hitLat, domain);
+                WbDrainEvent* dev = new (evRec) WbDrainEvent(this, domain);
+                ev->setMinStartCycle(req.cycle);
+                dev->setMinStartCycle(req.cycle);
+                ev->addChild(dev, evRec);
+                tr.startEvent = tr.endEvent = ev;
+            } else {
+                HitEvent* ev = new (evRec) HitEvent(this, req.lineAddr, hitLat, domain);
+                ev->setMinStartCycle(req.cycle);
+                tr.startEvent = tr.endEvent = ev;
+            }
         } else {
             assert_msg(getDoneCycle == respCycle, "gdc %ld rc %ld", getDoneCycle, respCycle);
 
             // Miss events:
             // MissStart (does high-prio lookup) -> getEvent || evictionEvent || replEvent (if needed) -> MissWriteback
 
-            MissStartEvent* mse = new (evRec) MissStartEvent(this, accLat, domain);
+            MissStartEvent* mse = new (evRec) MissStartEvent(this, req.lineAddr, accLat, domain);
             MissResponseEvent* mre = new (evRec) MissResponseEvent(this, mse, domain);
             MissWritebackEvent* mwe = new (evRec) MissWritebackEvent(this, mse, accLat, domain);
 
@@ -295,15 +344,40 @@ uint64_t TimingCache::tryLowPrioAccess(uint64_t cycle) {
     }
 }
 
+int32_t TimingCache::findMSHR(Address lineAddr) {
+    for (uint32_t m = 0; m < numMSHRs; m++) {
+        if (mshrs[m].lineAddr == lineAddr) return m;
+    }
+    return -1;
+}
+
+void TimingCache::wakeAll(WaitQueue& queue, uint64_t cycle, Counter& stallCycles) {
+    for (auto& qe : queue) {
+        stallCycles.inc(cycle - qe.second);
+        qe.first->requeue(cycle);
+    }
+    queue.clear();
+}
+
 void TimingCache::simulateHit(HitEvent* ev, uint64_t cycle) {
-    if (activeMisses < numMSHRs) {
+    int32_t m = (mshrTargets && activeMisses)? findMSHR(ev->lineAddr) : -1;
+    if (m != -1 && !mshrs[m].responded) {
+        // The line is still being filled (the bound phase saw it already there); wait for the fill
+        ev->hold();
+        if (mshrs[m].targets.size() < mshrTargets) {
+            mshrs[m].targets.push_back(ev);
+            profCoalesced.inc();
+        } else {
+            pendingQueue.push_back(std::make_pair(ev, cycle));
+        }
+    } else if (activeMisses < numMSHRs) {
         uint64_t lookupCycle = highPrioAccess(cycle);
         profHitLat.inc(lookupCycle-cycle);
         ev->done(lookupCycle);  // postDelay includes accLat + invalLat
     } else {
         // queue
         ev->hold();
-        pendingQueue.push_back(ev);
+        pendingQueue.push_back(std::make_pair(ev, cycle));
     }
 }
 
@@ -312,18 +386,28 @@ void TimingCache::simulateMissStart(MissStartEvent* ev, uint64_t cycle) {
         activeMisses++;
         profOccHist.transition(activeMisses, cycle);
 
+        int32_t m = findMSHR(-1L);
+        assert(m != -1);
+        mshrs[m].lineAddr = ev->lineAddr;
+        mshrs[m].responded = false;
+        ev->mshr = m;
+
         ev->startCycle = cycle;
         uint64_t lookupCycle = highPrioAccess(cycle);
         ev->done(lookupCycle);
     } else {
         //info("Miss, all MSHRs used, queuing");
         ev->hold();
-        pendingQueue.push_back(ev);
+        pendingQueue.push_back(std::make_pair(ev, cycle));
     }
 }
 
 void TimingCache::simulateMissResponse(MissResponseEvent* ev, uint64_t cycle, MissStartEvent* mse) {
     profMissRespLat.inc(cycle - mse->startCycle);
+    MSHR& m = mshrs[mse->mshr];
+    m.responded = true;
+    for (TimingEvent* tev : m.targets) tev->requeue(cycle);
+    m.targets.clear();
     ev->done(cycle);
 }
 
@@ -334,13 +418,10 @@ void TimingCache::simulateMissWriteback(MissWritebackEvent* ev, uint64_t cycle,
         profMissLat.inc(cycle - mse->startCycle);
         activeMisses--;
         profOccHist.transition(activeMisses, lookupCycle);
-        if (!pendingQueue.empty()) {
-            //info("XXX %ld elems in pending queue", pendingQueue.size());
-            for (TimingEvent* qev : pendingQueue) {
-                qev->requeue(cycle+1);
-            }
-            pendingQueue.clear();
-        }
+        assert(mshrs[mse->mshr].targets.empty());
+        mshrs[mse->mshr].lineAddr = -1L;
+        //info("XXX %ld elems in pending queue", pendingQueue.size());
+        wakeAll(pendingQueue, cycle+1, profMSHRFullCycles);
         ev->done(cycle);
     } else {
         ev->requeue(cycle+1);
@@ -362,3 +443,25 @@ void TimingCache::simulateReplAccess(ReplAccessEvent* ev, uint64_t cycle) {
     }
 }
 
+void TimingCache::simulateWbAbsorb(WbAbsorbEvent* ev, uint64_t cycle) {
+    if (wbOccupancy < wbEntries) {
+        wbOccupancy++;
+        profWbAbsorbed.inc();
+        ev->done(cycle);
+    } else {
+        ev->hold();
+        wbPendingQueue.push_back(std::make_pair(ev, cycle));
+    }
+}
+
+void TimingCache::simulateWbDrain(WbDrainEvent* ev, uint64_t cycle) {
+    uint64_t lookupCycle = tryLowPrioAccess(cycle);
+    if (lookupCycle) { //written into the array, free the entry
+        assert(wbOccupancy);
+        wbOccupancy--;
+        wakeAll(wbPendingQueue, cycle+1, profWbFullCycles);
+        ev->done(cycle);
+    } else {
+        ev->requeue(cycle+1);
+    }
+}
@@ -34,17 +34,50 @@ class MissStartEvent;
 class MissResponseEvent;
 class MissWritebackEvent;
 class ReplAccessEvent;
+class WbAbsorbEvent;
+class WbDrainEvent;
 class TimingEvent;
 
+/* Weave-phase model: a single tag port shared by high-priority (demand) and
+ * low-priority (writeback, replacement) accesses, and numMSHRs per-line miss
+ * status holding registers.
+ *
+ * Each MSHR tracks its line until the miss response. Accesses whose bound
+ * phase found the line present, but that reach the cache while its fill is
+ * still in flight, are secondary misses: they coalesce into the line's MSHR
+ * (up to mshrTargets of them) and complete when the fill arrives, without
+ * taking another MSHR. Coalescing is opt-in: with mshrTargets = 0 (the
+ * default), they are handled as before, as regular hits.
+ *
+ * With a write buffer (wbEntries > 0), PUTXs from children are absorbed into
+ * it and drained through low-priority tag accesses, so they don't compete
+ * with demand accesses; PUTXs wait only if the buffer is full.
+ */
 class TimingCache : public Cache {
     private:
+        struct MSHR {
+            Address lineAddr; // -1 if free
+            bool responded; // fill arrived, waiting on writeback to free
+            g_vector<TimingEvent*> targets; // coalesced secondary misses
+        };
+
+        // Events held until a resource frees up, with the cycle they started waiting
+        typedef g_vector<std::pair<TimingEvent*, uint64_t> > WaitQueue;
+
         uint64_t lastAccCycle, lastFreeCycle;
         uint32_t numMSHRs, activeMisses;
-        g_vector<TimingEvent*> pendingQueue;
+        uint32_t mshrTargets; // 0 -> no coalescing
+        g_vector<MSHR> mshrs;
+        WaitQueue pendingQueue;
+
+        uint32_t wbEntries, wbOccupancy;
+        WaitQueue wbPendingQueue;
 
         // Stats
         CycleBreakdownStat profOccHist;
         Counter profHitLat, profMissRespLat, profMissLat;
+        Counter profCoalesced, profMSHRFullCycles;
+        Counter profWbAbsorbed, profWbFullCycles;
 
         uint32_t domain;
 
@@ -57,7 +90,7 @@ class TimingCache : public Cache {
 
     public:
         TimingCache(uint32_t _numLines, CC* _cc, CacheArray* _array, ReplPolicy* _rp, uint32_t _accLat, uint32_t _invLat, uint32_t mshrs,
-                uint32_t tagLat, uint32_t ways, uint32_t cands, uint32_t _domain, const g_string& _name);
+                uint32_t mshrTargets, uint32_t wbEntries, uint32_t tagLat, uint32_t ways, uint32_t cands, uint32_t _domain, const g_string& _name);
         void initStats(AggregateStat* parentStat);
 
         uint64_t access(MemReq& req);
@@ -67,10 +100,15 @@ class TimingCache : public Cache {
         void simulateMissResponse(MissResponseEvent* ev, uint64_t cycle, MissStartEvent* mse);
         void simulateMissWriteback(MissWritebackEvent* ev, uint64_t cycle, MissStartEvent* mse);
         void simulateReplAccess(ReplAccessEvent* ev, uint64_t cycle);
+        void simulateWbAbsorb(WbAbsorbEvent* ev, uint64_t cycle);
+        void simulateWbDrain(WbDrainEvent* ev, uint64_t cycle);
 
     private:
         uint64_t highPrioAccess(uint64_t cycle);
         uint64_t tryLowPrioAccess(uint64_t cycle);
+
+        int32_t findMSHR(Address lineAddr);
+        void wakeAll(WaitQueue& queue, uint64_t cycle, Counter& stallCycles);
 };
 
 #endif  // TIMING_CACHE_H_
@@ -31,7 +31,7 @@
 //#define DEBUG_MSG(args...) info(args)
 
 TimingCore::TimingCore(FilterCache* _l1i, FilterCache* _l1d, uint32_t _domain, g_string& _name)
-    : Core(_name), l1i(_l1i), l1d(_l1d), instrs(0), curCycle(0), cRec(_domain, _name) {}
+    : Core(_name), l1i(_l1i), l1d(_l1d), instrs(0), curCycle(0), rmwHeld(false), cRec(_domain, _name) {}
 
 uint64_t TimingCore::getPhaseCycles() const {
     return curCycle % zinfo->phaseLength;
@@ -87,6 +87,17 @@ void TimingCore::storeAndRecord(Address addr, Address pc) {
     uint64_t startCycle = curCycle;
     curCycle = l1d->store(addr, curCycle, pc);
     cRec.record(startCycle);
+    if (unlikely(rmwHeld)) {
+        l1d->rmwRelease(curCycle);
+        rmwHeld = false;
+    }
+}
+
+void TimingCore::rmwAndRecord(Address addr, Address pc) {
+    uint64_t startCycle = curCycle;
+    curCycle = l1d->rmwAcquire(addr, curCycle, pc);
+    cRec.record(startCycle);
+    rmwHeld = true;
 }
 
 void TimingCore::bblAndRecord(Address bblAddr, BblInfo* bblInfo) {
@@ -103,7 +114,7 @@ void TimingCore::bblAndRecord(Address bblAddr, BblInfo* bblInfo) {
 
 
 InstrFuncPtrs TimingCore::GetFuncPtrs() {
-    return {LoadAndRecordFunc, StoreAndRecordFunc, BblAndRecordFunc, BranchFunc, PredLoadAndRecordFunc, PredStoreAndRecordFunc, FPTR_ANALYSIS, {0}};
+    return {LoadAndRecordFunc, StoreAndRecordFunc, BblAndRecordFunc, BranchFunc, PredLoadAndRecordFunc, PredStoreAndRecordFunc, RMWAndRecordFunc, FPTR_ANALYSIS};
 }
 
 void TimingCore::LoadAndRecordFunc(THREADID tid, ADDRINT loadPc, ADDRINT addr) {
@@ -114,6 +125,10 @@ void TimingCore::StoreAndRecordFunc(THREADID tid, ADDRINT storePc, ADDRINT addr)
     static_cast<TimingCore*>(cores[tid])->storeAndRecord(addr, storePc);
 }
 
+void TimingCore::RMWAndRecordFunc(THREADID tid, ADDRINT rmwPc, ADDRINT addr) {
+    static_cast<TimingCore*>(cores[tid])->rmwAndRecord(addr, rmwPc);
+}
+
 void TimingCore::BblAndRecordFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo) {
     TimingCore* core = static_cast<TimingCore*>(cores[tid]);
     core->bblAndRecord(bblAddr, bblInfo);
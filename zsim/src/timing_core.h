@@ -44,6 +44,8 @@ class TimingCore : public Core {
         uint64_t curCycle; //phase 1 clock
         uint64_t phaseEndCycle; //phase 1 end clock
 
+        bool rmwHeld; //an atomic RMW holds its line until its store completes
+
         CoreRecorder cRec;
 
     public:
@@ -68,6 +70,7 @@ class TimingCore : public Core {
     private:
         inline void loadAndRecord(Address addr, Address pc);
         inline void storeAndRecord(Address addr, Address pc);
+        inline void rmwAndRecord(Address addr, Address pc);
         inline void bblAndRecord(Address bblAddr, BblInfo* bblInstrs);
         inline void record(uint64_t startCycle);
 
@@ -76,6 +79,7 @@ class TimingCore : public Core {
         static void BblAndRecordFunc(THREADID tid, ADDRINT bblAddr, BblInfo* bblInfo);
         static void PredLoadAndRecordFunc(THREADID tid, ADDRINT predLoadPc, ADDRINT addr, BOOL pred);
         static void PredStoreAndRecordFunc(THREADID tid, ADDRINT predStorePc, ADDRINT addr, BOOL pred);
+        static void RMWAndRecordFunc(THREADID tid, ADDRINT rmwPc, ADDRINT addr);
 
         static void BranchFunc(THREADID, ADDRINT, BOOL, ADDRINT, ADDRINT) {}
 } ATTR_LINE_ALIGNED;
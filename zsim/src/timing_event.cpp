@@ -48,6 +48,12 @@ void TimingEvent::queue(uint64_t nextCycle) {
     zinfo->contentionSim->enqueueSynced(this, nextCycle);
 }
 
+void TimingEvent::queue(uint64_t nextCycle, uint32_t srcId) {
+    assert(state == EV_NONE && numParents == 0);
+    state = EV_QUEUED;
+    zinfo->contentionSim->enqueueSynced(this, nextCycle, srcId);
+}
+
 void TimingEvent::requeue(uint64_t nextCycle) {
     assert(numParents == 0);
     assert(state == EV_RUNNING || state == EV_HELD);
@@ -173,3 +179,29 @@ void CrossingEvent::simulate(uint64_t simCycle) {
     done(dCycle);
 }
 
+// Merges two records into one that starts both and ends when both end (writebacks may have no end event)
+TimingRecord MergeTimingRecords(EventRecorder* evRec, const TimingRecord& a, const TimingRecord& b) {
+    TimingRecord m = a;
+    m.reqCycle = MIN(a.reqCycle, b.reqCycle);
+    m.respCycle = MAX(a.respCycle, b.respCycle);
+
+    DelayEvent* startEv = new (evRec) DelayEvent(0);
+    startEv->setMinStartCycle(m.reqCycle);
+    DelayEvent* endEv = (a.endEvent || b.endEvent)? new (evRec) DelayEvent(0) : nullptr;
+    if (endEv) endEv->setMinStartCycle(m.respCycle);
+
+    for (const TimingRecord* r : {&a, &b}) {
+        DelayEvent* dStart = new (evRec) DelayEvent(r->reqCycle - m.reqCycle);
+        dStart->setMinStartCycle(m.reqCycle);
+        startEv->addChild(dStart, evRec)->addChild(r->startEvent, evRec);
+        if (r->endEvent) {
+            DelayEvent* dEnd = new (evRec) DelayEvent(m.respCycle - r->respCycle);
+            dEnd->setMinStartCycle(r->respCycle);
+            r->endEvent->addChild(dEnd, evRec)->addChild(endEv, evRec);
+        }
+    }
+
+    m.startEvent = startEv;
+    m.endEvent = endEv;
+    return m;
+}
@@ -146,6 +146,7 @@ class TimingEvent {
         //queue for the first time
         //always happens on PHASE 1 (bound), and is synchronized
         void queue(uint64_t qCycle); //see cpp
+        void queue(uint64_t qCycle, uint32_t srcId); //same, but staged without locking; srcId must be the caller's core
 
         //mark an already-dequeued event for reexecution (simulate will be called again at the specified cycle)
         //always happens on PHASE 2 (weave), and is unsynchronized
@@ -359,5 +360,7 @@ class CrossingEvent : public TimingEvent {
         friend class ContentionSim;
 };
 
+// Merges two records into one that starts both and ends when both end (writebacks may have no end event)
+TimingRecord MergeTimingRecords(EventRecorder* evRec, const TimingRecord& a, const TimingRecord& b);
 
 #endif  // TIMING_EVENT_H_
@@ -74,11 +74,14 @@ void TraceDriver::setParent(MemObject* _parent) {
     parent = _parent;
 }
 
-uint64_t TraceDriver::invalidate(uint32_t childId, Address lineAddr, InvType type, bool* reqWriteback, uint64_t reqCycle, uint32_t srcId) {
+uint64_t TraceDriver::invalidate(uint32_t childId, Address lineAddr, InvType type, bool* reqWriteback, uint64_t reqCycle, uint32_t srcId, bool imprecise) {
     assert(childId < numChildren);
     std::unordered_map<Address, MESIState>& cStore = children[childId].cStore;
     std::unordered_map<Address, MESIState>::iterator it = cStore.find(lineAddr);
-    assert((it != cStore.end()));
+    if (it == cStore.end()) {
+        assert(imprecise); //parent's sharer set may include children without the line
+        return 0;
+    }
     *reqWriteback = (it->second == M);
     if (type == INVX) {
         it->second = S;
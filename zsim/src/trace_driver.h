@@ -69,7 +69,7 @@ class TraceDriver {
         void initStats(AggregateStat* parentStat);
         void setParent(MemObject* _parent);
 
-        uint64_t invalidate(uint32_t childId, Address lineAddr, InvType type, bool* reqWriteback, uint64_t reqCycle, uint32_t srcId);
+        uint64_t invalidate(uint32_t childId, Address lineAddr, InvType type, bool* reqWriteback, uint64_t reqCycle, uint32_t srcId, bool imprecise);
 
         //Returns false if done, true otherwise
         bool executePhase();
@@ -97,7 +97,7 @@ class TraceDriverProxyCache : public BaseCache {
 
         uint64_t access(MemReq& req) {panic("Should never be called");}
         uint64_t invalidate(const InvReq& req) {
-            return drv->invalidate(id, req.lineAddr, req.type, req.writeback, req.cycle, req.srcId);
+            return drv->invalidate(id, req.lineAddr, req.type, req.writeback, req.cycle, req.srcId, req.imprecise);
         }
 };
 
@@ -26,6 +26,8 @@
 #ifndef WEAVE_MD1_MEM_H_
 #define WEAVE_MD1_MEM_H_
 
+#include <algorithm>
+#include "g_std/g_vector.h"
 #include "mem_ctrls.h"
 #include "timing_event.h"
 #include "zsim.h"
@@ -83,6 +85,134 @@ class WeaveMD1Memory : public MD1Memory {
         }
 };
 
+/* Bandwidth-limited weave-phase memory, between WeaveMD1Memory and DDRMemory
+ * in cost and accuracy. WeaveMD1Memory only adjusts its latency at phase
+ * boundaries, so bursts within a phase are invisible. Instead, this model
+ * tracks when each channel's data bus frees up: every access (read or dirty
+ * writeback) occupies its channel for one line transfer, and waits in the weave
+ * phase if the channel is busy. Unloaded latency is zeroLoadLatency, which is
+ * what the bound phase sees. No banks, rows, or scheduling, so it is much
+ * cheaper than DDRMemory.
+ */
+class WeaveBWMemory;
+
+class WeaveBWAccEvent : public TimingEvent {
+    private:
+        WeaveBWMemory* mem;
+        Address lineAddr;
+        bool write;
+        uint32_t bytes;  // 0 -> whole line
+
+    public:
+        WeaveBWAccEvent(WeaveBWMemory* _mem, Address _lineAddr, bool _write, uint32_t _bytes, int32_t domain, uint32_t preDelay, uint32_t postDelay)
+            : TimingEvent(preDelay, postDelay, domain), mem(_mem), lineAddr(_lineAddr), write(_write), bytes(_bytes) {}
+
+        void simulate(uint64_t startCycle);
+};
+
+class WeaveBWMemory : public MemObject {
+    private:
+        static const uint64_t TICKS_PER_CYCLE = 256;  // channels track occupancy in fixed-point to handle fractional transfer times
+
+        const uint32_t lineSize;
+        const uint32_t zeroLoadLatency;
+        const uint32_t domain;
+        const uint32_t channels;
+        uint32_t preDelay, postDelay;
+        uint64_t transferTicks;  // per line, on one channel
+        g_vector<uint64_t> channelFreeTicks;  // only touched in the weave phase, by this domain
+
+        Counter profReads;
+        Counter profWrites;
+        Counter profTotalRdLat;
+        Counter profTotalWrLat;
+        Counter profQueuedAccs;
+        Counter profQueueCycles;
+
+        g_string name;
+
+    public:
+        WeaveBWMemory(uint32_t lineSize, uint32_t megacyclesPerSecond, uint32_t megabytesPerSecond, uint32_t _channels,
+                uint32_t _zeroLoadLatency, uint32_t _domain, g_string& _name) :
+            lineSize(lineSize), zeroLoadLatency(_zeroLoadLatency), domain(_domain), channels(_channels), name(_name)
+        {
+            if (!channels) panic("%s: need at least one channel", name.c_str());
+            preDelay = zeroLoadLatency/2;
+            postDelay = zeroLoadLatency - preDelay;
+            // Bandwidth is split evenly among channels
+            transferTicks = ((uint64_t)lineSize)*channels*megacyclesPerSecond*TICKS_PER_CYCLE/megabytesPerSecond;
+            if (!transferTicks) transferTicks = 1;
+            channelFreeTicks.resize(channels, 0);
+            info("%s: %d channels, %.2f cycles/line/channel", name.c_str(), channels, ((double)transferTicks)/TICKS_PER_CYCLE);
+        }
+
+        void initStats(AggregateStat* parentStat) {
+            AggregateStat* memStats = new AggregateStat();
+            memStats->init(name.c_str(), "Memory controller stats");
+            profReads.init("rd", "Read requests"); memStats->append(&profReads);
+            profWrites.init("wr", "Write requests"); memStats->append(&profWrites);
+            profTotalRdLat.init("rdlat", "Total latency experienced by read requests"); memStats->append(&profTotalRdLat);
+            profTotalWrLat.init("wrlat", "Total latency experienced by write requests"); memStats->append(&profTotalWrLat);
+            profQueuedAccs.init("queued", "Requests that waited for a busy channel"); memStats->append(&profQueuedAccs);
+            profQueueCycles.init("qcycles", "Total cycles requests waited for a busy channel"); memStats->append(&profQueueCycles);
+            parentStat->append(memStats);
+        }
+
+        const char* getName() {return name.c_str();}
+
+        uint64_t access(MemReq& req) {
+            switch (req.type) {
+                case PUTS:
+                case PUTX:
+                    *req.state = I;
+                    break;
+                case GETS:
+                    *req.state = req.is(MemReq::NOEXCL)? S : E;
+                    break;
+                case GETX:
+                    *req.state = M;
+                    break;
+
+                default: panic("!?");
+            }
+
+            uint64_t respCycle = req.cycle + ((req.type == PUTS)? 0 : zeroLoadLatency);
+            if ((req.type != PUTS) && zinfo->eventRecorders[req.srcId]) {
+                WeaveBWAccEvent* memEv = new (zinfo->eventRecorders[req.srcId]) WeaveBWAccEvent(this, req.lineAddr, req.type == PUTX, req.compBytes, domain, preDelay, postDelay);
+                memEv->setMinStartCycle(req.cycle);
+                TimingRecord tr = {req.lineAddr, req.cycle, respCycle, req.type, memEv, memEv};
+                zinfo->eventRecorders[req.srcId]->pushRecord(tr);
+            }
+            return respCycle;
+        }
+
+        // Weave phase: returns the cycles the access waits for its channel
+        uint64_t transfer(Address lineAddr, bool write, uint32_t bytes, uint64_t startCycle) {
+            uint64_t& freeTicks = channelFreeTicks[lineAddr % channels];
+            uint64_t startTicks = std::max(startCycle*TICKS_PER_CYCLE, freeTicks);
+            // Compressed lines (see CompressedMemory) occupy the channel for less time
+            freeTicks = startTicks + (bytes? std::max(1ul, transferTicks*bytes/lineSize) : transferTicks);
+            uint64_t queueCycles = (startTicks + TICKS_PER_CYCLE - 1)/TICKS_PER_CYCLE - startCycle;
+
+            if (queueCycles) {
+                profQueuedAccs.inc();
+                profQueueCycles.inc(queueCycles);
+            }
+            if (write) {
+                profWrites.inc();
+                profTotalWrLat.inc(zeroLoadLatency + queueCycles);
+            } else {
+                profReads.inc();
+                profTotalRdLat.inc(zeroLoadLatency + queueCycles);
+            }
+            return queueCycles;
+        }
+};
+
+inline void WeaveBWAccEvent::simulate(uint64_t startCycle) {
+    done(startCycle + mem->transfer(lineAddr, write, bytes, startCycle));
+}
+
 // OK, even simpler...
 class WeaveSimpleMemory : public SimpleMemory {
     private:
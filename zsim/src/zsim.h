@@ -50,6 +50,7 @@ class PortVirtualizer;
 class VectorCounter;
 class AccessTraceWriter;
 class TraceDriver;
+class LockContention;
 template <typename T> class g_vector;
 
 struct ClockDomainInfo {
@@ -185,6 +186,9 @@ struct GlobSimInfo {
     bool traceDriven;
     TraceDriver* traceDriver;
 
+    // Atomic RMW contention profiling (null if disabled)
+    LockContention* lockContention;
+
     // Approximate computing
     bool approximate;
 };